@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file copy_benchmark.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Sends frames over loopback through the two paths of tcp::basic_io_manager::send, and reports the payload
+ * octets copied per message:
+ *  - copied: the payload is passed by const reference, and copied into its frame. Every frame went through
+ *            such a copy (header included) before the header and the payload of frames were written together.
+ *  - gathered: the payload is handed over by rvalue reference, and written as is after its header.
+ *
+ * usage: copy_benchmark [messages [payload size]]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <breep/network/tcp.hpp>
+
+namespace {
+
+	struct result {
+		double seconds;
+		double copied_per_message;
+	};
+
+	result run(unsigned short port, std::size_t messages, std::size_t payload_size, bool gathered) {
+		breep::tcp::peer_manager sender(port);
+		breep::tcp::peer_manager receiver(static_cast<unsigned short>(port + 1));
+
+		std::atomic<std::size_t> received{0};
+		receiver.add_data_listener([&received](breep::tcp::peer_manager&, const breep::tcp::peer&, breep::cuint8_random_iterator,
+		                                       std::size_t, bool) {
+			++received;
+		});
+
+		sender.run();
+		if (!receiver.connect(boost::asio::ip::address_v4::loopback(), port)) {
+			std::cerr << "Failed to connect.\n";
+			std::exit(1);
+		}
+		for (int i = 0 ; i < 100 && sender.peers().empty() ; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		const breep::tcp::peer& target = sender.peers().begin()->second;
+		const uint64_t copied_before = sender.io().statistics().octets_copied;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0 ; i < messages ; ++i) {
+			std::vector<uint8_t> payload(payload_size, static_cast<uint8_t>(i));
+			if (gathered) {
+				sender.io().send(breep::commands::send_to_all, std::move(payload), target);
+			} else {
+				sender.io().send(breep::commands::send_to_all, payload, target);
+			}
+		}
+		while (received < messages) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		const uint64_t copied = sender.io().statistics().octets_copied - copied_before;
+		receiver.disconnect();
+		sender.disconnect();
+		receiver.join();
+		sender.join();
+
+		return {std::chrono::duration<double>(elapsed).count(), static_cast<double>(copied) / static_cast<double>(messages)};
+	}
+}
+
+int main(int argc, char* argv[]) {
+	const std::size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	const std::size_t payload_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+
+	std::cout << messages << " messages of " << payload_size << " octets\n";
+	unsigned short port = 3590;
+	for (bool gathered : {false, true}) {
+		const result r = run(port, messages, payload_size, gathered);
+		port = static_cast<unsigned short>(port + 2);
+		std::cout << (gathered ? "gathered: " : "copied:   ")
+		          << r.copied_per_message << " octets copied per message, "
+		          << static_cast<std::size_t>(static_cast<double>(messages) / r.seconds) << " msgs/s\n";
+	}
+	return 0;
+}
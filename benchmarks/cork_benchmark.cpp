@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file cork_benchmark.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Runs the benchmark workload over loopback tcp (without Nagle's algorithm) with corking disabled, then with
+ * increasing cork deadlines, and finally with the longest deadline but flushing after each burst (as an
+ * application flushing at the end of its ticks would). Prints the throughput and the latency percentiles of each.
+ *
+ * usage: cork_benchmark [throughput messages [latency messages]]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <breep/network/tcp.hpp>
+
+#include "workload.hpp"
+
+namespace {
+
+	constexpr std::size_t cork_octets = 64 * 1024;
+
+	benchmark::workload_result run(unsigned short port, std::chrono::microseconds delay, bool flush,
+	                               benchmark::workload_parameters parameters) {
+		breep::tcp::network sender(port);
+		breep::tcp::network receiver(static_cast<unsigned short>(port + 1));
+		// Nagle's algorithm would hold the small messages as well, hiding the effect of the cork deadline
+		sender.socket_options(breep::socket_options::low_latency());
+		receiver.socket_options(breep::socket_options::low_latency());
+		if (delay.count() != 0) {
+			sender.cork(cork_octets, delay);
+		}
+		if (flush) {
+			parameters.after_burst = [&sender] { sender.flush(); };
+		}
+		return benchmark::run_workload(sender, receiver, port, parameters);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	benchmark::workload_parameters parameters;
+	if (argc > 1) {
+		parameters.throughput_messages = std::strtoul(argv[1], nullptr, 10);
+	}
+	if (argc > 2) {
+		parameters.latency_messages = std::strtoul(argv[2], nullptr, 10);
+	}
+
+	unsigned short port = 3600;
+	benchmark::print_result("uncorked          ", run(port, std::chrono::microseconds(0), false, parameters));
+	for (long delay : {20, 100, 500, 2000}) {
+		port = static_cast<unsigned short>(port + 2);
+		const std::string name = "corked " + std::to_string(delay) + " us";
+		benchmark::print_result((name + std::string(18 - name.size(), ' ')).c_str(),
+		                        run(port, std::chrono::microseconds(delay), false, parameters));
+	}
+	port = static_cast<unsigned short>(port + 2);
+	benchmark::print_result("corked 2000 us, flushed", run(port, std::chrono::microseconds(2000), true, parameters));
+	return 0;
+}
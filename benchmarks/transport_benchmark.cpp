@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file transport_benchmark.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Runs the benchmark workload between two peers of the same host, over loopback tcp (tcp::ip_transport) and
+ * over unix domain sockets (local::unix_transport), and prints the throughput and the latency percentiles of each.
+ *
+ * usage: transport_benchmark [throughput messages [latency messages]]
+ */
+
+#include <cstdlib>
+
+#include <breep/network/tcp.hpp>
+#include <breep/network/local.hpp>
+
+#include "workload.hpp"
+
+namespace {
+
+	template <typename network>
+	benchmark::workload_result run(unsigned short port, const benchmark::workload_parameters& parameters) {
+		network sender(port);
+		network receiver(static_cast<unsigned short>(port + 1));
+		sender.socket_options(breep::socket_options::low_latency());
+		receiver.socket_options(breep::socket_options::low_latency());
+		return benchmark::run_workload(sender, receiver, port, parameters);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	benchmark::workload_parameters parameters;
+	if (argc > 1) {
+		parameters.throughput_messages = std::strtoul(argv[1], nullptr, 10);
+	}
+	if (argc > 2) {
+		parameters.latency_messages = std::strtoul(argv[2], nullptr, 10);
+	}
+
+	benchmark::print_result("tcp loopback", run<breep::tcp::network>(3620, parameters));
+	benchmark::print_result("unix socket ", run<breep::local::network>(3622, parameters));
+	return 0;
+}
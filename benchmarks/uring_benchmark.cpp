@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file uring_benchmark.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Runs the benchmark workload (the one of transport_benchmark) over loopback tcp, driven by boost::asio
+ * (tcp::io_manager) then by io_uring (uring::io_manager), and prints the throughput and the latency percentiles of each.
+ *
+ * usage: uring_benchmark [throughput messages [latency messages]]
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include <breep/network/tcp.hpp>
+#include <breep/network/uring.hpp>
+
+#include "workload.hpp"
+
+namespace {
+
+	template <typename network, typename configurator>
+	benchmark::workload_result run(unsigned short port, const benchmark::workload_parameters& parameters, configurator&& configure) {
+		network sender(port);
+		network receiver(static_cast<unsigned short>(port + 1));
+		configure(sender);
+		configure(receiver);
+		return benchmark::run_workload(sender, receiver, port, parameters);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	benchmark::workload_parameters parameters;
+	if (argc > 1) {
+		parameters.throughput_messages = std::strtoul(argv[1], nullptr, 10);
+	}
+	if (argc > 2) {
+		parameters.latency_messages = std::strtoul(argv[2], nullptr, 10);
+	}
+
+	// uring::io_manager always disables Nagle's algorithm
+	benchmark::print_result("asio    ", run<breep::tcp::network>(3630, parameters, [](breep::tcp::network& net) {
+		net.socket_options(breep::socket_options::low_latency());
+	}));
+	try {
+		benchmark::print_result("io_uring", run<breep::uring::network>(3632, parameters, [](breep::uring::network&) {}));
+	} catch (const breep::unsupported_system& e) {
+		std::cerr << "io_uring: " << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
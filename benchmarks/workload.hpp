@@ -0,0 +1,133 @@
+#ifndef BREEP_BENCHMARKS_WORKLOAD_HPP
+#define BREEP_BENCHMARKS_WORKLOAD_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file workload.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Workload shared by the benchmarks: a sender streams 8-octet messages stamped with their sending time to a
+ * receiver, first back to back (throughput), then in paced bursts (latency, from send to receive).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address_v4.hpp>
+
+namespace benchmark {
+
+	struct workload_result {
+		double messages_per_second;
+		double p50_micros;
+		double p99_micros;
+	};
+
+	struct workload_parameters {
+		// messages sent back to back
+		std::size_t throughput_messages{200000};
+		// messages sent in bursts, every burst_interval
+		std::size_t latency_messages{20000};
+		std::size_t burst_size{16};
+		std::chrono::microseconds burst_interval{200};
+		// called after each burst
+		std::function<void()> after_burst{};
+	};
+
+	inline uint64_t now_nanos() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	/**
+	 * Connects \em receiver to \em sender (listening on \em port), and runs the workload from \em sender to
+	 * \em receiver. Both networks should be configured beforehand, but neither started.
+	 */
+	template <typename network>
+	workload_result run_workload(network& sender, network& receiver, unsigned short port, const workload_parameters& parameters) {
+		const std::size_t total = parameters.throughput_messages + parameters.latency_messages;
+		std::vector<uint64_t> latencies(total);
+		std::atomic<std::size_t> received{0};
+		receiver.template add_data_listener<uint64_t>([&](auto& dw) {
+			const std::size_t index = received;
+			if (index < total) {
+				latencies[index] = now_nanos() - dw.data;
+			}
+			received = index + 1;
+		});
+
+		sender.awake();
+		if (!receiver.connect(boost::asio::ip::address_v4::loopback(), port)) {
+			std::cerr << "Failed to connect.\n";
+			std::exit(1);
+		}
+		for (int i = 0 ; i < 100 && sender.peers().empty() ; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		const typename network::peer& target = sender.peers().begin()->second;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0 ; i < parameters.throughput_messages ; ++i) {
+			sender.send_object_to(target, now_nanos());
+		}
+		while (received < parameters.throughput_messages) {
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		auto next_burst = std::chrono::steady_clock::now();
+		for (std::size_t sent = 0 ; sent < parameters.latency_messages ;) {
+			std::this_thread::sleep_until(next_burst);
+			next_burst += parameters.burst_interval;
+			for (std::size_t i = 0 ; i < parameters.burst_size && sent < parameters.latency_messages ; ++i, ++sent) {
+				sender.send_object_to(target, now_nanos());
+			}
+			if (parameters.after_burst) {
+				parameters.after_burst();
+			}
+		}
+		while (received < total) {
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+
+		receiver.disconnect();
+		sender.disconnect();
+		receiver.join();
+		sender.join();
+
+		std::vector<uint64_t> paced(latencies.begin() + static_cast<std::ptrdiff_t>(parameters.throughput_messages), latencies.end());
+		std::sort(paced.begin(), paced.end());
+		workload_result result{};
+		result.messages_per_second = static_cast<double>(parameters.throughput_messages) / seconds;
+		if (!paced.empty()) {
+			result.p50_micros = static_cast<double>(paced[paced.size() / 2]) / 1000.;
+			result.p99_micros = static_cast<double>(paced[paced.size() * 99 / 100]) / 1000.;
+		}
+		return result;
+	}
+
+	inline void print_result(const char* name, const workload_result& result) {
+		std::cout << name << ": " << static_cast<uint64_t>(result.messages_per_second) << " msgs/s, latency p50 "
+		          << result.p50_micros << " us, p99 " << result.p99_micros << " us\n";
+	}
+}
+
+#endif //BREEP_BENCHMARKS_WORKLOAD_HPP
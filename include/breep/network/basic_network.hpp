@@ -137,6 +137,19 @@ namespace breep {
 		 */
 		using unlistened_type_listener = std::function<void(network& network, const peer& source, breep::deserializer& data, bool sent_to_all, uint64_t type_hash)>;
 
+		/**
+		 * Type representing a stream listener.
+		 * The function should take \em this instance of \em basic_network<io_manager>, the peer that sent the stream,
+		 * the id of the stream, the offset of the chunk in the stream, the chunk itself, and a boolean set to true for
+		 * the last chunk of the stream as parameter.
+		 *
+		 * @sa basic_network::send_stream(const peer&, stream_id, InputIterator, InputIterator, send_priority)
+		 *
+		 * @since 1.1.0
+		 */
+		using stream_listener = std::function<void(network& network, const peer& source, stream_id id, uint64_t offset,
+		                                           cuint8_random_iterator chunk, size_t chunk_size, bool last)>;
+
 		/**
 		 * internally used.
 		 */
@@ -184,22 +197,25 @@ namespace breep {
 		 * @sa basic_network::send_object_to(const peer&, const Serialiseable&) const
 		 * @sa basic_network::send_packet(const packet& pack)
 		 *
+		 * @param priority lane of the peers' send queues the object is sent in (see breep::send_priority). @since 1.1.0
+		 *
 		 * @until 1.0.0: void send_object(Serialiseable);
 	 	 * @since 1.0.0: void send_object(const Serialiseable&);
 		 */
 		template <typename Serialiseable>
-		void send_object(const Serialiseable& data) const {
+		void send_object(const Serialiseable& data, send_priority priority = send_priority::normal) const {
 			breep::serializer s;
 			s << type_traits<Serialiseable>::hash_code();
 			s << data;
 			breep::logger<network>.debug("Sending " + type_traits<Serialiseable>::universal_name());
-			m_manager.send_to_all(s.str());
+			m_manager.send_to_all(s.str(), priority);
 		}
 
 		/**
 		 * @brief Sends an object to a specific member of the network
 		 *
 		 * @param p Target peer
+		 * @param priority lane of the send queue the object is sent in (see breep::send_priority). @since 1.1.0
 		 *
 		 * @sa basic_network::send_object(const Serialiseable&) const
 		 * @sa basic_network::send_object_to_self(const T& data) const
@@ -209,13 +225,13 @@ namespace breep {
 	 	 * @since 1.0.0: void send_object_to(const peer&, const Serialiseable&);
 		 */
 		template <typename Serialiseable>
-		void send_object_to(const peer& p, const Serialiseable& data) const {
+		void send_object_to(const peer& p, const Serialiseable& data, send_priority priority = send_priority::normal) const {
 
 			breep::serializer s;
 			s << type_traits<Serialiseable>::hash_code();
 			s << data;
 			breep::logger<network>.debug("Sending private " + type_traits<Serialiseable>::universal_name() + " to " + p.id_as_string());
-			m_manager.send_to(p, s.str());
+			m_manager.send_to(p, s.str(), priority);
 		}
 
 		/**
@@ -245,30 +261,68 @@ namespace breep {
 		/**
 		 * @brief Sends a packet containing 0 or more classes
 		 * @param pack The packet to be sent.
+		 * @param priority lane of the peers' send queues the packet is sent in (see breep::send_priority). @since 1.1.0
 		 *
 		 * @sa basic_network::send_packet_to(const peer&, const packet&)
 		 * @sa basic_network::send_object(const Serialiseable&)
 		 *
 		 * @since 1.0.0
 		 */
-		void send_packet(const packet& pack) const {
+		void send_packet(const packet& pack, send_priority priority = send_priority::normal) const {
 			breep::logger<network>.debug("Sending a packet");
-			m_manager.send_to_all(pack.m_s.str());
+			m_manager.send_to_all(pack.m_s.str(), priority);
 		}
 
 		/**
 		 * @brief Sends a packet containing 0 or more classes
 		 * @param pack The packet to be sent.
 		 * @param target Target peer
+		 * @param priority lane of the send queue the packet is sent in (see breep::send_priority). @since 1.1.0
 		 *
 		 * @sa basic_network::send_packet(const packet&)
 		 * @sa basic_network::send_object_to(const peer& const Serialiseable&)
 		 *
 		 * @since 1.0.0
 		 */
-		void send_packet_to(const peer& target, const packet& pack) const {
+		void send_packet_to(const peer& target, const packet& pack, send_priority priority = send_priority::normal) const {
 			breep::logger<network>.debug("Sending a private packet");
-			m_manager.send_to(target, pack.m_s.str());
+			m_manager.send_to(target, pack.m_s.str(), priority);
+		}
+
+		/**
+		 * @brief Streams the octets of [begin, end) to a specific member of the network, without holding them all in memory.
+		 * @details The data is sent in chunks of stream_chunk_size() octets, handed one by one to the stream listeners of
+		 *          \em target. At most stream_window() octets are on their way at a time: this call blocks until
+		 *          \em target catches up, and returns once it received the whole stream. The chunks are sent in the
+		 *          \em priority lane, letting other data through.
+		 *
+		 * @param target   Target peer
+		 * @param id       Id of the stream, which must not already be in use towards \em target.
+		 * @param priority lane of the send queue the chunks are sent in (see breep::send_priority).
+		 * @return false if \em target disconnected before receiving the whole stream.
+		 *
+		 * @throws invalid_state if a stream with the same id is already being sent to \em target.
+		 * @attention Must not be called from a listener, from the network's thread.
+		 *
+		 * @sa basic_network::add_stream_listener(stream_listener)
+		 *
+		 * @since 1.1.0
+		 */
+		template <typename InputIterator>
+		bool send_stream(const peer& target, stream_id id, InputIterator begin, InputIterator end, send_priority priority = send_priority::low) {
+			breep::logger<network>.debug("Sending stream " + std::to_string(id) + " to " + target.id_as_string());
+			return m_manager.send_stream(target, id, begin, end, priority);
+		}
+
+		/**
+		 * @brief Streams the content of \em input (an std::ifstream, for example) to a specific member of the network.
+		 * @copydetails basic_network::send_stream(const peer&, stream_id, InputIterator, InputIterator, send_priority)
+		 *
+		 * @since 1.1.0
+		 */
+		bool send_stream(const peer& target, stream_id id, std::istream& input, send_priority priority = send_priority::low) {
+			breep::logger<network>.debug("Sending stream " + std::to_string(id) + " to " + target.id_as_string());
+			return m_manager.send_stream(target, id, input, priority);
 		}
 
 		/**
@@ -433,6 +487,41 @@ namespace breep {
 			return m_dc_listeners.erase(id) > 0;
 		}
 
+		/**
+		 * @brief Adds a listener for incoming streams
+		 * @details Each time a chunk of a stream is received, the method passed as a parameter is called,
+		 *          with parameters specified in \em network::stream_listener. The sender may send more of the
+		 *          stream once every listener returned.
+		 * @param listener The new listener
+		 * @return An id used to remove the listener
+		 *
+		 * @sa network::remove_stream_listener(listener_id)
+		 *
+		 * @since 1.1.0
+		 */
+		listener_id add_stream_listener(stream_listener listener) {
+			return m_manager.add_stream_listener(
+					[this, listener = std::move(listener)] (peer_manager&, const peer& source, stream_id id, uint64_t offset,
+					                                        cuint8_random_iterator chunk, size_t chunk_size, bool last) {
+						listener(*this, source, id, offset, chunk, chunk_size, last);
+					}
+			);
+		}
+
+		/**
+		 * @brief Removes a listener
+		 * @details Stops the listener from being called
+		 * @param id id of the listener to remove
+		 * @return true if a listener was removed, false otherwise
+		 *
+		 * @attention Results in a dead lock if called from a stream listener, from the network's thread
+		 *
+		 * @since 1.1.0
+		 */
+		bool remove_stream_listener(listener_id id) {
+			return m_manager.remove_stream_listener(id);
+		}
+
 		/**
 		 * @return The list of connected peers (you excluded)
 		 *
@@ -590,6 +679,147 @@ namespace breep {
 			}
 		}
 
+		/**
+		 * @brief Sets the maximum number of connections opened at once when joining a network.
+		 *
+		 * @since 1.1.0
+		 */
+		void max_parallel_connections(std::size_t count) {
+			m_manager.max_parallel_connections(count);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t max_parallel_connections() const {
+			return m_manager.max_parallel_connections();
+		}
+
+		/**
+		 * @brief Sets the size of the chunks streams are sent in (64 KiB by default).
+		 *
+		 * @since 1.1.0
+		 */
+		void stream_chunk_size(std::size_t octets) {
+			m_manager.stream_chunk_size(octets);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t stream_chunk_size() const {
+			return m_manager.stream_chunk_size();
+		}
+
+		/**
+		 * @brief Sets the number of octets of a stream that may be on their way to its target (1 MiB by default),
+		 *        bounding the memory a stream takes on both sides.
+		 *
+		 * @since 1.1.0
+		 */
+		void stream_window(std::size_t octets) {
+			m_manager.stream_window(octets);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t stream_window() const {
+			return m_manager.stream_window();
+		}
+
+		/**
+		 * @brief Bounds the send queue of each peer (see breep::send_queue_limits).
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void send_queue_limits(const breep::send_queue_limits& limits) {
+			m_manager.io().send_queue_limits(limits);
+		}
+
+		/**
+		 * @brief Sets the listener called when the send queue of a peer goes over its high watermark,
+		 *        letting producers throttle.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void set_high_watermark_listener(std::function<void(const peer&)> listener) {
+			m_manager.io().set_high_watermark_listener(std::move(listener));
+		}
+
+		/**
+		 * @brief Sets the listener called when the send queue of a peer is back under its low watermark.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void set_low_watermark_listener(std::function<void(const peer&)> listener) {
+			m_manager.io().set_low_watermark_listener(std::move(listener));
+		}
+
+		/**
+		 * @brief Holds the data sent to each peer until \em octets are waiting or for at most \em delay, so that
+		 *        small objects are written together.
+		 *
+		 * @since 1.1.0
+		 */
+		void cork(std::size_t octets, std::chrono::microseconds delay) {
+			m_manager.io().cork(octets, delay);
+		}
+
+		/**
+		 * @brief Stops holding data, and sends the data being held.
+		 *
+		 * @since 1.1.0
+		 */
+		void uncork() {
+			m_manager.io().uncork();
+		}
+
+		/**
+		 * @brief Sends the data held by cork() right away.
+		 *
+		 * @since 1.1.0
+		 */
+		void flush() {
+			m_manager.io().flush();
+		}
+
+		/**
+		 * @brief Sets the options of the sockets of the peers (see breep::socket_options).
+		 * @details May be called while the network is running: the sockets of the connected peers are updated.
+		 *
+		 * @since 1.1.0
+		 */
+		void socket_options(const breep::socket_options& options) {
+			m_manager.io().socket_options(options);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		breep::socket_options socket_options() const {
+			return m_manager.io().socket_options();
+		}
+
+		/**
+		 * @return the underlying io_manager, giving access to its own settings and statistics.
+		 *
+		 * @since 1.1.0
+		 */
+		io_manager& io() {
+			return m_manager.io();
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		const io_manager& io() const {
+			return m_manager.io();
+		}
+
 		/**
 		 * @brief removes all listeners of the given type
 		 *
@@ -606,7 +836,7 @@ namespace breep {
 		}
 
 		/**
-		 * @brief removes any data/connection/disconnection listeners
+		 * @brief removes any data/connection/disconnection/stream listeners
 		 * @details Also removes all object builders. As a side effect, all types are considered to never have been
 		 *         registered.
 		 *
@@ -622,6 +852,7 @@ namespace breep {
 			m_dc_listeners.clear();
 			m_disconnection_mutex.unlock();
 			m_data_listeners.clear();
+			m_manager.clear_stream_listeners();
 		}
 
 		/**
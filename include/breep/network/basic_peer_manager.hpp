@@ -24,6 +24,12 @@
 #include <unordered_map>
 #include <functional>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <istream>
+#include <deque>
+#include <memory>
+#include <algorithm>
 #include <boost/uuid/uuid.hpp>
 #include <boost/functional/hash.hpp>
 
@@ -76,7 +82,7 @@ namespace breep {
 		using peer_manager = basic_peer_manager<io_manager>;
 
 		static const unsigned short default_port = 3479;
-		using network_command_handler = void (peer_manager::*)(const peer&, const std::vector<uint8_t>&);
+		using network_command_handler = void (peer_manager::*)(const peer&, const detail::unowning_linear_container&);
 
 		/**
 		 * Type representing a connection listener
@@ -106,6 +112,17 @@ namespace breep {
 		 */
 		using disconnection_listener = std::function<void(peer_manager& network, const peer& disconnected_peer)>;
 
+		/**
+		 * Type representing a stream listener.
+		 * The function should take \em this instance of \em peer_manager, the peer that sent the stream,
+		 * the id of the stream, the offset of the chunk in the stream, the chunk itself, and a boolean set
+		 * to true for the last chunk of the stream as parameter.
+		 *
+		 * @since 1.1.0
+		 */
+		using stream_listener = std::function<void(peer_manager& network, const peer& source, stream_id id, uint64_t offset,
+		                                           cuint8_random_iterator chunk, size_t chunk_size, bool last)>;
+
 		/**
 		 * @since 0.1.0
 		 */
@@ -135,13 +152,14 @@ namespace breep {
 		 * @tparam data_container Type representing data. Exact definition
 		 *                        is to be defined by \em network_manager::send_to
 		 * @param data Data to be sent
+		 * @param priority lane of the peers' send queues the data is sent in. @since 1.1.0
 		 *
 		 * @sa basic_peer_manager::send_to(const peer&, const data_container&) const
 		 *
 	 	 * @since 0.1.0
 		 */
 		template <typename data_container>
-		void send_to_all(const data_container& data) const;
+		void send_to_all(const data_container& data, send_priority priority = send_priority::normal) const;
 
 		/**
 		 * Sends data to a specific member of the network
@@ -149,13 +167,44 @@ namespace breep {
 		 *                        is to be defined by \em network_manager_base::send
 		 * @param p Target peer
 		 * @param data Data to be sent
+		 * @param priority lane of the send queue the data is sent in. @since 1.1.0
 		 *
 		 * @sa basic_peer_manager::send_to_all(const data_container&) const
 		 *
 	 	 * @since 0.1.0
 		 */
 		template <typename data_container>
-		void send_to(const peer& p, const data_container& data) const;
+		void send_to(const peer& p, const data_container& data, send_priority priority = send_priority::normal) const;
+
+		/**
+		 * @brief Streams the octets of [begin, end) to a specific member of the network, chunk by chunk.
+		 * @details At most stream_window() octets are sent and not yet handed to the target's stream listeners at a time:
+		 *          this call blocks until the target catches up. The chunks are sent in the \em priority lane,
+		 *          letting other data through.
+		 *
+		 * @param p        Target peer
+		 * @param id       Id of the stream, which must not already be in use towards \em p.
+		 * @param priority lane of the send queue the chunks are sent in.
+		 * @return false if \em p disconnected before the whole stream was sent.
+		 *
+		 * @throws invalid_state if a stream with the same id is already being sent to \em p.
+		 * @attention Must not be called from the network's threads (ie: from a listener): they receive the
+		 *            acknowledgements this call waits for.
+		 *
+		 * @sa basic_peer_manager::add_stream_listener(stream_listener)
+		 *
+		 * @since 1.1.0
+		 */
+		template <typename InputIterator>
+		bool send_stream(const peer& p, stream_id id, InputIterator begin, InputIterator end, send_priority priority = send_priority::low);
+
+		/**
+		 * @brief Streams the content of \em input (a file, for example) to a specific member of the network, chunk by chunk.
+		 * @copydetails basic_peer_manager::send_stream(const peer&, stream_id, InputIterator, InputIterator, send_priority)
+		 *
+		 * @since 1.1.0
+		 */
+		bool send_stream(const peer& p, stream_id id, std::istream& input, send_priority priority = send_priority::low);
 
 		/**
 		 * Starts a new network on background. It is considered as a network connection (ie: you can't call connect(ip::address)).
@@ -274,6 +323,21 @@ namespace breep {
 		 */
 		listener_id add_disconnection_listener(disconnection_listener listener);
 
+		/**
+		 * @brief Adds a listener for incoming streams
+		 * @details Each time a chunk of a stream is received, the method passed as a parameter is called,
+		 *          with parameters specified in \em network::stream_listener. The sender may send more of
+		 *          the stream once every listener returned.
+		 * @param listener The new listener
+		 * @return An id used to remove the listener
+		 *
+		 * @sa basic_peer_manager::stream_listener
+		 * @sa basic_peer_manager::remove_stream_listener(listener_id)
+		 *
+		 * @since 1.1.0
+		 */
+		listener_id add_stream_listener(stream_listener listener);
+
 		/**
 		 * @brief Removes a listener
 		 * @param id id of the listener to remove
@@ -301,6 +365,15 @@ namespace breep {
 		 */
 		bool remove_disconnection_listener(listener_id id);
 
+		/**
+		 * @brief Removes a listener
+		 * @param id id of the listener to remove
+		 * @return true if a listener was removed, false otherwise
+		 *
+		 * @since 1.1.0
+		 */
+		bool remove_stream_listener(listener_id id);
+
 		/**
 		 * @return The list of connected peers (you excluded)
 		 *
@@ -357,13 +430,83 @@ namespace breep {
 			m_manager.set_log_level(ll);
 		}
 
+		/**
+		 * @brief Sets the maximum number of connections opened at once when joining a network.
+		 * @details When joining, a connection to each known peer is attempted. These connections
+		 *          are run concurrently, without blocking the network.
+		 *
+		 * @since 1.1.0
+		 */
+		void max_parallel_connections(std::size_t count) {
+			m_max_parallel_connections = std::max<std::size_t>(count, 1);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t max_parallel_connections() const {
+			return m_max_parallel_connections;
+		}
+
+		/**
+		 * @brief Sets the size of the chunks streams are sent in.
+		 * @note Should not be changed while streams are being sent.
+		 *
+		 * @since 1.1.0
+		 */
+		void stream_chunk_size(std::size_t octets) {
+			m_stream_chunk_size = std::max<std::size_t>(octets, 1);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t stream_chunk_size() const {
+			return m_stream_chunk_size;
+		}
+
+		/**
+		 * @brief Sets the number of octets of a stream that may be sent before the target handed them to its
+		 *        listeners, bounding the memory a stream takes on both sides.
+		 * @note A chunk is always sent once the previous ones were handed to the listeners, even if it is bigger.
+		 *       Should not be changed while streams are being sent.
+		 *
+		 * @since 1.1.0
+		 */
+		void stream_window(std::size_t octets) {
+			m_stream_window = octets;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t stream_window() const {
+			return m_stream_window;
+		}
+
+		/**
+		 * @return the underlying io_manager, giving access to its own settings and statistics.
+		 *
+		 * @since 1.1.0
+		 */
+		io_manager& io() {
+			return m_manager;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		const io_manager& io() const {
+			return m_manager;
+		}
+
 		/**
 		 * @brief removes all data listeners from the list.
 		 *
 		 * @since 0.1.0
 		 */
 		void clear_data_listeners() {
-			std::lock_guard<std::mutex> lock_guard(m_data_mutex);
+			std::lock_guard<std::shared_mutex> lock_guard(m_data_mutex);
 			m_data_r_listener.clear();
 		}
 
@@ -373,7 +516,7 @@ namespace breep {
 		 * @since 0.1.0
 		 */
 		void clear_connection_listeners() {
-			std::lock_guard<std::mutex> lock_guard(m_co_mutex);
+			std::lock_guard<std::shared_mutex> lock_guard(m_co_mutex);
 			m_co_listener.clear();
 		}
 
@@ -383,10 +526,20 @@ namespace breep {
 		 * @since 0.1.0
 		 */
 		void clear_disconnection_listeners() {
-			std::lock_guard<std::mutex> lock_guard(m_dc_mutex);
+			std::lock_guard<std::shared_mutex> lock_guard(m_dc_mutex);
 			m_dc_listener.clear();
 		}
 
+		/**
+		 * @brief removes all stream listeners from the list.
+		 *
+		 * @since 1.1.0
+		 */
+		void clear_stream_listeners() {
+			std::lock_guard<std::shared_mutex> lock_guard(m_stream_mutex);
+			m_stream_listener.clear();
+		}
+
 		/**
 		 * @brief clears all listeners
 		 *
@@ -396,6 +549,7 @@ namespace breep {
 			clear_data_listeners();
 			clear_connection_listeners();
 			clear_disconnection_listeners();
+			clear_stream_listeners();
 		}
 
 		/**
@@ -447,13 +601,14 @@ namespace breep {
 		bool try_connect(const boost::asio::ip::address& address, unsigned short port);
 
 		void peer_connected(peer&& p);
-		void peer_connected(peer&& p, unsigned char distance, peer& bridge);
+		// \em lock holds the peers list, and is released before calling the listeners.
+		void peer_connected(peer&& p, unsigned char distance, peer& bridge, std::unique_lock<std::recursive_mutex>& lock);
 		void peer_disconnected(peer& p);
-		void data_received(const peer& source, commands command, const std::vector<uint8_t>& data);
+		void data_received(const peer& source, commands command, const detail::unowning_linear_container& data);
 
 		void update_distance(const peer& concerned_peer);
 
-		void forward_if_needed(const peer& source, commands command, const std::vector<uint8_t>& data);
+		void forward_if_needed(const peer& source, commands command, const detail::unowning_linear_container& data);
 		void require_non_running() {
 			if (m_running) {
 				invalid_state("Already running.");
@@ -461,23 +616,72 @@ namespace breep {
 		}
 
 		/* command handlers */
-		void send_to_handler(const peer& source, const std::vector<uint8_t>& data);
-		void send_to_all_handler(const peer& source, const std::vector<uint8_t>& data);
-		void forward_to_handler(const peer& source, const std::vector<uint8_t>& data);
-		void stop_forwarding_handler(const peer& source, const std::vector<uint8_t>& data);
-		void forwarding_to_handler(const peer& source, const std::vector<uint8_t>& data);
-		void connect_to_handler(const peer& source, const std::vector<uint8_t>& data);
-		void cant_connect_handler(const peer& source, const std::vector<uint8_t>& data);
-		void update_distance_handler(const peer& source, const std::vector<uint8_t>& data);
-		void retrieve_distance_handler(const peer& source, const std::vector<uint8_t>& data);
-		void retrieve_peers_handler(const peer& source, const std::vector<uint8_t>& data);
-		void peers_list_handler(const peer& source, const std::vector<uint8_t>& data);
-		void peer_disconnection_handler(const peer& source, const std::vector<uint8_t>& data);
-		void empty_handler(const peer&, const std::vector<uint8_t>&) {
+		void send_to_handler(const peer& source, const detail::unowning_linear_container& data);
+		void send_to_all_handler(const peer& source, const detail::unowning_linear_container& data);
+		void forward_to_handler(const peer& source, const detail::unowning_linear_container& data);
+		void stop_forwarding_handler(const peer& source, const detail::unowning_linear_container& data);
+		void forwarding_to_handler(const peer& source, const detail::unowning_linear_container& data);
+		void connect_to_handler(const peer& source, const detail::unowning_linear_container& data);
+		void cant_connect_handler(const peer& source, const detail::unowning_linear_container& data);
+		void update_distance_handler(const peer& source, const detail::unowning_linear_container& data);
+		void retrieve_distance_handler(const peer& source, const detail::unowning_linear_container& data);
+		void retrieve_peers_handler(const peer& source, const detail::unowning_linear_container& data);
+		void peers_list_handler(const peer& source, const detail::unowning_linear_container& data);
+		void peer_disconnection_handler(const peer& source, const detail::unowning_linear_container& data);
+		void stream_chunk_handler(const peer& source, const detail::unowning_linear_container& data);
+		void stream_ack_handler(const peer& source, const detail::unowning_linear_container& data);
+
+		// stream being sent to a peer
+		struct outgoing_stream {
+			std::mutex mutex{};
+			std::condition_variable window_opened{};
+			// octets sent, and octets the target handed to its listeners
+			uint64_t sent{0};
+			uint64_t acknowledged{0};
+			// chunks sent and not acknowledged yet
+			std::size_t pending{0};
+			// set when the target disconnects
+			bool closed{false};
+		};
+
+		using stream_key = std::pair<boost::uuids::uuid, stream_id>;
+
+		/**
+		 * Sends the chunks \em fill appends to the frame it is given (at most stream_chunk_size() octets per call,
+		 * returning true once the stream is over).
+		 */
+		template <typename ChunkFiller>
+		bool send_stream_chunks(const peer& p, stream_id id, send_priority priority, ChunkFiller fill);
+
+		// wakes up the senders of the streams sent to \em target (to every peer if nullptr), telling them it is gone.
+		void close_streams(const peer* target);
+
+		// appends [size of 1 id][sender id][target id] to \em data
+		void append_route(std::vector<uint8_t>& data, const boost::uuids::uuid& sender, const boost::uuids::uuid& target) const;
+
+		// reads the header appended by append_route. false if it is malformed.
+		static bool read_route(const detail::unowning_linear_container& data, boost::uuids::uuid& sender, boost::uuids::uuid& target);
+
+		// peer to connect to, when joining a network
+		struct join_target {
+			boost::uuids::uuid id;
+			boost::asio::ip::address address;
+			unsigned short port;
+		};
+
+		struct join_state {
+			std::deque<join_target> pending{};
+			std::size_t in_flight{};
+		};
+
+		void join_next(std::shared_ptr<join_state> join);
+
+		void connection_failed(std::unique_ptr<peer>&& failed);
+		void empty_handler(const peer&, const detail::unowning_linear_container&) {
 			breep::logger<peer_manager>.warning("Call to empty_handler was made. This is not supposed to happen in normal circonstances.\n");
 		}
 
-		void keep_alive_handler(const peer& p, const std::vector<uint8_t>& /* unused */) {
+		void keep_alive_handler(const peer& p, const detail::unowning_linear_container& /* unused */) {
 			breep::logger<peer_manager>.trace("Received keep_alive from " + p.id_as_string());
 		}
 
@@ -485,6 +689,13 @@ namespace breep {
 		std::unordered_map<listener_id, connection_listener> m_co_listener;
 		std::unordered_map<listener_id, data_received_listener> m_data_r_listener;
 		std::unordered_map<listener_id, disconnection_listener> m_dc_listener;
+		std::unordered_map<listener_id, stream_listener> m_stream_listener;
+
+		// streams being sent
+		std::unordered_map<stream_key, std::shared_ptr<outgoing_stream>, boost::hash<stream_key>> m_streams;
+		std::mutex m_streams_mutex;
+		std::size_t m_stream_chunk_size;
+		std::size_t m_stream_window;
 
 		// predicate telling whether a peer should be accepted or not
 		// Is ignored when connecting to someone
@@ -504,13 +715,18 @@ namespace breep {
 		network_command_handler m_command_handlers[static_cast<uint8_t>(commands::null_command)];
 
         std::mutex m_waitfor_run;
-		mutable std::mutex m_co_mutex;
-		mutable std::mutex m_dc_mutex;
-		mutable std::mutex m_data_mutex;
+		// guards m_peers, m_me's routing tables and m_failed_connections, that may be accessed from several io threads.
+		mutable std::recursive_mutex m_peers_mutex;
+		mutable std::shared_mutex m_co_mutex;
+		mutable std::shared_mutex m_dc_mutex;
+		mutable std::shared_mutex m_data_mutex;
+		mutable std::shared_mutex m_stream_mutex;
 
 		friend class detail::peer_manager_attorney<io_manager>;
 
 		std::unique_ptr<std::thread> m_thread;
+
+		std::size_t m_max_parallel_connections;
 	};
 
 
@@ -526,6 +742,8 @@ namespace breep {
 		peer_manager_attorney() = delete;
 
 	private:
+		// These lock the peers list (and the routing tables) only while they are accessed: the listeners are called
+		// once it is released, so that io_managers running several threads may dispatch to them in parallel.
 		inline static void peer_connected(basic_peer_manager<T>& object, basic_peer<T>&& p) {
 			object.peer_connected(std::move(p));
 		}
@@ -534,10 +752,17 @@ namespace breep {
 			object.peer_disconnected(p);
 		}
 
-		inline static void data_received(basic_peer_manager<T>& object, const basic_peer<T>& source, commands command, const std::vector<uint8_t>& data) {
+		inline static void data_received(basic_peer_manager<T>& object, const basic_peer<T>& source, commands command, const detail::unowning_linear_container& data) {
 			object.data_received(source, command, data);
 		}
 
+		/**
+		 * Locks the peers list (and the routing tables), for io_managers iterating on it from their own threads.
+		 */
+		inline static std::unique_lock<std::recursive_mutex> peers_lock(basic_peer_manager<T>& object) {
+			return std::unique_lock<std::recursive_mutex>(object.m_peers_mutex);
+		}
+
 		friend T;
 	};
 
@@ -0,0 +1,58 @@
+#ifndef BREEP_NETWORK_CODEC_HPP
+#define BREEP_NETWORK_CODEC_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file codec.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace breep {
+
+	/**
+	 * @brief Compression algorithm applied to the payload of the frames sent to the peers (see the io_managers' compression()).
+	 * @details Two peers only compress the frames they exchange if they use codecs with the same id.
+	 *          Implementations must be thread safe: frames sent to different peers are compressed concurrently.
+	 *
+	 * @since 1.1.0
+	 */
+	class codec {
+	public:
+		virtual ~codec() = default;
+
+		/**
+		 * @return the identifier of the codec, sent during the handshake. Must not be 0. Ids from 1 to 127 are
+		 *         reserved to the codecs provided by breep.
+		 */
+		virtual uint8_t id() const = 0;
+
+		/**
+		 * @brief Appends the compressed form of \em input to \em output.
+		 */
+		virtual void compress(const uint8_t* input, std::size_t size, std::vector<uint8_t>& output) const = 0;
+
+		/**
+		 * @brief Decompresses \em input into \em output, which is exactly the size of the original data.
+		 * @details Compressed data may not be more than 256 times smaller than the original data.
+		 * @return false if \em input is malformed.
+		 */
+		virtual bool decompress(const uint8_t* input, std::size_t size, uint8_t* output, std::size_t output_size) const = 0;
+	};
+}
+
+#endif //BREEP_NETWORK_CODEC_HPP
@@ -0,0 +1,168 @@
+#ifndef BREEP_NETWORK_DETAIL_BUFFER_POOL_HPP
+#define BREEP_NETWORK_DETAIL_BUFFER_POOL_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file buffer_pool.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace breep { namespace detail {
+
+	/**
+	 * @brief Recycles the buffers of sent frames.
+	 * @details Buffers are sorted in size classes (powers of two, from min_class_size to max_class_size octets).
+	 *          Buffers bigger than max_class_size are neither pooled nor counted. Thread safe.
+	 *          Buffers given by share() may outlive the pool.
+	 *
+	 * @since 1.1.0
+	 */
+	class buffer_pool final {
+	public:
+		static constexpr std::size_t min_class_size = 64;
+		static constexpr std::size_t max_class_size = 1024 * 1024;
+		// maximum number of idle buffers kept for each size class.
+		static constexpr std::size_t max_buffers_per_class = 64;
+
+		struct statistics final {
+			// buffers acquired from the pool
+			std::atomic<uint64_t> hits{0};
+			// buffers that had to be allocated
+			std::atomic<uint64_t> misses{0};
+			// octets currently held by the pool's idle buffers
+			std::atomic<uint64_t> pooled_octets{0};
+			// highest value reached by pooled_octets
+			std::atomic<uint64_t> pooled_octets_high_water{0};
+		};
+
+		buffer_pool()
+			: m_state(std::make_shared<state>())
+		{}
+
+		buffer_pool(const buffer_pool&) = delete;
+		buffer_pool& operator=(const buffer_pool&) = delete;
+
+		/**
+		 * @return an empty buffer with a capacity of at least \em size octets.
+		 */
+		std::vector<uint8_t> acquire(std::size_t size) {
+			std::size_t idx = class_of_size(size);
+			if (idx < class_count) {
+				size_class& sc = m_state->classes[idx];
+				std::lock_guard<std::mutex> lock(sc.mutex);
+				if (!sc.buffers.empty()) {
+					std::vector<uint8_t> buffer = std::move(sc.buffers.back());
+					sc.buffers.pop_back();
+					m_state->stats.pooled_octets -= buffer.capacity();
+					++m_state->stats.hits;
+					return buffer;
+				}
+				size = min_class_size << idx;
+			}
+
+			++m_state->stats.misses;
+			std::vector<uint8_t> buffer;
+			buffer.reserve(size);
+			return buffer;
+		}
+
+		/**
+		 * @brief gives a buffer back to the pool.
+		 */
+		void release(std::vector<uint8_t>&& buffer) {
+			release(*m_state, std::move(buffer));
+		}
+
+		/**
+		 * @brief Turns \em buffer into a payload that may be shared between threads, and that
+		 *        gives itself back to the pool once its last owner drops it.
+		 */
+		std::shared_ptr<const std::vector<uint8_t>> share(std::vector<uint8_t>&& buffer) {
+			std::shared_ptr<state> owner = m_state;
+			return std::shared_ptr<const std::vector<uint8_t>>(new std::vector<uint8_t>(std::move(buffer)),
+			                                                    [owner](std::vector<uint8_t>* shared) {
+				release(*owner, std::move(*shared));
+				delete shared;
+			});
+		}
+
+		const statistics& stats() const {
+			return m_state->stats;
+		}
+
+	private:
+		static constexpr std::size_t class_count = 15; // 64 o -> 1 Mio
+
+		struct size_class {
+			std::mutex mutex{};
+			std::vector<std::vector<uint8_t>> buffers{};
+		};
+
+		// shared with the payloads given by share()
+		struct state {
+			std::array<size_class, class_count> classes{};
+			statistics stats{};
+		};
+
+		static void release(state& pool, std::vector<uint8_t>&& buffer) {
+			std::size_t idx = class_of_capacity(buffer.capacity());
+			if (idx >= class_count) {
+				return;
+			}
+
+			buffer.clear();
+			size_class& sc = pool.classes[idx];
+			std::lock_guard<std::mutex> lock(sc.mutex);
+			if (sc.buffers.size() < max_buffers_per_class) {
+				uint64_t pooled = pool.stats.pooled_octets += buffer.capacity();
+				uint64_t high_water = pool.stats.pooled_octets_high_water;
+				while (pooled > high_water && !pool.stats.pooled_octets_high_water.compare_exchange_weak(high_water, pooled));
+				sc.buffers.push_back(std::move(buffer));
+			}
+		}
+
+		// smallest class holding at least size octets
+		static std::size_t class_of_size(std::size_t size) {
+			std::size_t idx{0};
+			while (idx < class_count && (min_class_size << idx) < size) {
+				++idx;
+			}
+			return idx;
+		}
+
+		// biggest class that a buffer of this capacity can serve (class_count if none)
+		static std::size_t class_of_capacity(std::size_t capacity) {
+			if (capacity < min_class_size || capacity > max_class_size * 2 - 1) {
+				return class_count;
+			}
+			std::size_t idx{0};
+			while (idx + 1 < class_count && (min_class_size << (idx + 1)) <= capacity) {
+				++idx;
+			}
+			return idx;
+		}
+
+		std::shared_ptr<state> m_state;
+	};
+}}
+
+#endif //BREEP_NETWORK_DETAIL_BUFFER_POOL_HPP
@@ -145,6 +145,33 @@ namespace breep {
 		 */
 		connection_accepted,
 		connection_refused,
+		/**
+		 * @brief     Frame whose payload was compressed by the io_manager.
+		 * @details   Must be followed by the original command (one octet), the original size (varint) and the
+		 *            compressed payload. Unwrapped by the io_managers: never handed to basic_peer_manager.
+		 *
+		 * @since 1.1.0
+		 */
+		compressed,
+		/**
+		 * @brief     Command for sending a chunk of a stream to a specific peer.
+		 * @details   Format : [size of 1 id (in octet, on 1 octet)],[sender id],[target peer id],[stream id (varint)],
+		 *                     [offset of the chunk (varint)],[last chunk (1 octet)],[chunk]
+		 * @sa        commands::stream_ack
+		 *
+		 * @since 1.1.0
+		 */
+		stream_chunk,
+		/**
+		 * @brief     Command to tell the sender of a stream how much of it was handed to the listeners,
+		 *            letting it send more.
+		 * @details   Format : [size of 1 id (in octet, on 1 octet)],[sender id],[target peer id],[stream id (varint)],
+		 *                     [octets received (varint)]
+		 * @sa        commands::stream_chunk
+		 *
+		 * @since 1.1.0
+		 */
+		stream_ack,
 
 		/**
 		 * @brief never sent
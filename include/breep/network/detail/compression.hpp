@@ -0,0 +1,265 @@
+#ifndef BREEP_NETWORK_DETAIL_COMPRESSION_HPP
+#define BREEP_NETWORK_DETAIL_COMPRESSION_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file compression.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "breep/network/codec.hpp"
+#include "breep/network/typedefs.hpp"
+#include "breep/network/detail/commands.hpp"
+#include "breep/network/detail/buffer_pool.hpp"
+#include "breep/network/detail/utils.hpp"
+
+namespace breep { namespace detail {
+
+	/**
+	 * Compression counters of a peer, updated by the io_manager and read from any thread.
+	 */
+	struct compression_counters final {
+		std::atomic<uint64_t> frames_compressed{0};
+		std::atomic<uint64_t> octets_before_compression{0};
+		std::atomic<uint64_t> octets_after_compression{0};
+		std::atomic<uint64_t> frames_incompressible{0};
+		std::atomic<uint64_t> compression_nanoseconds{0};
+		std::atomic<uint64_t> frames_decompressed{0};
+		std::atomic<uint64_t> octets_before_decompression{0};
+		std::atomic<uint64_t> octets_after_decompression{0};
+		std::atomic<uint64_t> decompression_nanoseconds{0};
+
+		compression_statistics snapshot() const {
+			compression_statistics stats;
+			stats.frames_compressed = frames_compressed;
+			stats.octets_before_compression = octets_before_compression;
+			stats.octets_after_compression = octets_after_compression;
+			stats.frames_incompressible = frames_incompressible;
+			stats.compression_time = std::chrono::nanoseconds(compression_nanoseconds);
+			stats.frames_decompressed = frames_decompressed;
+			stats.octets_before_decompression = octets_before_decompression;
+			stats.octets_after_decompression = octets_after_decompression;
+			stats.decompression_time = std::chrono::nanoseconds(decompression_nanoseconds);
+			return stats;
+		}
+	};
+
+	/**
+	 * @brief Compression settings of an io_manager, and compression of the frames it sends.
+	 * @details A compressed frame is sent with commands::compressed, and its payload is:
+	 *          [original command (1 octet)][original payload size (varint)][compressed payload].
+	 *          Each side advertises the id of its codec during the handshake (0 if none): frames are only
+	 *          compressed between peers advertising the same one.
+	 *
+	 * @since 1.1.0
+	 */
+	class frame_compressor final {
+	public:
+		frame_compressor() = default;
+
+		frame_compressor(frame_compressor&& other) noexcept
+				: m_codec(std::move(other.m_codec))
+				, m_threshold(other.m_threshold)
+		{}
+
+		frame_compressor(const frame_compressor&) = delete;
+		frame_compressor& operator=(const frame_compressor&) = delete;
+
+		/**
+		 * @param c         codec to use, nullptr to disable compression.
+		 * @param threshold size from which payloads are compressed.
+		 */
+		void configure(std::shared_ptr<const breep::codec> c, std::size_t threshold) {
+			m_codec = std::move(c);
+			m_threshold = threshold;
+		}
+
+		const std::shared_ptr<const breep::codec>& codec() const {
+			return m_codec;
+		}
+
+		std::size_t threshold() const {
+			return m_threshold;
+		}
+
+		/**
+		 * @return the id advertised during the handshake.
+		 */
+		uint8_t codec_id() const {
+			return m_codec ? m_codec->id() : uint8_t{0};
+		}
+
+		/**
+		 * @return the codec of a link with a peer that advertised \em remote_id, nullptr if frames are not compressed.
+		 */
+		std::shared_ptr<const breep::codec> negotiate(uint8_t remote_id) const {
+			if (m_codec && remote_id == m_codec->id()) {
+				return m_codec;
+			}
+			return {};
+		}
+
+		/**
+		 * @brief Compresses \em payload in place (and turns \em command into commands::compressed) if the link has
+		 *        a codec, the payload reaches the threshold, and compressing it makes it smaller.
+		 */
+		void compress(const breep::codec* link_codec, commands& command, std::vector<uint8_t>& payload,
+		              compression_counters& counters, buffer_pool& pool) const {
+			if (link_codec == nullptr || payload.size() < m_threshold || payload.empty()) {
+				return;
+			}
+
+			std::vector<uint8_t> compressed = pool.acquire(payload.size());
+			if (wrap(*link_codec, command, payload, compressed, counters)) {
+				command = commands::compressed;
+				std::swap(payload, compressed);
+			}
+			pool.release(std::move(compressed));
+		}
+
+		/**
+		 * @brief Same as compress(), for payloads shared between several peers: the last shared payload is
+		 *        compressed once, and its compressed form handed to the other peers it is sent to.
+		 * @details The compression time is only counted for the peer the payload was compressed for.
+		 */
+		void compress_shared(const breep::codec* link_codec, commands& command, std::shared_ptr<const std::vector<uint8_t>>& payload,
+		                     compression_counters& counters, buffer_pool& pool) const {
+			if (link_codec == nullptr || payload->size() < m_threshold || payload->empty()) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(m_shared_mutex);
+			const bool cached = !m_shared_source.owner_before(payload) && !payload.owner_before(m_shared_source)
+			                    && !m_shared_source.expired() && m_shared_command == command && m_shared_codec == link_codec;
+			if (!cached) {
+				std::vector<uint8_t> compressed = pool.acquire(payload->size());
+				m_shared_source = payload;
+				m_shared_command = command;
+				m_shared_codec = link_codec;
+				if (wrap(*link_codec, command, *payload, compressed, counters)) {
+					// goes back to the pool once the last frame pointing at it drops it (see buffer_pool::share)
+					m_shared_result = pool.share(std::move(compressed));
+				} else {
+					m_shared_result.reset();
+					pool.release(std::move(compressed));
+				}
+			} else if (m_shared_result) {
+				++counters.frames_compressed;
+				counters.octets_before_compression += payload->size();
+				counters.octets_after_compression += m_shared_result->size();
+			} else {
+				++counters.frames_incompressible;
+			}
+
+			if (m_shared_result) {
+				command = commands::compressed;
+				payload = m_shared_result;
+			}
+		}
+
+		/**
+		 * @brief Forgets the last shared payload, once it was passed to compress_shared() for each of its peers:
+		 *        its compressed form then goes back to the pool as soon as the last frame pointing at it is written.
+		 */
+		void end_shared() const {
+			std::lock_guard<std::mutex> lock(m_shared_mutex);
+			m_shared_source.reset();
+			m_shared_result.reset();
+		}
+
+		/**
+		 * @brief Decompresses the payload of a commands::compressed frame into \em output.
+		 * @return false if the frame is malformed.
+		 */
+		static bool decompress(const breep::codec& link_codec, const unowning_linear_container& frame, commands& command,
+		                       std::vector<uint8_t>& output, compression_counters& counters) {
+			if (frame.size() < 2) {
+				return false;
+			}
+			uint64_t size;
+			std::size_t varint_size = read_varint(frame.data() + 1, frame.size() - 1, size);
+			if (varint_size == 0 || varint_size > max_varint_size || static_cast<commands>(frame[0]) == commands::compressed
+			    || static_cast<commands>(frame[0]) >= commands::null_command) {
+				return false;
+			}
+			const std::size_t header_size = 1 + varint_size;
+			// bounds what a malformed frame may make us allocate (see codec::decompress)
+			if (size / max_expansion > frame.size() - header_size) {
+				return false;
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+			output.resize(static_cast<std::size_t>(size));
+			bool valid = link_codec.decompress(frame.data() + header_size, frame.size() - header_size, output.data(), output.size());
+			counters.decompression_nanoseconds += elapsed(start);
+			if (!valid) {
+				return false;
+			}
+
+			command = static_cast<commands>(frame[0]);
+			++counters.frames_decompressed;
+			counters.octets_before_decompression += frame.size();
+			counters.octets_after_decompression += output.size();
+			return true;
+		}
+
+	private:
+		static constexpr uint64_t max_expansion = 256;
+
+		// writes the compressed form of \em payload into \em output. false if it is not smaller than \em payload.
+		static bool wrap(const breep::codec& link_codec, commands command, const std::vector<uint8_t>& payload,
+		                 std::vector<uint8_t>& output, compression_counters& counters) {
+			const auto start = std::chrono::steady_clock::now();
+			output.resize(1 + max_varint_size);
+			output[0] = static_cast<uint8_t>(command);
+			output.resize(1 + write_varint(output.data() + 1, payload.size()));
+			link_codec.compress(payload.data(), payload.size(), output);
+			counters.compression_nanoseconds += elapsed(start);
+
+			if (output.size() >= payload.size()) {
+				++counters.frames_incompressible;
+				return false;
+			}
+			++counters.frames_compressed;
+			counters.octets_before_compression += payload.size();
+			counters.octets_after_compression += output.size();
+			return true;
+		}
+
+		static uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		std::shared_ptr<const breep::codec> m_codec{};
+		std::size_t m_threshold{0};
+
+		// last shared payload compressed by compress_shared, and its compressed form (nullptr if incompressible),
+		// until end_shared() is called.
+		mutable std::mutex m_shared_mutex{};
+		mutable std::weak_ptr<const std::vector<uint8_t>> m_shared_source{};
+		mutable commands m_shared_command{commands::null_command};
+		mutable const breep::codec* m_shared_codec{nullptr};
+		mutable std::shared_ptr<const std::vector<uint8_t>> m_shared_result{};
+	};
+}}
+
+#endif //BREEP_NETWORK_DETAIL_COMPRESSION_HPP
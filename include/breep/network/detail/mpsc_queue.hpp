@@ -0,0 +1,95 @@
+#ifndef BREEP_NETWORK_DETAIL_MPSC_QUEUE_HPP
+#define BREEP_NETWORK_DETAIL_MPSC_QUEUE_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file mpsc_queue.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <atomic>
+#include <utility>
+
+namespace breep { namespace detail {
+
+	/**
+	 * @brief Unbounded multiple producers, single consumer queue.
+	 * @details push() is lock-free: one exchange links the new node. pop() may miss a value whose push() is still
+	 *          in progress: it is then returned by a later pop(). Values pushed from a given thread are popped in
+	 *          the order they were pushed.
+	 *
+	 * @since 1.1.0
+	 */
+	template <typename T>
+	class mpsc_queue final {
+	public:
+		mpsc_queue()
+				: m_head(new node)
+				, m_tail(m_head.load(std::memory_order_relaxed))
+		{}
+
+		mpsc_queue(const mpsc_queue&) = delete;
+		mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+		~mpsc_queue() {
+			T value;
+			while (pop(value)) {}
+			delete m_tail;
+		}
+
+		/**
+		 * @brief Adds \em value to the queue. May be called from any thread.
+		 */
+		void push(T&& value) {
+			node* n = new node{std::move(value)};
+			node* previous = m_head.exchange(n, std::memory_order_acq_rel);
+			previous->next.store(n, std::memory_order_release);
+		}
+
+		/**
+		 * @brief Takes the oldest value of the queue. Must only be called from one thread at a time.
+		 * @return false if the queue is empty.
+		 */
+		bool pop(T& value) {
+			node* next = m_tail->next.load(std::memory_order_acquire);
+			if (next == nullptr) {
+				return false;
+			}
+			// next becomes the sentinel.
+			value = std::move(next->value);
+			delete m_tail;
+			m_tail = next;
+			return true;
+		}
+
+	private:
+		struct node {
+			node() = default;
+
+			explicit node(T&& value_)
+					: value(std::move(value_))
+			{}
+
+			T value{};
+			std::atomic<node*> next{nullptr};
+		};
+
+		// last node pushed
+		std::atomic<node*> m_head;
+		// sentinel preceding the oldest value
+		node* m_tail;
+	};
+}}
+
+#endif //BREEP_NETWORK_DETAIL_MPSC_QUEUE_HPP
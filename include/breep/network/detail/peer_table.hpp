@@ -0,0 +1,164 @@
+#ifndef BREEP_NETWORK_DETAIL_PEER_TABLE_HPP
+#define BREEP_NETWORK_DETAIL_PEER_TABLE_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file peer_table.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <limits>
+#include <stdexcept>
+
+namespace breep { namespace detail {
+
+	/**
+	 * @brief Compact reference to a peer stored in a peer_table, cheap to copy into completion handlers.
+	 * @details A handle whose peer was erased is stale: looking it up gives nullptr, even once its slot is reused.
+	 *
+	 * @since 1.1.0
+	 */
+	struct peer_handle final {
+		static constexpr uint32_t invalid_index = std::numeric_limits<uint32_t>::max();
+
+		uint32_t index{invalid_index};
+		uint32_t generation{0};
+	};
+
+	/**
+	 * @brief Slots holding the io_manager's copy of its connected peers.
+	 * @details Slots are allocated by chunks that are never moved, so that looking a handle up does not lock.
+	 *          insert() and erase() may be called from any thread. A peer must only be looked up and erased from
+	 *          a single thread at a time (typically, its strand): erase() does not wait for concurrent lookups of
+	 *          the same handle.
+	 *
+	 * @since 1.1.0
+	 */
+	template <typename peer_type>
+	class peer_table final {
+	public:
+		static constexpr std::size_t chunk_size = 256;
+		static constexpr std::size_t max_chunks = 4096;
+
+		peer_table() = default;
+		peer_table(const peer_table&) = delete;
+		peer_table& operator=(const peer_table&) = delete;
+
+		~peer_table() {
+			for (std::atomic<slot*>& chunk : m_chunks) {
+				delete[] chunk.load();
+			}
+		}
+
+		/**
+		 * @brief Stores a copy of \em p.
+		 * @throws std::length_error if every slot is taken.
+		 */
+		peer_handle insert(const peer_type& p) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			uint32_t index;
+			if (!m_free.empty()) {
+				index = m_free.back();
+				m_free.pop_back();
+			} else {
+				if (m_size == chunk_size * max_chunks) {
+					throw std::length_error("Too many peers connected at once.");
+				}
+				index = m_size++;
+				if (index % chunk_size == 0) {
+					m_chunks[index / chunk_size].store(new slot[chunk_size], std::memory_order_release);
+				}
+			}
+
+			slot& s = at(index);
+			s.value = std::make_unique<peer_type>(p);
+			return peer_handle{index, s.generation.load(std::memory_order_relaxed)};
+		}
+
+		/**
+		 * @return the peer referred to by \em handle, or nullptr if it was erased.
+		 */
+		peer_type* find(peer_handle handle) const {
+			if (handle.index >= chunk_size * max_chunks) {
+				return nullptr;
+			}
+			slot* chunk = m_chunks[handle.index / chunk_size].load(std::memory_order_acquire);
+			if (chunk == nullptr) {
+				return nullptr;
+			}
+			slot& s = chunk[handle.index % chunk_size];
+			if (s.generation.load(std::memory_order_acquire) != handle.generation) {
+				return nullptr;
+			}
+			return s.value.get();
+		}
+
+		/**
+		 * @brief Releases the slot of \em handle. Does nothing if the handle is stale.
+		 */
+		void erase(peer_handle handle) {
+			if (find(handle) == nullptr) {
+				return;
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			release(handle.index);
+		}
+
+		/**
+		 * @brief Releases every slot.
+		 * @note No lookup may run concurrently.
+		 */
+		void clear() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (uint32_t index{0} ; index < m_size ; ++index) {
+				if (at(index).value) {
+					release(index);
+				}
+			}
+		}
+
+	private:
+		struct slot {
+			std::atomic<uint32_t> generation{0};
+			std::unique_ptr<peer_type> value{};
+		};
+
+		slot& at(uint32_t index) const {
+			return m_chunks[index / chunk_size].load(std::memory_order_relaxed)[index % chunk_size];
+		}
+
+		// to be called with m_mutex locked.
+		void release(uint32_t index) {
+			slot& s = at(index);
+			// stale handles must not match anymore before the peer is destroyed.
+			s.generation.fetch_add(1, std::memory_order_release);
+			s.value.reset();
+			m_free.push_back(index);
+		}
+
+		std::array<std::atomic<slot*>, max_chunks> m_chunks{};
+		uint32_t m_size{0};
+		std::vector<uint32_t> m_free{};
+		std::mutex m_mutex{};
+	};
+}}
+
+#endif //BREEP_NETWORK_DETAIL_PEER_TABLE_HPP
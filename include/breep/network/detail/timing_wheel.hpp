@@ -0,0 +1,145 @@
+#ifndef BREEP_NETWORK_DETAIL_TIMING_WHEEL_HPP
+#define BREEP_NETWORK_DETAIL_TIMING_WHEEL_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file timing_wheel.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+
+namespace breep { namespace detail {
+
+	/**
+	 * @brief Hierarchical timing wheel: schedules values to expire at a given time.
+	 * @details Time is divided in ticks of \em resolution. The first level holds the values expiring in the next
+	 *          slots_per_level ticks, one slot per tick, and each further level covers slots_per_level times the
+	 *          span of the previous one. Advancing the wheel only touches the slots of the elapsed ticks, and the
+	 *          values they hold: a higher level slot is moved down to the lower levels when its time comes.
+	 *          Deadlines are rounded up to the next tick; those further than the wheel's span are clamped to it.
+	 *          Not thread safe.
+	 *
+	 * @since 1.1.0
+	 */
+	template <typename T>
+	class timing_wheel final {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		static constexpr unsigned int slot_bits = 6;
+		static constexpr std::size_t slots_per_level = std::size_t{1} << slot_bits;
+		static constexpr std::size_t level_count = 4;
+		// number of ticks covered by the wheel
+		static constexpr uint64_t span = uint64_t{1} << (slot_bits * level_count);
+
+		explicit timing_wheel(clock::duration resolution, clock::time_point start = clock::now())
+				: m_resolution(std::max(resolution, clock::duration(1)))
+				, m_start(start)
+				, m_current_tick(0)
+				, m_size(0)
+				, m_levels{}
+		{}
+
+		/**
+		 * @brief Schedules \em value to expire at \em deadline.
+		 */
+		void schedule(clock::time_point deadline, T value) {
+			uint64_t tick = m_current_tick + 1;
+			if (deadline > m_start) {
+				tick = std::max(tick, static_cast<uint64_t>((deadline - m_start + m_resolution - clock::duration(1)) / m_resolution));
+			}
+			tick = std::min(tick, m_current_tick + span - 1);
+			place(entry{tick, std::move(value)});
+			++m_size;
+		}
+
+		/**
+		 * @brief Advances the wheel up to \em now.
+		 * @param expired Called with each value whose deadline passed.
+		 */
+		template <typename Callback>
+		void advance(clock::time_point now, Callback&& expired) {
+			if (now <= m_start) {
+				return;
+			}
+			const uint64_t target = static_cast<uint64_t>((now - m_start) / m_resolution);
+			while (m_current_tick < target) {
+				++m_current_tick;
+
+				// Moving the higher levels down first: they may fill the lower level slots that are due.
+				for (std::size_t level = level_count - 1 ; level > 0 ; --level) {
+					if ((m_current_tick & ((uint64_t{1} << (slot_bits * level)) - 1)) == 0) {
+						std::vector<entry> cascading = std::move(slot(level, m_current_tick));
+						slot(level, m_current_tick).clear();
+						for (entry& e : cascading) {
+							place(std::move(e));
+						}
+					}
+				}
+
+				std::vector<entry> due = std::move(slot(0, m_current_tick));
+				slot(0, m_current_tick).clear();
+				m_size -= due.size();
+				for (entry& e : due) {
+					expired(std::move(e.value));
+				}
+			}
+		}
+
+		/**
+		 * @return the number of scheduled values.
+		 */
+		std::size_t size() const {
+			return m_size;
+		}
+
+		clock::duration resolution() const {
+			return m_resolution;
+		}
+
+	private:
+		struct entry {
+			uint64_t tick;
+			T value;
+		};
+
+		std::vector<entry>& slot(std::size_t level, uint64_t tick) {
+			return m_levels[level][(tick >> (slot_bits * level)) & (slots_per_level - 1)];
+		}
+
+		void place(entry&& e) {
+			const uint64_t delta = e.tick > m_current_tick ? e.tick - m_current_tick : 0;
+			std::size_t level{0};
+			while (level + 1 < level_count && delta >= (uint64_t{1} << (slot_bits * (level + 1)))) {
+				++level;
+			}
+			slot(level, std::max(e.tick, m_current_tick)).push_back(std::move(e));
+		}
+
+		const clock::duration m_resolution;
+		const clock::time_point m_start;
+		uint64_t m_current_tick;
+		std::size_t m_size;
+		std::array<std::array<std::vector<entry>, slots_per_level>, level_count> m_levels;
+	};
+}}
+
+#endif //BREEP_NETWORK_DETAIL_TIMING_WHEEL_HPP
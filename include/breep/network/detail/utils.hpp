@@ -103,6 +103,49 @@ namespace breep { namespace detail {
 		return read_uint16(container, idx) << 16 | read_uint16(container, idx + sizeof(uint16_t));
 	}
 
+	/**
+	 * Maximum number of octets taken by a varint encoded uint64_t.
+	 */
+	constexpr std::size_t max_varint_size = 10;
+
+	/**
+	 * Writes \em value to \em output as a varint (7 bits per octet, least significant group first,
+	 * the most significant bit of each octet telling whether another octet follows).
+	 *
+	 * @return the number of octets written (at most max_varint_size).
+	 */
+	inline std::size_t write_varint(uint8_t* output, uint64_t value) {
+		std::size_t i{0};
+		while (value > 0x7F) {
+			output[i++] = static_cast<uint8_t>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		output[i++] = static_cast<uint8_t>(value);
+		return i;
+	}
+
+	/**
+	 * Reads a varint from data[0, size).
+	 *
+	 * @return the number of octets the varint takes, 0 if it is incomplete,
+	 *         or max_varint_size + 1 if it is malformed.
+	 */
+	inline std::size_t read_varint(const uint8_t* data, std::size_t size, uint64_t& value) {
+		value = 0;
+		for (std::size_t i{0} ; i < size && i < max_varint_size ; ++i) {
+			value |= static_cast<uint64_t>(data[i] & 0x7F) << (7 * i);
+			if (!(data[i] & 0x80)) {
+				return i + 1;
+			}
+		}
+		return size < max_varint_size ? 0 : max_varint_size + 1;
+	}
+
+	/**
+	 * Default bound of the size of the frames a peer may send (see the io_managers' max_frame_size()).
+	 */
+	constexpr std::size_t default_max_frame_size = 64 * 1024 * 1024;
+
 
 
 	template <typename... T>
@@ -9,6 +9,7 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include <thread>
+#include <array>
 #include <iostream>
 #include <functional>
 #include <algorithm>
@@ -30,6 +31,11 @@ breep::basic_peer_manager<T>::basic_peer_manager(T&& manager, unsigned short por
 	, m_co_listener{}
 	, m_data_r_listener{}
 	, m_dc_listener{}
+	, m_stream_listener{}
+	, m_streams{}
+	, m_streams_mutex{}
+	, m_stream_chunk_size{64 * 1024}
+	, m_stream_window{1024 * 1024}
 	, m_predicate{[](const auto&){return true;}}
 	, m_me{}
 	, m_failed_connections{}
@@ -38,10 +44,13 @@ breep::basic_peer_manager<T>::basic_peer_manager(T&& manager, unsigned short por
 	, m_port{port}
 	, m_running(false)
     , m_waitfor_run{}
+	, m_peers_mutex{}
 	, m_co_mutex{}
 	, m_dc_mutex{}
 	, m_data_mutex{}
+	, m_stream_mutex{}
 	, m_thread{nullptr}
+	, m_max_parallel_connections{16}
 
 {
 	static_assert(std::is_base_of<breep::io_manager_base<T>, T>::value, "Specified type not derived from breep::io_manager_base");
@@ -64,50 +73,99 @@ breep::basic_peer_manager<T>::basic_peer_manager(T&& manager, unsigned short por
 	m_command_handlers[static_cast<uint8_t>(commands::keep_alive)]             = &breep::basic_peer_manager<T>::keep_alive_handler;
 	m_command_handlers[static_cast<uint8_t>(commands::connection_accepted)]    = &breep::basic_peer_manager<T>::empty_handler;
 	m_command_handlers[static_cast<uint8_t>(commands::connection_refused)]     = &breep::basic_peer_manager<T>::empty_handler;
+	m_command_handlers[static_cast<uint8_t>(commands::compressed)]             = &breep::basic_peer_manager<T>::empty_handler;
+	m_command_handlers[static_cast<uint8_t>(commands::stream_chunk)]           = &breep::basic_peer_manager<T>::stream_chunk_handler;
+	m_command_handlers[static_cast<uint8_t>(commands::stream_ack)]             = &breep::basic_peer_manager<T>::stream_ack_handler;
 
 }
 
 template <typename T>
 template <typename data_container>
-inline void breep::basic_peer_manager<T>::send_to_all(const data_container& data) const {
+inline void breep::basic_peer_manager<T>::send_to_all(const data_container& data, send_priority priority) const {
 
-	std::vector<uint8_t> sendable_data;
+	std::vector<uint8_t> sendable_data = m_manager.acquire_buffer(data.size() + 1);
 	detail::make_little_endian(data, sendable_data);
 
 	breep::logger<peer_manager>.debug("Sending " + std::to_string(sendable_data.size()) + " octets");
-	for (const std::pair<boost::uuids::uuid, peer>& pair : m_peers) {
-		if (pair.second.distance() == 0) {
-			breep::logger<peer_manager>.trace("Sending to " + pair.second.id_as_string());
-			m_manager.send(commands::send_to_all, sendable_data, pair.second);
-		} else {
-			breep::logger<peer_manager>.trace
-					("Expecting another peer to forward to " + pair.second.id_as_string() + " (no direct connection)");
+
+	// Sending may block on a full send queue: the peers are not kept locked meanwhile.
+	std::vector<peer> targets;
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
+		targets.reserve(m_peers.size());
+		for (const std::pair<const boost::uuids::uuid, peer>& pair : m_peers) {
+			if (pair.second.distance() == 0) {
+				targets.push_back(pair.second);
+			} else {
+				breep::logger<peer_manager>.trace
+						("Expecting another peer to forward to " + pair.second.id_as_string() + " (no direct connection)");
+			}
 		}
 	}
+
+	if (targets.size() == 1) {
+		breep::logger<peer_manager>.trace("Sending to " + targets.front().id_as_string());
+		m_manager.send(commands::send_to_all, std::move(sendable_data), targets.front(), priority);
+		return;
+	}
+
+	// Every peer's queue points at the same buffer, which goes back to the pool once written to all of them.
+	std::shared_ptr<const std::vector<uint8_t>> shared_data = m_manager.share_buffer(std::move(sendable_data));
+	for (const peer& target : targets) {
+		breep::logger<peer_manager>.trace("Sending to " + target.id_as_string());
+		m_manager.send_shared(commands::send_to_all, shared_data, target, priority);
+	}
+	m_manager.end_shared();
 }
 
 template <typename T>
 template <typename data_container>
-inline void breep::basic_peer_manager<T>::send_to(const peer& p, const data_container& data) const {
+inline void breep::basic_peer_manager<T>::send_to(const peer& p, const data_container& data, send_priority priority) const {
 
-	std::vector<uint8_t> processed_data;
-	processed_data.reserve(data.size() + m_me.id().size() * 2 + 1);
+	std::vector<uint8_t> processed_data = m_manager.acquire_buffer(data.size() + m_me.id().size() * 2 + 1);
 	processed_data.push_back(static_cast<uint8_t>(m_me.id().size()));
 	std::copy(m_me.id().data, m_me.id().data + m_me.id().size(), std::back_inserter(processed_data));
 	std::copy(p.id().data, p.id().data + p.id().size(), std::back_inserter(processed_data));
 	std::copy(data.cbegin(), data.cend(), std::back_inserter(processed_data));
 
-	std::vector<uint8_t> sendable_data;
+	std::vector<uint8_t> sendable_data = m_manager.acquire_buffer(processed_data.size() + 1);
 	detail::make_little_endian(processed_data, sendable_data);
+	m_manager.release_buffer(std::move(processed_data));
 
 	breep::logger<peer_manager>.debug("Sending private data to " + p.id_as_string());
 	breep::logger<peer_manager>.debug("(" + std::to_string(data.size()) + " octets)");
 
+	std::unique_lock<std::recursive_mutex> lock(m_peers_mutex);
 	if (p.distance() != 0) {
 		breep::logger<peer_manager>.trace("Passing through " + m_me.path_to(p)->id_as_string() + " (no direct connection)");
 	}
 
-	m_manager.send(commands::send_to, sendable_data, *m_me.path_to(p));
+	// Sending may block on a full send queue: the peers are not kept locked meanwhile.
+	peer target = *m_me.path_to(p);
+	lock.unlock();
+	m_manager.send(commands::send_to, std::move(sendable_data), target, priority);
+}
+
+template <typename T>
+template <typename InputIterator>
+inline bool breep::basic_peer_manager<T>::send_stream(const peer& p, stream_id id, InputIterator begin, InputIterator end, send_priority priority) {
+	return send_stream_chunks(p, id, priority, [&begin, &end](std::vector<uint8_t>& frame, std::size_t max) {
+		for (std::size_t i{0} ; i < max && begin != end ; ++i, ++begin) {
+			frame.push_back(static_cast<uint8_t>(*begin));
+		}
+		return begin == end;
+	});
+}
+
+template <typename T>
+inline bool breep::basic_peer_manager<T>::send_stream(const peer& p, stream_id id, std::istream& input, send_priority priority) {
+	return send_stream_chunks(p, id, priority, [&input](std::vector<uint8_t>& frame, std::size_t max) {
+		const std::size_t size = frame.size();
+		frame.resize(size + max);
+		input.read(reinterpret_cast<char*>(frame.data() + size), static_cast<std::streamsize>(max));
+		frame.resize(size + static_cast<std::size_t>(input.gcount()));
+		return input.peek() == std::istream::traits_type::eof();
+	});
 }
 
 template <typename T>
@@ -155,14 +213,30 @@ void breep::basic_peer_manager<T>::disconnect() {
 	breep::logger<peer_manager>.info("Shutting the network off.");
 
 	m_manager.disconnect();
-	for (auto&& peer_pair : m_peers) {
-		peer& p = peer_pair.second;
-		m_manager.disconnect(p);
 
-		p.distance(std::numeric_limits<unsigned char>::max());
+	// The listeners are called once the peers are released: they may use the network meanwhile.
+	std::vector<peer> disconnected;
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
+		disconnected.reserve(m_peers.size());
+		for (auto&& peer_pair : m_peers) {
+			peer& p = peer_pair.second;
+			m_manager.disconnect(p);
+			p.distance(std::numeric_limits<unsigned char>::max());
+			disconnected.push_back(p);
+		}
+
+		close_streams(nullptr);
+		m_peers.clear();
+		m_me.path_to_passing_by().clear();
+		m_me.bridging_from_to().clear();
+		m_failed_connections.clear();
+	}
+
+	std::shared_lock<std::shared_mutex> lock_guard(m_dc_mutex);
+	for (const peer& p : disconnected) {
 		breep::logger<peer_manager>.info("Peer " + p.id_as_string() + " disconnected");
 
-		std::lock_guard<std::mutex> lock_guard(m_dc_mutex);
 		for(auto& l : m_dc_listener) {
 			try {
 				breep::logger<peer_manager>.trace("Calling disconnection listener (id: " + std::to_string(l.first) + ")");
@@ -178,16 +252,11 @@ void breep::basic_peer_manager<T>::disconnect() {
 			}
 		}
 	}
-
-	m_peers.clear();
-	m_me.path_to_passing_by().clear();
-	m_me.bridging_from_to().clear();
-	m_failed_connections.clear();
 }
 
 template <typename T>
 inline breep::listener_id breep::basic_peer_manager<T>::add_connection_listener(connection_listener listener) {
-	std::lock_guard<std::mutex> lock_guard(m_co_mutex);
+	std::lock_guard<std::shared_mutex> lock_guard(m_co_mutex);
 	m_co_listener.emplace(m_id_count, listener);
 	breep::logger<peer_manager>.trace("Adding connection listener (id: " + std::to_string(m_id_count) + ")");
 	return m_id_count++;
@@ -195,7 +264,7 @@ inline breep::listener_id breep::basic_peer_manager<T>::add_connection_listener(
 
 template <typename T>
 inline breep::listener_id breep::basic_peer_manager<T>::add_data_listener(data_received_listener listener){
-	std::lock_guard<std::mutex> lock_guard(m_data_mutex);
+	std::lock_guard<std::shared_mutex> lock_guard(m_data_mutex);
 	m_data_r_listener.emplace(m_id_count, listener);
 	breep::logger<peer_manager>.trace("Adding data listener (id: " + std::to_string(m_id_count) + ")");
 	return m_id_count++;
@@ -203,33 +272,48 @@ inline breep::listener_id breep::basic_peer_manager<T>::add_data_listener(data_r
 
 template <typename T>
 inline breep::listener_id breep::basic_peer_manager<T>::add_disconnection_listener(disconnection_listener listener){
-	std::lock_guard<std::mutex> lock_guard(m_dc_mutex);
+	std::lock_guard<std::shared_mutex> lock_guard(m_dc_mutex);
 	m_dc_listener.emplace(m_id_count, listener);
 	breep::logger<peer_manager>.trace("Adding disconnection listener (id: " + std::to_string(m_id_count) + ")");
 	return m_id_count++;
 }
 
+template <typename T>
+inline breep::listener_id breep::basic_peer_manager<T>::add_stream_listener(stream_listener listener){
+	std::lock_guard<std::shared_mutex> lock_guard(m_stream_mutex);
+	m_stream_listener.emplace(m_id_count, listener);
+	breep::logger<peer_manager>.trace("Adding stream listener (id: " + std::to_string(m_id_count) + ")");
+	return m_id_count++;
+}
+
 template <typename T>
 inline bool breep::basic_peer_manager<T>::remove_connection_listener(listener_id id) {
-	std::lock_guard<std::mutex> lock_guard(m_co_mutex);
+	std::lock_guard<std::shared_mutex> lock_guard(m_co_mutex);
 	breep::logger<peer_manager>.trace("Removing connection listener (id: " + std::to_string(m_id_count) + ")");
 	return m_co_listener.erase(id) > 0;
 }
 
 template <typename T>
 inline bool breep::basic_peer_manager<T>::remove_disconnection_listener(listener_id id) {
-	std::lock_guard<std::mutex> lock_guard(m_dc_mutex);
+	std::lock_guard<std::shared_mutex> lock_guard(m_dc_mutex);
 	breep::logger<peer_manager>.trace("Removing disconnection listener (id: " + std::to_string(m_id_count) + ")");
 	return m_dc_listener.erase(id) > 0;
 }
 
 template <typename T>
 inline bool breep::basic_peer_manager<T>::remove_data_listener(listener_id id) {
-	std::lock_guard<std::mutex> lock_guard(m_data_mutex);
+	std::lock_guard<std::shared_mutex> lock_guard(m_data_mutex);
 	breep::logger<peer_manager>.trace("Removing data listener (id: " + std::to_string(m_id_count) + ")");
 	return m_data_r_listener.erase(id) > 0;
 }
 
+template <typename T>
+inline bool breep::basic_peer_manager<T>::remove_stream_listener(listener_id id) {
+	std::lock_guard<std::shared_mutex> lock_guard(m_stream_mutex);
+	breep::logger<peer_manager>.trace("Removing stream listener (id: " + std::to_string(m_id_count) + ")");
+	return m_stream_listener.erase(id) > 0;
+}
+
 /* PRIVATE */
 
 template <typename T>
@@ -261,6 +345,7 @@ bool breep::basic_peer_manager<T>::try_connect(const boost::asio::ip::address& a
 
 template <typename T>
 inline void breep::basic_peer_manager<T>::peer_connected(peer&& p) {
+	std::unique_lock<std::recursive_mutex> lock(m_peers_mutex);
 	if (m_peers.count(p.id())) {
 		breep::logger<peer_manager>.warning("Peer with id " + p.id_as_string()
 				+ " tried to connect, but a peer with equal id is already connected.");
@@ -282,14 +367,17 @@ inline void breep::basic_peer_manager<T>::peer_connected(peer&& p) {
 		peer& new_peer = m_peers.at(id);
 		new_peer.distance(0);
 		m_manager.process_connected_peer(new_peer);
+		// copied, as the peer may disconnect once the lock is released
+		const peer connected(new_peer);
+		lock.unlock();
 
 		breep::logger<peer_manager>.info("Peer " + boost::uuids::to_string(id) + " connected");
 
-		std::lock_guard<std::mutex> lock_guard(m_co_mutex);
+		std::shared_lock<std::shared_mutex> lock_guard(m_co_mutex);
 		for(auto& l : m_co_listener) {
 			try {
 				breep::logger<peer_manager>.trace("Calling connection listener (id: " + std::to_string(l.first) + ")");
-				l.second(*this, p);
+				l.second(*this, connected);
 
 			} catch (const std::exception& e) {
 				breep::logger<peer_manager>.warning("Exception thrown while calling connection listener " + l.first);
@@ -307,7 +395,8 @@ inline void breep::basic_peer_manager<T>::peer_connected(peer&& p) {
 }
 
 template <typename T>
-inline void breep::basic_peer_manager<T>::peer_connected(peer&& p, unsigned char distance, peer& bridge) {
+inline void breep::basic_peer_manager<T>::peer_connected(peer&& p, unsigned char distance, peer& bridge,
+                                                         std::unique_lock<std::recursive_mutex>& lock) {
 	boost::uuids::uuid id = p.id();
 	m_peers.emplace(std::make_pair(id, std::move(p)));
 
@@ -318,14 +407,18 @@ inline void breep::basic_peer_manager<T>::peer_connected(peer&& p, unsigned char
 	peer& new_peer = m_peers.at(id);
 	new_peer.distance(distance);
 	m_manager.process_connected_peer(new_peer);
+	update_distance(new_peer);
+	// copied, as the peer may disconnect once the lock is released
+	const peer connected(new_peer);
+	lock.unlock();
 
 	breep::logger<peer_manager>.info("Peer " + boost::uuids::to_string(id) + " connected");
 
-	std::lock_guard<std::mutex> lock_guard(m_co_mutex);
+	std::shared_lock<std::shared_mutex> lock_guard(m_co_mutex);
 	for (auto& l : m_co_listener) {
 		try {
 			breep::logger<peer_manager>.trace("Calling connection listener (id: " + std::to_string(l.first) + ")");
-			l.second(*this, p);
+			l.second(*this, connected);
 
 		} catch (const std::exception& e) {
 			breep::logger<peer_manager>.warning("Exception thrown while calling connection listener " + l.first);
@@ -336,31 +429,37 @@ inline void breep::basic_peer_manager<T>::peer_connected(peer&& p, unsigned char
 			delete e;
 		}
 	}
-
-	update_distance(p);
 }
 
 template <typename T>
 inline void breep::basic_peer_manager<T>::peer_disconnected(peer& p) {
-	p.distance(std::numeric_limits<unsigned char>::max());
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
+		p.distance(std::numeric_limits<unsigned char>::max());
+	}
 
 	breep::logger<peer_manager>.info("Peer " + p.id_as_string() + " disconnected");
 
-	std::lock_guard<std::mutex> lock_guard(m_dc_mutex);
-	for(auto& l : m_dc_listener) {
-		try {
-			breep::logger<peer_manager>.trace("Calling disconnection listener (id: " + std::to_string(l.first) + ")");
-			l.second(*this, p);
+	{
+		std::shared_lock<std::shared_mutex> lock_guard(m_dc_mutex);
+		for(auto& l : m_dc_listener) {
+			try {
+				breep::logger<peer_manager>.trace("Calling disconnection listener (id: " + std::to_string(l.first) + ")");
+				l.second(*this, p);
 
-		} catch (const std::exception& e) {
-			breep::logger<peer_manager>.warning("Exception thrown while calling disconnection listener " + l.first);
-			breep::logger<peer_manager>.warning(e.what());
-		} catch (const std::exception* e) {
-			breep::logger<peer_manager>.warning("Exception thrown while calling disconnection listener " + l.first);
-			breep::logger<peer_manager>.warning(e->what());
-			delete e;
+			} catch (const std::exception& e) {
+				breep::logger<peer_manager>.warning("Exception thrown while calling disconnection listener " + l.first);
+				breep::logger<peer_manager>.warning(e.what());
+			} catch (const std::exception* e) {
+				breep::logger<peer_manager>.warning("Exception thrown while calling disconnection listener " + l.first);
+				breep::logger<peer_manager>.warning(e->what());
+				delete e;
+			}
 		}
 	}
+	close_streams(&p);
+
+	std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
 	m_me.path_to_passing_by().erase(p.id());
 	m_me.bridging_from_to().erase(p.id());
 
@@ -368,7 +467,25 @@ inline void breep::basic_peer_manager<T>::peer_disconnected(peer& p) {
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::data_received(const peer& source, commands command, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::data_received(const peer& source, commands command, const detail::unowning_linear_container& data) {
+	switch (command) {
+		case commands::send_to:
+		case commands::send_to_all:
+		case commands::stream_chunk:
+		case commands::forwarding_to:
+			// these handlers lock the peers list themselves, and call the listeners once they released it
+		case commands::keep_alive:
+		case commands::connection_accepted:
+		case commands::connection_refused:
+			// these handlers do not touch the peers list
+		case commands::stream_ack:
+			// only locks the peers list to forward the acknowledgement
+			((*this).*(m_command_handlers[static_cast<uint8_t>(command)]))(source, data);
+			return;
+		default:
+			break;
+	}
+	std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
 	((*this).*(m_command_handlers[static_cast<uint8_t>(command)]))(source, data);
 }
 
@@ -391,17 +508,30 @@ void breep::basic_peer_manager<T>::update_distance(const peer& concerned_peer) {
 
 
 template <typename T>
-inline void breep::basic_peer_manager<T>::forward_if_needed(const peer& source, commands command, const std::vector<uint8_t>& data) {
+inline void breep::basic_peer_manager<T>::forward_if_needed(const peer& source, commands command, const detail::unowning_linear_container& data) {
 	const std::vector<const peer*>& peers =	m_me.bridging_from_to().at(source.id());
+	if (peers.size() < 2) {
+		for (const peer* the_peer : peers) {
+			breep::logger<peer_manager>.trace
+					("Forwarding " + std::to_string(data.size()) + " octets from " + source.id_as_string() + " to " + the_peer->id_as_string());
+			m_manager.send(command, data, *the_peer);
+		}
+		return;
+	}
+
+	std::vector<uint8_t> buffer = m_manager.acquire_buffer(data.size());
+	buffer.insert(buffer.end(), data.cbegin(), data.cend());
+	std::shared_ptr<const std::vector<uint8_t>> shared_data = m_manager.share_buffer(std::move(buffer));
 	for (const peer* the_peer : peers) {
 		breep::logger<peer_manager>.trace
 				("Forwarding " + std::to_string(data.size()) + " octets from " + source.id_as_string() + " to " + the_peer->id_as_string());
-		m_manager.send(command, data, *the_peer);
+		m_manager.send_shared(command, shared_data, *the_peer);
 	}
+	m_manager.end_shared();
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::send_to_handler(const peer& /*source*/, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::send_to_handler(const peer& /*source*/, const detail::unowning_linear_container& data) {
 	std::vector<uint8_t> processed_data;
 	detail::unmake_little_endian(data, processed_data);
 
@@ -411,6 +541,7 @@ void breep::basic_peer_manager<T>::send_to_handler(const peer& /*source*/, const
 	std::copy(processed_data.data() + 1, processed_data.data() + 1 + id_size, sender_id.data);
 	std::copy(processed_data.data() + 1 + id_size, processed_data.data() + 1 + 2 * id_size, target_id.data);
 
+	std::unique_lock<std::recursive_mutex> lock(m_peers_mutex);
 	if (!m_peers.count(sender_id)) {
 		breep::logger<peer_manager>.error("Received data from peer " + boost::uuids::to_string(sender_id)
 				+ " which is disconnected.");
@@ -419,10 +550,12 @@ void breep::basic_peer_manager<T>::send_to_handler(const peer& /*source*/, const
 
 	if (m_me.id() == target_id) {
 
-		const peer& sender(m_peers.at(sender_id));
+		// copied, as the sender may disconnect once the lock is released
+		const peer sender(m_peers.at(sender_id));
+		lock.unlock();
 		breep::logger<peer_manager>.debug
 				("Received " + std::to_string(data.size() - id_size) + " octets in a private message from " + sender.id_as_string());
-		std::lock_guard<std::mutex> lock_guard(m_data_mutex);
+		std::shared_lock<std::shared_mutex> lock_guard(m_data_mutex);
 		for (auto& l : m_data_r_listener) {
 			try {
 				breep::logger<peer_manager>.trace("Calling data listener (id: " + std::to_string(l.first) + ")");
@@ -444,9 +577,12 @@ void breep::basic_peer_manager<T>::send_to_handler(const peer& /*source*/, const
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::send_to_all_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::send_to_all_handler(const peer& source, const detail::unowning_linear_container& data) {
 
-	forward_if_needed(source, commands::send_to_all, data);
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
+		forward_if_needed(source, commands::send_to_all, data);
+	}
 
 	std::vector<uint8_t> processed_data;
 	detail::unmake_little_endian(data, processed_data);
@@ -454,7 +590,7 @@ void breep::basic_peer_manager<T>::send_to_all_handler(const peer& source, const
 	breep::logger<peer_manager>.debug
 			("Received " + std::to_string(data.size()) + "octets from " + source.id_as_string());
 
-	std::lock_guard<std::mutex> lock_guard(m_data_mutex);
+	std::shared_lock<std::shared_mutex> lock_guard(m_data_mutex);
 
 	for (auto& l : m_data_r_listener) {
 		try {
@@ -473,7 +609,7 @@ void breep::basic_peer_manager<T>::send_to_all_handler(const peer& source, const
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::forward_to_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::forward_to_handler(const peer& source, const detail::unowning_linear_container& data) {
 
 	std::string id;
 	detail::unmake_little_endian(data, id);
@@ -490,17 +626,17 @@ void breep::basic_peer_manager<T>::forward_to_handler(const peer& source, const
 	unsigned char dist = source.distance();
 	const boost::uuids::uuid& source_id = source.id();
 	detail::make_little_endian(std::string(&dist, &dist + 1) + std::string(source_id.data, source_id.data + source_id.size()), ldata);
-	m_manager.send(commands::forwarding_to, ldata, target);
+	m_manager.send(commands::forwarding_to, std::move(ldata), target);
 
 	ldata.clear();
 	dist = target.distance();
 	const boost::uuids::uuid& target_id = target.id();
 	detail::make_little_endian(std::string(&dist, &dist + 1) + std::string(target_id.data, target_id.data + target_id.size()), ldata);
-	m_manager.send(commands::forwarding_to, ldata, source);
+	m_manager.send(commands::forwarding_to, std::move(ldata), source);
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::stop_forwarding_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::stop_forwarding_handler(const peer& source, const detail::unowning_linear_container& data) {
 
 	std::string data_str;
 	detail::unmake_little_endian(data, data_str);
@@ -527,13 +663,14 @@ void breep::basic_peer_manager<T>::stop_forwarding_handler(const peer& source, c
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::forwarding_to_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::forwarding_to_handler(const peer& source, const detail::unowning_linear_container& data) {
 	std::string str;
 	detail::unmake_little_endian(data, str);
 	boost::uuids::uuid uuid;
 	std::copy(str.data() + 1, str.data() + str.size() - 1, uuid.data);
 
 	unsigned char distance = static_cast<unsigned char>(str[0]);
+	std::unique_lock<std::recursive_mutex> lock(m_peers_mutex);
 	try {
 		peer& target = m_peers.at(uuid);
 		m_me.path_to(target) = &source;
@@ -550,14 +687,15 @@ void breep::basic_peer_manager<T>::forwarding_to_handler(const peer& source, con
 
 		if (p != nullptr) {
 			p->swap(m_failed_connections.back());
-			peer_connected(std::move(*p->get()), static_cast<unsigned char>(distance + 1), m_peers.at(source.id()));
+			std::unique_ptr<peer> connected = std::move(m_failed_connections.back());
 			m_failed_connections.pop_back();
+			peer_connected(std::move(*connected), static_cast<unsigned char>(distance + 1), m_peers.at(source.id()), lock);
 		}
 	}
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::connect_to_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::connect_to_handler(const peer& source, const detail::unowning_linear_container& data) {
 	std::vector<uint8_t> ldata;
 	detail::unmake_little_endian(data, ldata);
 	auto remote_port = static_cast<unsigned short>(ldata[0] << 8 | ldata[1]);
@@ -580,24 +718,31 @@ void breep::basic_peer_manager<T>::connect_to_handler(const peer& source, const
 	}
 
 	breep::logger<peer_manager>.debug("Connecting to " + boost::uuids::to_string(id) + "@" + buff2 + ":" + std::to_string(remote_port));
-	detail::optional<peer> p(m_manager.connect(boost::asio::ip::address::from_string(buff2), remote_port));
 
 	ldata.clear();
 	detail::make_little_endian(buff, ldata);
 
-	if (p && p->id() == id) {
-		breep::logger<peer_manager>.trace("Connection successful");
-        m_ignore_predicate = true;
-		peer_connected(std::move(p.get()));
-        m_ignore_predicate = true;
-	} else {
-		breep::logger<peer_manager>.trace("Connection failed. Requesting a forwarding.");
-		m_manager.send(commands::forward_to, ldata, source);
-	}
+	boost::uuids::uuid source_id = source.id();
+	m_manager.async_connect(boost::asio::ip::address::from_string(buff2), remote_port,
+	                        [this, id, source_id, ldata](detail::optional<peer>&& p) mutable {
+		std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
+		if (p && p->id() == id) {
+			breep::logger<peer_manager>.trace("Connection successful");
+			m_ignore_predicate = true;
+			peer_connected(std::move(p.get()));
+			m_ignore_predicate = false;
+		} else {
+			breep::logger<peer_manager>.trace("Connection failed. Requesting a forwarding.");
+			auto source_it = m_peers.find(source_id);
+			if (source_it != m_peers.end()) {
+				m_manager.send(commands::forward_to, std::move(ldata), source_it->second);
+			}
+		}
+	});
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::cant_connect_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::cant_connect_handler(const peer& source, const detail::unowning_linear_container& data) {
 	std::vector<uint8_t> id_vect;
 	detail::unmake_little_endian(data, id_vect);
 
@@ -617,11 +762,11 @@ void breep::basic_peer_manager<T>::cant_connect_handler(const peer& source, cons
 
 	std::vector<uint8_t> buffer;
 	detail::make_little_endian(data_to_send, buffer);
-	m_manager.send(commands::connect_to, buffer, m_peers.at(target_id));
+	m_manager.send(commands::connect_to, std::move(buffer), m_peers.at(target_id));
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::update_distance_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::update_distance_handler(const peer& source, const detail::unowning_linear_container& data) {
 	std::string ldata;
 	detail::unmake_little_endian(data, ldata);
 	boost::uuids::uuid uuid;
@@ -634,7 +779,7 @@ void breep::basic_peer_manager<T>::update_distance_handler(const peer& source, c
 			breep::logger<peer_manager>.trace("Found a better path for " + p.id_as_string() + " (through " + source.id_as_string() + ")");
 			std::vector<uint8_t> peer_id;
 			detail::make_little_endian(detail::unowning_linear_container(uuid.data), peer_id);
-			m_manager.send(commands::forward_to, peer_id, source);
+			m_manager.send(commands::forward_to, std::move(peer_id), source);
 			std::vector<uint8_t> sendable;
 			detail::make_little_endian(std::string(&distance, &distance + 1) + std::string(uuid.data, uuid.data + uuid.size()), sendable);
 			for (const auto& peer_p : m_peers) {
@@ -656,7 +801,7 @@ void breep::basic_peer_manager<T>::update_distance_handler(const peer& source, c
 			std::vector<uint8_t> peer_id;
 			breep::logger<peer_manager>.trace("Path to " + (*p)->id_as_string() + " found (through " + source.id_as_string() + ")");
 			detail::make_little_endian(detail::unowning_linear_container(uuid.data), peer_id);
-			m_manager.send(commands::forward_to, peer_id, source);
+			m_manager.send(commands::forward_to, std::move(peer_id), source);
 			std::vector<uint8_t> sendable;
 			detail::make_little_endian(std::string(&distance, &distance + 1) + std::string(uuid.data, uuid.data + uuid.size()), sendable);
 			for (const auto& peer_p : m_peers) {
@@ -669,7 +814,7 @@ void breep::basic_peer_manager<T>::update_distance_handler(const peer& source, c
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::retrieve_distance_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::retrieve_distance_handler(const peer& source, const detail::unowning_linear_container& data) {
 	std::string id;
 	detail::unmake_little_endian(data, id);
 	boost::uuids::uuid uuid;
@@ -679,11 +824,11 @@ void breep::basic_peer_manager<T>::retrieve_distance_handler(const peer& source,
 	std::vector<uint8_t> ldata;
 	detail::make_little_endian(std::string(&dist, &dist + 1) + std::string(uuid.data, uuid.data + uuid.size()), ldata);
 	breep::logger<peer_manager>.trace("Sending distances to " + source.id_as_string());
-	m_manager.send(commands::update_distance, ldata, source);
+	m_manager.send(commands::update_distance, std::move(ldata), source);
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::retrieve_peers_handler(const peer& source, const std::vector<uint8_t>& /*data*/) {
+void breep::basic_peer_manager<T>::retrieve_peers_handler(const peer& source, const detail::unowning_linear_container& /*data*/) {
 
 	auto peers_nbr = static_cast<unsigned short>(m_peers.size());
 	assert(peers_nbr == m_peers.size());
@@ -708,19 +853,18 @@ void breep::basic_peer_manager<T>::retrieve_peers_handler(const peer& source, co
 	std::vector<uint8_t> ldata;
 	detail::make_little_endian(ans, ldata);
 	breep::logger<peer_manager>.trace("Sending peers list to " + source.id_as_string());
-	m_manager.send(commands::peers_list, ldata, source);
+	m_manager.send(commands::peers_list, std::move(ldata), source);
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::peers_list_handler(const peer& /*source*/, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::peers_list_handler(const peer& /*source*/, const detail::unowning_linear_container& data) {
 
 	breep::logger<peer_manager>.trace("Received a list of peers. Scanning through it.");
 
 	std::vector<uint8_t> ldata;
 	detail::unmake_little_endian(data, ldata);
 	size_t peers_nbr(ldata[0] << 8 | ldata[1]);
-	std::vector<peer> peers_list;
-	peers_list.reserve(peers_nbr);
+	auto join = std::make_shared<join_state>();
 
 	size_t index = 2;
 	while(peers_nbr--) {
@@ -743,59 +887,65 @@ void breep::basic_peer_manager<T>::peers_list_handler(const peer& /*source*/, co
 		index += address_size;
 
 		if (uuid != m_me.id() && m_peers.count(uuid) == 0) {
-			bool not_found = true;
-			for (auto it = peers_list.cbegin(), end = peers_list.cend() ; it != end && not_found ; ++it) {
-				if (it->address() == address && it->connection_port() == remote_port) {
-					not_found = false;
-				}
+			auto same_endpoint = [&address, remote_port](const join_target& target) {
+				return target.address == address && target.port == remote_port;
+			};
+			if (std::none_of(join->pending.cbegin(), join->pending.cend(), same_endpoint)) {
+				join->pending.push_back(join_target{uuid, address, remote_port});
+			} else {
+				// two peers can't be listening on the same endpoint: we won't be able to connect to this one.
+				connection_failed(std::make_unique<peer>(uuid, address, remote_port));
 			}
+		}
+	}
+
+	join_next(join);
+}
 
-			if (not_found) {
-				detail::optional<peer> new_peer(m_manager.connect(address, remote_port));
-				if (new_peer) {
-					if (new_peer->id() != uuid) {
-						m_failed_connections.push_back(std::make_unique<peer>(uuid, address, remote_port));
-					}
-					peers_list.emplace_back(std::move(new_peer.get()));
-				} else {
-					m_failed_connections.push_back(std::make_unique<peer>(uuid, address, remote_port));
+template <typename T>
+void breep::basic_peer_manager<T>::join_next(std::shared_ptr<join_state> join) {
+	while (!join->pending.empty() && join->in_flight < m_max_parallel_connections) {
+		join_target target = std::move(join->pending.front());
+		join->pending.pop_front();
+		++join->in_flight;
+
+		m_manager.async_connect(target.address, target.port, [this, join, target](detail::optional<peer>&& new_peer) {
+			std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
+			--join->in_flight;
+
+			if (new_peer) {
+				if (new_peer->id() != target.id) {
+					connection_failed(std::make_unique<peer>(target.id, target.address, target.port));
 				}
+				m_ignore_predicate = true;
+				peer_connected(std::move(new_peer.get()));
+				m_ignore_predicate = false;
 			} else {
-				not_found = true;
-				for (auto it = peers_list.cbegin(), end = peers_list.cend() ; it != end && not_found ; ++it) {
-					if (it->id() == uuid) {
-						not_found = false;
-					}
-				}
-				if (not_found) {
-					m_failed_connections.push_back(std::make_unique<peer>(uuid, address, remote_port));
-				}
+				connection_failed(std::make_unique<peer>(target.id, target.address, target.port));
 			}
-		}
-	}
 
-    m_ignore_predicate = true;
-	for (auto& peer_ptr : peers_list) {
-		peer_connected(std::move(peer_ptr));
+			join_next(join);
+		});
 	}
-    m_ignore_predicate = false;
+}
 
-	std::vector<uint8_t> sendable_uuid;
-	for (std::unique_ptr<peer>& peer_ptr : m_failed_connections) {
-		peer_ptr->distance(std::numeric_limits<unsigned char>::max());
-		detail::make_little_endian(detail::unowning_linear_container(peer_ptr->id().data), sendable_uuid);
+template <typename T>
+void breep::basic_peer_manager<T>::connection_failed(std::unique_ptr<peer>&& failed) {
+	failed->distance(std::numeric_limits<unsigned char>::max());
 
-		for (const std::pair<boost::uuids::uuid, peer>& pair : m_peers) {
-			if (pair.second.distance() == 0) {
-				m_manager.send(commands::retrieve_distance, sendable_uuid, pair.second);
-			}
+	std::vector<uint8_t> sendable_uuid;
+	detail::make_little_endian(detail::unowning_linear_container(failed->id().data), sendable_uuid);
+	for (const std::pair<const boost::uuids::uuid, peer>& pair : m_peers) {
+		if (pair.second.distance() == 0) {
+			m_manager.send(commands::retrieve_distance, sendable_uuid, pair.second);
 		}
-		sendable_uuid.clear();
 	}
+
+	m_failed_connections.push_back(std::move(failed));
 }
 
 template <typename T>
-void breep::basic_peer_manager<T>::peer_disconnection_handler(const peer& source, const std::vector<uint8_t>& data) {
+void breep::basic_peer_manager<T>::peer_disconnection_handler(const peer& source, const detail::unowning_linear_container& data) {
 	forward_if_needed(source, commands::peer_disconnection, data);
 	std::string local_data;
 	detail::unmake_little_endian(data, local_data);
@@ -804,3 +954,244 @@ void breep::basic_peer_manager<T>::peer_disconnection_handler(const peer& source
 	std::copy(local_data.data(), local_data.data() + local_data.size(), uuid.data);
 	peer_disconnected(m_peers.at(uuid));
 }
+
+template <typename T>
+template <typename ChunkFiller>
+bool breep::basic_peer_manager<T>::send_stream_chunks(const peer& p, stream_id id, send_priority priority, ChunkFiller fill) {
+	// p is erased from m_peers if it disconnects meanwhile
+	const boost::uuids::uuid target_id = p.id();
+	const std::string target_name = p.id_as_string();
+
+	std::shared_ptr<outgoing_stream> stream = std::make_shared<outgoing_stream>();
+	{
+		std::lock_guard<std::mutex> lock(m_streams_mutex);
+		if (!m_streams.emplace(stream_key(target_id, id), stream).second) {
+			throw invalid_state("Stream " + std::to_string(id) + " is already being sent to " + target_name + ".");
+		}
+	}
+
+	breep::logger<peer_manager>.debug("Sending stream " + std::to_string(id) + " to " + target_name);
+
+	auto unregister = [this, &target_id, id] {
+		std::lock_guard<std::mutex> lock(m_streams_mutex);
+		m_streams.erase(stream_key(target_id, id));
+	};
+
+	try {
+		uint64_t offset{0};
+		bool last{false};
+		while (!last) {
+			{
+				// waiting for the target to catch up
+				std::unique_lock<std::mutex> lock(stream->mutex);
+				stream->window_opened.wait(lock, [this, &stream] {
+					return stream->closed || stream->pending == 0
+					       || stream->sent - stream->acknowledged + m_stream_chunk_size <= m_stream_window;
+				});
+				if (stream->closed) {
+					breep::logger<peer_manager>.warning("Stream " + std::to_string(id) + " interrupted: " + target_name + " disconnected.");
+					unregister();
+					return false;
+				}
+			}
+
+			std::vector<uint8_t> frame = m_manager.acquire_buffer(1 + 2 * target_id.size() + 2 * detail::max_varint_size + 1 + m_stream_chunk_size);
+			append_route(frame, m_me.id(), target_id);
+			std::array<uint8_t, 2 * detail::max_varint_size> varints;
+			std::size_t varints_size = detail::write_varint(varints.data(), id);
+			varints_size += detail::write_varint(varints.data() + varints_size, offset);
+			frame.insert(frame.end(), varints.data(), varints.data() + varints_size);
+			frame.push_back(0);
+			const std::size_t header_size = frame.size();
+
+			last = fill(frame, m_stream_chunk_size);
+			frame[header_size - 1] = static_cast<uint8_t>(last);
+			const std::size_t chunk_size = frame.size() - header_size;
+
+			std::unique_lock<std::recursive_mutex> lock(m_peers_mutex);
+			auto target_it = m_peers.find(target_id);
+			if (target_it == m_peers.end()) {
+				lock.unlock();
+				m_manager.release_buffer(std::move(frame));
+				breep::logger<peer_manager>.warning("Stream " + std::to_string(id) + " interrupted: " + target_name + " disconnected.");
+				unregister();
+				return false;
+			}
+			// Sending may block on a full send queue: the peers are not kept locked meanwhile.
+			peer target = *m_me.path_to(target_it->second);
+			lock.unlock();
+
+			{
+				std::lock_guard<std::mutex> stream_lock(stream->mutex);
+				stream->sent += chunk_size;
+				++stream->pending;
+			}
+			m_manager.send(commands::stream_chunk, std::move(frame), target, priority);
+			offset += chunk_size;
+		}
+
+		// waiting for the last chunks to be handed to the target's listeners
+		std::unique_lock<std::mutex> lock(stream->mutex);
+		stream->window_opened.wait(lock, [&stream] {
+			return stream->closed || stream->pending == 0;
+		});
+		const bool delivered = stream->pending == 0;
+		lock.unlock();
+		unregister();
+		if (delivered) {
+			breep::logger<peer_manager>.debug("Stream " + std::to_string(id) + " sent to " + target_name + " (" + std::to_string(offset) + " octets)");
+		} else {
+			breep::logger<peer_manager>.warning("Stream " + std::to_string(id) + " interrupted: " + target_name + " disconnected.");
+		}
+		return delivered;
+
+	} catch (...) {
+		unregister();
+		throw;
+	}
+}
+
+template <typename T>
+void breep::basic_peer_manager<T>::close_streams(const peer* target) {
+	std::lock_guard<std::mutex> lock(m_streams_mutex);
+	for (auto& pair : m_streams) {
+		if (target == nullptr || pair.first.first == target->id()) {
+			std::lock_guard<std::mutex> stream_lock(pair.second->mutex);
+			pair.second->closed = true;
+			pair.second->window_opened.notify_all();
+		}
+	}
+}
+
+template <typename T>
+void breep::basic_peer_manager<T>::append_route(std::vector<uint8_t>& data, const boost::uuids::uuid& sender, const boost::uuids::uuid& target) const {
+	data.push_back(static_cast<uint8_t>(sender.size()));
+	data.insert(data.end(), sender.data, sender.data + sender.size());
+	data.insert(data.end(), target.data, target.data + target.size());
+}
+
+template <typename T>
+bool breep::basic_peer_manager<T>::read_route(const detail::unowning_linear_container& data, boost::uuids::uuid& sender, boost::uuids::uuid& target) {
+	if (data.size() < 1 + 2 * sender.size() || data[0] != sender.size()) {
+		return false;
+	}
+	std::copy(data.data() + 1, data.data() + 1 + sender.size(), sender.data);
+	std::copy(data.data() + 1 + sender.size(), data.data() + 1 + 2 * sender.size(), target.data);
+	return true;
+}
+
+template <typename T>
+void breep::basic_peer_manager<T>::stream_chunk_handler(const peer& /*source*/, const detail::unowning_linear_container& data) {
+	boost::uuids::uuid sender_id, target_id;
+	std::unique_lock<std::recursive_mutex> lock(m_peers_mutex);
+	if (!read_route(data, sender_id, target_id) || !m_peers.count(sender_id)) {
+		breep::logger<peer_manager>.warning("Received a stream chunk from an unknown or disconnected peer.");
+		return;
+	}
+
+	if (m_me.id() != target_id) {
+		auto target = m_peers.find(target_id);
+		if (target != m_peers.end()) {
+			breep::logger<peer_manager>.trace("Forwarding stream chunk to " + target->second.id_as_string());
+			m_manager.send(commands::stream_chunk, data, *m_me.path_to(target->second));
+		}
+		return;
+	}
+
+	std::size_t index = 1 + 2 * sender_id.size();
+	uint64_t id, offset;
+	std::size_t varint_size = detail::read_varint(data.data() + index, data.size() - index, id);
+	if (varint_size != 0 && varint_size <= detail::max_varint_size) {
+		index += varint_size;
+		varint_size = detail::read_varint(data.data() + index, data.size() - index, offset);
+	}
+	if (varint_size == 0 || varint_size > detail::max_varint_size || index + varint_size >= data.size()) {
+		breep::logger<peer_manager>.warning("Received a malformed stream chunk from " + boost::uuids::to_string(sender_id));
+		return;
+	}
+	index += varint_size;
+	const bool last = data[index++] != 0;
+	const std::size_t chunk_size = data.size() - index;
+
+	// copied, as the sender may disconnect once the lock is released
+	const peer sender(m_peers.at(sender_id));
+	lock.unlock();
+	breep::logger<peer_manager>.trace("Received " + std::to_string(chunk_size) + " octets of stream " + std::to_string(id) + " from " + sender.id_as_string());
+	{
+		std::shared_lock<std::shared_mutex> lock_guard(m_stream_mutex);
+		if (m_stream_listener.empty()) {
+			breep::logger<peer_manager>.warning("Received a stream chunk, but no stream listener is registered.");
+		}
+		for (auto& l : m_stream_listener) {
+			try {
+				breep::logger<peer_manager>.trace("Calling stream listener (id: " + std::to_string(l.first) + ")");
+				l.second(*this, sender, id, offset, data.data() + index, chunk_size, last);
+
+			} catch (const std::exception& e) {
+				breep::logger<peer_manager>.warning("Exception thrown while calling stream listener " + std::to_string(l.first));
+				breep::logger<peer_manager>.warning(e.what());
+			} catch (const std::exception* e) {
+				breep::logger<peer_manager>.warning("Exception thrown while calling stream listener " + std::to_string(l.first));
+				breep::logger<peer_manager>.warning(e->what());
+				delete e;
+			}
+		}
+	}
+
+	// Opening the sender's window
+	std::vector<uint8_t> ack;
+	ack.reserve(1 + 2 * sender_id.size() + 2 * detail::max_varint_size);
+	append_route(ack, m_me.id(), sender_id);
+	std::array<uint8_t, 2 * detail::max_varint_size> varints;
+	std::size_t varints_size = detail::write_varint(varints.data(), id);
+	varints_size += detail::write_varint(varints.data() + varints_size, offset + chunk_size);
+	ack.insert(ack.end(), varints.data(), varints.data() + varints_size);
+	lock.lock();
+	if (m_peers.count(sender_id)) {
+		m_manager.send(commands::stream_ack, std::move(ack), *m_me.path_to(sender));
+	}
+}
+
+template <typename T>
+void breep::basic_peer_manager<T>::stream_ack_handler(const peer& /*source*/, const detail::unowning_linear_container& data) {
+	boost::uuids::uuid sender_id, target_id;
+	if (!read_route(data, sender_id, target_id)) {
+		breep::logger<peer_manager>.warning("Received a malformed stream acknowledgement.");
+		return;
+	}
+
+	if (m_me.id() != target_id) {
+		std::lock_guard<std::recursive_mutex> lock(m_peers_mutex);
+		auto target = m_peers.find(target_id);
+		if (target != m_peers.end()) {
+			breep::logger<peer_manager>.trace("Forwarding stream acknowledgement to " + target->second.id_as_string());
+			m_manager.send(commands::stream_ack, data, *m_me.path_to(target->second));
+		}
+		return;
+	}
+
+	std::size_t index = 1 + 2 * sender_id.size();
+	uint64_t id, received;
+	std::size_t varint_size = detail::read_varint(data.data() + index, data.size() - index, id);
+	if (varint_size != 0 && varint_size <= detail::max_varint_size) {
+		index += varint_size;
+		varint_size = detail::read_varint(data.data() + index, data.size() - index, received);
+	}
+	if (varint_size == 0 || varint_size > detail::max_varint_size) {
+		breep::logger<peer_manager>.warning("Received a malformed stream acknowledgement from " + boost::uuids::to_string(sender_id));
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_streams_mutex);
+	auto stream = m_streams.find(stream_key(sender_id, id));
+	if (stream == m_streams.end()) {
+		// the stream was interrupted
+		return;
+	}
+	std::lock_guard<std::mutex> stream_lock(stream->second->mutex);
+	stream->second->acknowledged = std::max(stream->second->acknowledged, received);
+	if (stream->second->pending != 0) {
+		--stream->second->pending;
+	}
+	stream->second->window_opened.notify_all();
+}
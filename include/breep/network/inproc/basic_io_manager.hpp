@@ -0,0 +1,327 @@
+#ifndef BREEP_NETWORK_INPROC_BASIC_IO_MANAGER_HPP
+#define BREEP_NETWORK_INPROC_BASIC_IO_MANAGER_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file inproc/basic_io_manager.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/uuid/uuid.hpp>
+
+#include "breep/network/io_manager_base.hpp"
+#include "breep/network/typedefs.hpp"
+#include "breep/util/exceptions.hpp"
+#include "breep/network/detail/commands.hpp"
+#include "breep/network/detail/mpsc_queue.hpp"
+
+
+namespace breep {
+	template <typename T>
+	class basic_peer_manager;
+
+	namespace detail {
+		template <typename T>
+		class peer_manager_attorney;
+	}
+}
+
+namespace breep { namespace inproc {
+
+	struct mailbox;
+
+	/**
+	 * What an io_manager gives to another one.
+	 */
+	struct message final {
+		enum class kind : uint8_t {
+			data,
+			// id, port, reply_link and reply_to are set.
+			connect_request,
+			// id, port, reply_link and reply_to are set.
+			connect_accept,
+			connect_refuse,
+			close
+		};
+
+		kind type{kind::data};
+		// link of the receiver the message is about.
+		uint64_t link{0};
+
+		commands command{commands::null_command};
+		std::vector<uint8_t> payload{};
+		// set instead of payload for data shared between peers.
+		std::shared_ptr<const std::vector<uint8_t>> shared_payload{};
+
+		boost::uuids::uuid id{};
+		unsigned short port{0};
+		uint64_t reply_link{0};
+		std::shared_ptr<mailbox> reply_to{};
+	};
+
+	/**
+	 * Queue of the messages given to an io_manager.
+	 */
+	struct mailbox final {
+
+		/**
+		 * @brief Queues the message, and wakes the io_manager up if it is not already about to read its messages.
+		 */
+		void deliver(message&& m) {
+			queue.push(std::move(m));
+			if (!drain_scheduled.exchange(true)) {
+				std::lock_guard<std::mutex> lock(owner_mutex);
+				if (wake) {
+					wake();
+				}
+			}
+		}
+
+		detail::mpsc_queue<message> queue{};
+		// true while a read of the queue is pending.
+		std::atomic<bool> drain_scheduled{false};
+		// schedules a read of the queue. Emptied when the owning io_manager is destroyed.
+		std::function<void()> wake{};
+		std::mutex owner_mutex{};
+	};
+
+	/**
+	 * @brief Process-wide table of the listening io_managers, by port.
+	 *
+	 * @since 1.1.0
+	 */
+	class registry final {
+	public:
+		registry() = delete;
+
+		/**
+		 * @throws boost::system::system_error if the port is taken.
+		 */
+		static void bind(unsigned short port, const std::shared_ptr<mailbox>& box) {
+			std::lock_guard<std::mutex> lock(mutex());
+			auto it = mailboxes().find(port);
+			if (it != mailboxes().end() && !it->second.expired() && it->second.lock() != box) {
+				throw boost::system::system_error(boost::asio::error::address_in_use);
+			}
+			mailboxes()[port] = box;
+		}
+
+		static void unbind(unsigned short port, const mailbox* box) {
+			std::lock_guard<std::mutex> lock(mutex());
+			auto it = mailboxes().find(port);
+			if (it != mailboxes().end() && (it->second.expired() || it->second.lock().get() == box)) {
+				mailboxes().erase(it);
+			}
+		}
+
+		/**
+		 * @return the mailbox of the io_manager listening on \em port, or nullptr.
+		 */
+		static std::shared_ptr<mailbox> find(unsigned short port) {
+			std::lock_guard<std::mutex> lock(mutex());
+			auto it = mailboxes().find(port);
+			return it == mailboxes().end() ? nullptr : it->second.lock();
+		}
+
+	private:
+		static std::mutex& mutex() {
+			static std::mutex m;
+			return m;
+		}
+
+		static std::map<unsigned short, std::weak_ptr<mailbox>>& mailboxes() {
+			static std::map<unsigned short, std::weak_ptr<mailbox>> boxes;
+			return boxes;
+		}
+	};
+
+	/**
+	 * State of a peer, as kept by the io_manager.
+	 */
+	struct io_manager_data final {
+
+		io_manager_data(std::shared_ptr<mailbox> remote_, uint64_t remote_link_, uint64_t link_, bool waiting_acceptance_ans = false)
+				: remote(std::move(remote_))
+				, remote_link(remote_link_)
+				, link(link_)
+				, waiting_acceptance_answer(waiting_acceptance_ans)
+		{}
+
+		// mailbox of the peer's io_manager, and the link under which it knows us.
+		const std::shared_ptr<mailbox> remote;
+		const uint64_t remote_link;
+		// the link under which we know the peer.
+		const uint64_t link;
+		// true for peers that connected to us, until the connection is accepted or refused.
+		bool waiting_acceptance_answer;
+		std::atomic<bool> disconnected{false};
+	};
+
+	/**
+	 * @brief in-process network_manager implementation
+	 * @details Connects peer_managers living in the same process. They are found by port: the address given to
+	 *          connect is ignored, and peers are seen as connected from the loopback address. Frames are handed over
+	 *          as they are to the receiving io_manager, through a lock-free queue read by its network thread:
+	 *          sending is a queue push, there is neither framing nor system call. Messages sent from a given thread
+	 *          are received in the order they were sent.
+	 *
+	 * @tparam MAX_DRAIN_BATCH Number of messages handled in a row by the network thread, before the other handlers get a turn.
+	 *
+	 * @since 1.1.0
+	 */
+	template <unsigned int MAX_DRAIN_BATCH>
+	class basic_io_manager final: public io_manager_base<basic_io_manager<MAX_DRAIN_BATCH>> {
+	public:
+
+		static_assert(MAX_DRAIN_BATCH > 0, "MAX_DRAIN_BATCH should be positive.");
+
+		using io_manager = basic_io_manager<MAX_DRAIN_BATCH>;
+		using peer = basic_peer<io_manager>;
+		using data_type = std::shared_ptr<io_manager_data>;
+
+		/**
+		 * @throws boost::system::system_error if another io_manager of the process listens on \em port.
+		 */
+		explicit basic_io_manager(unsigned short port);
+
+		basic_io_manager(io_manager&& other) noexcept;
+
+		~basic_io_manager() final;
+
+		template <typename Container>
+		void send(commands command, const Container& container, const peer& peer, send_priority priority = send_priority::normal) const;
+
+		template <typename InputIterator, typename size_type>
+		void send(commands command, InputIterator begin, size_type size, const peer& peer, send_priority priority = send_priority::normal) const;
+
+		void send(commands command, std::vector<uint8_t>&& data, const peer& peer, send_priority priority = send_priority::normal) const;
+
+		/**
+		 * @brief Hands the data over without copying it.
+		 *
+		 * @since 1.1.0
+		 */
+		void send_shared(commands command, const std::shared_ptr<const std::vector<uint8_t>>& data, const peer& peer, send_priority priority = send_priority::normal) const;
+
+		detail::optional<peer> connect(const boost::asio::ip::address& address, unsigned short port) final;
+
+		/**
+		 * @brief Connects without blocking: the peer's network thread answers the connection request, or
+		 *        the connection fails once handshake_timeout() passed.
+		 *
+		 * @since 1.1.0
+		 */
+		void async_connect(const boost::asio::ip::address& address, unsigned short port,
+		                   std::function<void(detail::optional<peer>&&)> handler) final;
+
+		void process_connected_peer(peer& peer) final;
+
+		void process_connection_denial(peer& peer) final;
+
+		void disconnect() final;
+
+		void disconnect(peer& peer) final;
+
+		void run() final;
+
+		void set_log_level(log_level ll) const final {
+			breep::logger<io_manager>.level(ll);
+		}
+
+		/**
+		 * @brief Sets the time a connection request is given to be answered.
+		 *
+		 * @since 1.1.0
+		 */
+		void handshake_timeout(std::chrono::milliseconds timeout) {
+			m_handshake_timeout = timeout;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::chrono::milliseconds handshake_timeout() const {
+			return m_handshake_timeout;
+		}
+
+	private:
+
+		// outgoing connection, waiting for an answer.
+		struct connection final {
+			connection(boost::asio::io_service& io_service, unsigned short port_, std::function<void(detail::optional<peer>&&)>&& handler_)
+					: port(port_)
+					, handler(std::move(handler_))
+					, deadline(io_service)
+			{}
+
+			const unsigned short port;
+			std::function<void(detail::optional<peer>&&)> handler;
+			boost::asio::steady_timer deadline;
+		};
+
+		void port(unsigned short port) final;
+
+		void owner(basic_peer_manager<io_manager>* owner) final;
+
+		// makes the mailbox wake this object up.
+		void attach_mailbox();
+
+		// handles the queued messages.
+		void drain();
+
+		void process(message&& m);
+
+		void process_connection_request(message& m);
+
+		void process_connection_answer(message& m);
+
+		void connection_done(uint64_t link, detail::optional<peer>&& result);
+
+		// forgets about the peer, and tells the peer_manager it disconnected.
+		void lose_peer(peer& p);
+
+		static boost::asio::ip::address address() {
+			return boost::asio::ip::address_v4::loopback();
+		}
+
+		basic_peer_manager<io_manager>* m_owner;
+		boost::asio::io_service m_io_service;
+		std::shared_ptr<mailbox> m_mailbox;
+		unsigned short m_port;
+
+		uint64_t m_next_link;
+		// connected peers, by link.
+		std::unordered_map<uint64_t, peer> m_peers;
+		std::map<uint64_t, std::unique_ptr<connection>> m_connections;
+		// messages received from peers we connected to, before the peer_manager accepted them.
+		std::map<uint64_t, std::vector<message>> m_early_messages;
+
+		std::chrono::milliseconds m_handshake_timeout;
+
+		friend class detail::peer_manager_attorney<io_manager>;
+	};
+}} // namespace breep::inproc
+
+#include "breep/network/inproc/impl/basic_io_manager.tcc"
+
+#endif //BREEP_NETWORK_INPROC_BASIC_IO_MANAGER_HPP
@@ -0,0 +1,416 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "breep/network/inproc/basic_io_manager.hpp" // allows my IDE to work
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <iterator>
+#include <boost/asio.hpp>
+
+#include "breep/network/detail/utils.hpp"
+#include "breep/network/basic_peer_manager.hpp"
+#include "breep/network/basic_peer.hpp"
+#include "breep/util/exceptions.hpp"
+
+
+/**
+ * @file basic_io_manager.tcc
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+
+template <unsigned int T>
+breep::inproc::basic_io_manager<T>::basic_io_manager(unsigned short port)
+		: m_owner(nullptr)
+		, m_io_service{}
+		, m_mailbox(std::make_shared<mailbox>())
+		, m_port(port)
+		, m_next_link(1)
+		, m_peers()
+		, m_connections()
+		, m_early_messages()
+		, m_handshake_timeout(5000)
+{
+	registry::bind(m_port, m_mailbox);
+	attach_mailbox();
+}
+
+template <unsigned int T>
+breep::inproc::basic_io_manager<T>::basic_io_manager(io_manager&& other) noexcept
+		: m_owner(other.m_owner)
+		, m_io_service()
+		, m_mailbox(std::move(other.m_mailbox))
+		, m_port(other.m_port)
+		, m_next_link(other.m_next_link)
+		, m_peers()
+		, m_connections()
+		, m_early_messages()
+		, m_handshake_timeout(other.m_handshake_timeout)
+{
+	other.m_io_service.stop();
+	attach_mailbox();
+	// a read may have been scheduled on the other io_service.
+	m_mailbox->drain_scheduled = true;
+	m_io_service.post([this]() {
+		drain();
+	});
+}
+
+template <unsigned int T>
+breep::inproc::basic_io_manager<T>::~basic_io_manager() {
+	m_io_service.stop();
+	if (!m_mailbox) {
+		// moved from.
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mailbox->owner_mutex);
+		m_mailbox->wake = nullptr;
+	}
+	registry::unbind(m_port, m_mailbox.get());
+
+	for (auto& pair : m_peers) {
+		disconnect(pair.second);
+	}
+}
+
+template <unsigned int T>
+template <typename Container>
+inline void breep::inproc::basic_io_manager<T>::send(commands command, const Container& container, const peer& peer, send_priority priority) const {
+	send(command, container.cbegin(), container.size(), peer, priority);
+}
+
+template <unsigned int T>
+template <typename InputIterator, typename size_type>
+inline void breep::inproc::basic_io_manager<T>::send(commands command, InputIterator begin, size_type size, const peer& peer, send_priority priority) const {
+	std::vector<uint8_t> payload;
+	payload.reserve(static_cast<std::size_t>(size));
+	std::copy_n(begin, size, std::back_inserter(payload));
+	send(command, std::move(payload), peer, priority);
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::send(commands command, std::vector<uint8_t>&& data, const peer& peer, send_priority /*priority*/) const {
+	if (!peer.io_data || peer.io_data->disconnected) {
+		return;
+	}
+
+	message m;
+	m.link = peer.io_data->remote_link;
+	m.command = command;
+	m.payload = std::move(data);
+	peer.io_data->remote->deliver(std::move(m));
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::send_shared(commands command, const std::shared_ptr<const std::vector<uint8_t>>& data, const peer& peer, send_priority /*priority*/) const {
+	if (!peer.io_data || peer.io_data->disconnected) {
+		return;
+	}
+
+	message m;
+	m.link = peer.io_data->remote_link;
+	m.command = command;
+	m.shared_payload = data;
+	peer.io_data->remote->deliver(std::move(m));
+}
+
+template <unsigned int T>
+auto breep::inproc::basic_io_manager<T>::connect(const boost::asio::ip::address& address, unsigned short port) -> detail::optional<peer> {
+	// The network is not running yet: the connection is driven from the calling thread.
+	detail::optional<peer> result;
+	bool done = false;
+
+	m_io_service.reset();
+	async_connect(address, port, [&result, &done](detail::optional<peer>&& p) {
+		if (p) {
+			result.emplace(std::move(*p));
+		}
+		done = true;
+	});
+	while (!done && m_io_service.run_one()) {}
+	return result;
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::async_connect(const boost::asio::ip::address& /*address*/, unsigned short port,
+                                                       std::function<void(detail::optional<peer>&&)> handler) {
+	std::shared_ptr<mailbox> remote = registry::find(port);
+	if (!remote) {
+		breep::logger<io_manager>.warning("Connection refused (port " + std::to_string(port) + ")");
+		handler({});
+		return;
+	}
+
+	uint64_t link = m_next_link++;
+	auto co = std::make_unique<connection>(m_io_service, port, std::move(handler));
+	co->deadline.expires_after(m_handshake_timeout);
+	co->deadline.async_wait([this, link](const boost::system::error_code& ec) {
+		auto it = m_connections.find(link);
+		if (ec != boost::asio::error::operation_aborted && it != m_connections.end()) {
+			breep::logger<io_manager>.warning("Connection to port " + std::to_string(it->second->port) + " timed out.");
+			connection_done(link, {});
+		}
+	});
+	m_connections.emplace(link, std::move(co));
+
+	message request;
+	request.type = message::kind::connect_request;
+	request.id = m_owner->self().id();
+	request.port = m_owner->port();
+	request.reply_link = link;
+	request.reply_to = m_mailbox;
+	remote->deliver(std::move(request));
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::process_connected_peer(peer& peer) {
+	data_type io_data = peer.io_data;
+	m_peers.erase(io_data->link);
+	m_peers.emplace(io_data->link, peer);
+
+	if (io_data->waiting_acceptance_answer) {
+		io_data->waiting_acceptance_answer = false;
+		message answer;
+		answer.type = message::kind::connect_accept;
+		answer.link = io_data->remote_link;
+		answer.id = m_owner->self().id();
+		answer.port = m_owner->port();
+		answer.reply_link = io_data->link;
+		answer.reply_to = m_mailbox;
+		io_data->remote->deliver(std::move(answer));
+	}
+
+	auto early = m_early_messages.find(io_data->link);
+	if (early != m_early_messages.end()) {
+		std::vector<message> messages = std::move(early->second);
+		m_early_messages.erase(early);
+		for (message& m : messages) {
+			process(std::move(m));
+		}
+	}
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::process_connection_denial(peer& peer) {
+	io_manager_data& io_data = *peer.io_data;
+	m_early_messages.erase(io_data.link);
+	io_data.disconnected = true;
+
+	message answer;
+	answer.type = io_data.waiting_acceptance_answer ? message::kind::connect_refuse : message::kind::close;
+	answer.link = io_data.remote_link;
+	io_data.waiting_acceptance_answer = false;
+	io_data.remote->deliver(std::move(answer));
+}
+
+template <unsigned int T>
+inline void breep::inproc::basic_io_manager<T>::disconnect() {
+	m_io_service.stop();
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::disconnect(peer& peer) {
+	if (!peer.io_data || peer.io_data->disconnected.exchange(true)) {
+		return;
+	}
+	message close;
+	close.type = message::kind::close;
+	close.link = peer.io_data->remote_link;
+	peer.io_data->remote->deliver(std::move(close));
+
+	data_type io_data = peer.io_data;
+	m_io_service.post([this, io_data]() {
+		auto it = m_peers.find(io_data->link);
+		if (it != m_peers.end() && it->second.io_data == io_data) {
+			m_peers.erase(it);
+		}
+	});
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::run() {
+	m_io_service.reset();
+	breep::logger<io_manager>.info("The network is now online.");
+
+	{
+		// there is no pending operation while waiting for messages.
+		boost::asio::io_service::work work(m_io_service);
+		m_io_service.run();
+	}
+
+	// The peers are then disconnected by the peer_manager.
+	m_peers.clear();
+	boost::system::error_code ec;
+	for (auto& pair : m_connections) {
+		pair.second->deadline.cancel(ec);
+	}
+	m_connections.clear();
+	m_early_messages.clear();
+
+	breep::logger<io_manager>.info("The network is now offline.");
+}
+
+/* PRIVATE */
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::port(unsigned short port) {
+	if (port == m_port) {
+		return;
+	}
+	registry::bind(port, m_mailbox);
+	registry::unbind(m_port, m_mailbox.get());
+	m_port = port;
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::owner(basic_peer_manager<io_manager>* owner) {
+	if (m_owner == nullptr) {
+		m_owner = owner;
+	} else {
+		throw invalid_state("Tried to set an already set owner. This object shouldn't be shared.");
+	}
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::attach_mailbox() {
+	std::lock_guard<std::mutex> lock(m_mailbox->owner_mutex);
+	m_mailbox->wake = [this]() {
+		m_io_service.post([this]() {
+			drain();
+		});
+	};
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::drain() {
+	// Cleared before reading: messages queued from now on schedule another read.
+	m_mailbox->drain_scheduled = false;
+
+	message m;
+	for (unsigned int i = 0 ; i < T ; ++i) {
+		if (!m_mailbox->queue.pop(m)) {
+			return;
+		}
+		process(std::move(m));
+	}
+
+	// there may be more.
+	if (!m_mailbox->drain_scheduled.exchange(true)) {
+		m_io_service.post([this]() {
+			drain();
+		});
+	}
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::process(message&& m) {
+	switch (m.type) {
+		case message::kind::connect_request:
+			process_connection_request(m);
+			return;
+		case message::kind::connect_accept:
+		case message::kind::connect_refuse:
+			process_connection_answer(m);
+			return;
+		default:
+			break;
+	}
+
+	auto it = m_peers.find(m.link);
+	if (it == m_peers.end()) {
+		auto early = m_early_messages.find(m.link);
+		if (early != m_early_messages.end()) {
+			early->second.push_back(std::move(m));
+		}
+		return;
+	}
+
+	peer& p = it->second;
+	if (m.type == message::kind::close) {
+		breep::logger<io_manager>.trace("Connection closed by peer " + p.id_as_string());
+		lose_peer(p);
+	} else if (!p.io_data->disconnected) {
+		const std::vector<uint8_t>& payload = m.shared_payload ? *m.shared_payload : m.payload;
+		detail::peer_manager_attorney<io_manager>::data_received(*m_owner, p, m.command,
+		                                                         detail::unowning_linear_container(payload.data(), payload.size()));
+	}
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::process_connection_request(message& m) {
+	breep::logger<io_manager>.trace("Connection request from port " + std::to_string(m.port));
+	detail::peer_manager_attorney<io_manager>::peer_connected(*m_owner, peer(
+			m.id,
+			address(),
+			m.port,
+			std::make_shared<io_manager_data>(std::move(m.reply_to), m.reply_link, m_next_link++, true)
+	));
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::process_connection_answer(message& m) {
+	auto it = m_connections.find(m.link);
+	if (it == m_connections.end()) {
+		// the connection timed out.
+		if (m.type == message::kind::connect_accept) {
+			message close;
+			close.type = message::kind::close;
+			close.link = m.reply_link;
+			m.reply_to->deliver(std::move(close));
+		}
+		return;
+	}
+
+	if (m.type == message::kind::connect_refuse) {
+		breep::logger<io_manager>.info("Connection refused (port " + std::to_string(it->second->port) + ")");
+		connection_done(m.link, {});
+		return;
+	}
+
+	// The peer may send data before the peer_manager accepted it.
+	m_early_messages[m.link];
+	connection_done(m.link, peer(
+			m.id,
+			address(),
+			m.port,
+			std::make_shared<io_manager_data>(std::move(m.reply_to), m.reply_link, m.link)
+	));
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::connection_done(uint64_t link, detail::optional<peer>&& result) {
+	auto it = m_connections.find(link);
+	std::unique_ptr<connection> co = std::move(it->second);
+	m_connections.erase(it);
+
+	boost::system::error_code ec;
+	co->deadline.cancel(ec);
+	co->handler(std::move(result));
+}
+
+template <unsigned int T>
+void breep::inproc::basic_io_manager<T>::lose_peer(peer& p) {
+	data_type io_data = p.io_data;
+	if (io_data->disconnected.exchange(true)) {
+		m_peers.erase(io_data->link);
+		return;
+	}
+
+	peer lost(p);
+	m_peers.erase(io_data->link);
+	detail::peer_manager_attorney<io_manager>::peer_disconnected(*m_owner, lost);
+}
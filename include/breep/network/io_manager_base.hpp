@@ -20,9 +20,14 @@
  * @since 0.1.0
  */
 
+#include <functional>
+#include <vector>
+#include <memory>
+#include <cstdint>
 #include <boost/asio/ip/address.hpp>
 
 #include "breep/util/type_traits.hpp"
+#include "breep/network/typedefs.hpp"
 #include "breep/network/detail/commands.hpp"
 #include "breep/network/detail/utils.hpp"
 
@@ -67,11 +72,14 @@ namespace breep {
 		 * @param command command of the packet (considered as data)
 		 * @param data data to be sent. It is uppon your responsability to check for endianness.
 		 * @param peer the peer to whom to send the data.
+		 * @param priority lane of the peer's send queue user data is sent in. The network's own commands are sent
+		 *                 in the send_priority::control lane. io_managers without send queues may ignore it. @since 1.1.0
 		 *
 		 * @since 0.1.0
 		 */
 		template <typename data_container>
-		void send(commands /*command*/, const data_container& /*data*/, const basic_peer<io_manager>& /*peer*/) const {
+		void send(commands /*command*/, const data_container& /*data*/, const basic_peer<io_manager>& /*peer*/,
+		          send_priority /*priority*/ = send_priority::normal) const {
 			static_assert(detail::dependent_false<io_manager_base<io_manager>, data_container>::value, "Send called without specialisation.");
 		}
 
@@ -87,14 +95,65 @@ namespace breep {
 		 * @param begin iterator to the data to be sent. It is uppon your responsability to check for endianness.
 		 * @param size quantity of data to be sent
 		 * @param peer of the peer to whom to send the data.
+		 * @param priority lane of the peer's send queue user data is sent in. @since 1.1.0
 		 *
 		 * @since 0.1.0
 		 */
 		template <typename data_iterator, typename  size_type>
-		void send(commands command, data_iterator /*begin*/, size_type /*size*/, const basic_peer<io_manager>& /*peer*/) const {
+		void send(commands command, data_iterator /*begin*/, size_type /*size*/, const basic_peer<io_manager>& /*peer*/,
+		          send_priority /*priority*/ = send_priority::normal) const {
 			static_assert(detail::dependent_false<io_manager_base<io_manager>, data_iterator>::value, "Send called without specialisation.");
 		}
 
+		/**
+		 * @brief Sends data that is shared with other peers (typically, a broadcast).
+		 * @details io_managers able to queue the same buffer for several peers should hide this function.
+		 *          The default implementation copies the data.
+		 *
+		 * @since 1.1.0
+		 */
+		void send_shared(commands command, const std::shared_ptr<const std::vector<uint8_t>>& data, const basic_peer<io_manager>& peer,
+		                 send_priority priority = send_priority::normal) const {
+			static_cast<const io_manager*>(this)->send(command, *data, peer, priority);
+		}
+
+		/**
+		 * @brief Called once a shared buffer was passed to send_shared() for each of the peers it is sent to.
+		 * @details io_managers keeping something about the last shared buffer should hide this function.
+		 *
+		 * @since 1.1.0
+		 */
+		void end_shared() const {}
+
+		/**
+		 * @brief Gives an empty buffer with a capacity of at least \em size octets, to be filled and then
+		 *        passed to send(). io_managers that recycle their buffers should hide this function.
+		 *
+		 * @since 1.1.0
+		 */
+		std::vector<uint8_t> acquire_buffer(std::size_t size) const {
+			std::vector<uint8_t> buffer;
+			buffer.reserve(size);
+			return buffer;
+		}
+
+		/**
+		 * @brief Gives back a buffer that is not needed anymore. io_managers that recycle their buffers should hide this function.
+		 *
+		 * @since 1.1.0
+		 */
+		void release_buffer(std::vector<uint8_t>&& /*buffer*/) const {}
+
+		/**
+		 * @brief Turns a buffer into a payload for send_shared(). io_managers that recycle their buffers should hide
+		 *        this function, and give the buffer back once its last owner drops it.
+		 *
+		 * @since 1.1.0
+		 */
+		std::shared_ptr<const std::vector<uint8_t>> share_buffer(std::vector<uint8_t>&& buffer) const {
+			return std::make_shared<const std::vector<uint8_t>>(std::move(buffer));
+		}
+
 		/**
 		 * @brief connects to a peer
 		 *
@@ -104,6 +163,19 @@ namespace breep {
 		 */
 		virtual detail::optional<basic_peer<io_manager>> connect(const boost::asio::ip::address&, unsigned short port) = 0;
 
+		/**
+		 * @brief connects to a peer without blocking the network
+		 * @details \em handler is called with the newly connected peer, or with an empty optional if the connection
+		 *          wasn't successful. Should only be called while the network is running; \em handler is then called
+		 *          from the network thread. The default implementation calls connect() and then \em handler.
+		 *
+		 * @since 1.1.0
+		 */
+		virtual void async_connect(const boost::asio::ip::address& address, unsigned short port,
+		                           std::function<void(detail::optional<basic_peer<io_manager>>&&)> handler) {
+			handler(connect(address, port));
+		}
+
 		/**
 		 * @brief performs any required action after a peer connection.
 		 *
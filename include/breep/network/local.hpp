@@ -0,0 +1,44 @@
+#ifndef BREEP_NETWORK_LOCAL_HPP
+#define BREEP_NETWORK_LOCAL_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file local.hpp
+ * @author Lucas Lazare
+ * @brief convenience header for breep::local: networks of peers running on the same host, over unix domain sockets.
+ * @since 1.1.0
+ */
+
+#include <breep/util/type_traits.hpp>
+#include <breep/network/basic_netdata_wrapper.hpp>
+#include <breep/network/basic_peer.hpp>
+#include <breep/network/basic_network.hpp>
+#include <breep/network/tcp/basic_io_manager.hpp>
+#include <breep/network/local/unix_transport.hpp>
+
+namespace breep { namespace local {
+		using io_manager = tcp::basic_io_manager<1024, 5000, 120000, 54000, unix_transport>;
+		using peer = basic_peer<io_manager>;
+		using network = basic_network<io_manager>;
+		using peer_manager = basic_peer_manager<io_manager>;
+
+		template <typename T>
+		using netdata_wrapper = basic_netdata_wrapper<io_manager, T>;
+}}
+
+BREEP_DECLARE_TYPE(breep::local::io_manager)
+BREEP_DECLARE_TYPE(breep::local::peer)
+BREEP_DECLARE_TYPE(breep::local::peer_manager)
+BREEP_DECLARE_TYPE(breep::local::network)
+
+#endif //BREEP_NETWORK_LOCAL_HPP
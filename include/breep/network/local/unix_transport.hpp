@@ -0,0 +1,127 @@
+#ifndef BREEP_NETWORK_LOCAL_UNIX_TRANSPORT_HPP
+#define BREEP_NETWORK_LOCAL_UNIX_TRANSPORT_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file local/unix_transport.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <string>
+#include <cstdio>
+#include <boost/asio.hpp>
+
+#include "breep/util/exceptions.hpp"
+
+#ifndef BOOST_ASIO_HAS_LOCAL_SOCKETS
+#error "Unix domain sockets are not available on your system."
+#endif
+
+namespace breep { namespace local {
+
+	/**
+	 * @brief Transport of tcp::basic_io_manager over unix domain stream sockets, for peers running on the same host.
+	 * @details The port \em p is the socket file directory() + "/breep-" + p + ".sock". Peers keep their usual
+	 *          addresses and ports (peers connecting are given the loopback address), but the address is not
+	 *          used to reach them: only peers of the same host, sharing the directory, can be connected to.
+	 *
+	 * @since 1.1.0
+	 */
+	struct unix_transport final {
+		using protocol = boost::asio::local::stream_protocol;
+
+		static constexpr bool tcp_options = false;
+
+		/**
+		 * @brief Sets the directory holding the socket files. Defaults to /tmp.
+		 * @note Should be called before any network is created.
+		 */
+		static void directory(std::string path) {
+			directory_path() = std::move(path);
+		}
+
+		static const std::string& directory() {
+			return directory_path();
+		}
+
+		static std::string path(unsigned short port) {
+			return directory() + "/breep-" + std::to_string(port) + ".sock";
+		}
+
+		/**
+		 * @brief Listens to \em port. A socket file left by a process that stopped is replaced.
+		 * @throws unsupported_system if \em reuse_port is requested: acceptors can't share a socket file.
+		 */
+		static protocol::acceptor make_acceptor(boost::asio::io_service& io_service, unsigned short port, bool reuse_port) {
+			if (reuse_port) {
+				throw unsupported_system("Unix domain sockets can't be shared between acceptors: network can't be sharded.");
+			}
+
+			const std::string file = path(port);
+			protocol::socket probe(io_service);
+			boost::system::error_code ec;
+			probe.connect(protocol::endpoint(file), ec);
+			if (ec == boost::asio::error::connection_refused) {
+				// nobody listens anymore.
+				std::remove(file.c_str());
+			}
+			probe.close(ec);
+
+			return protocol::acceptor(io_service, protocol::endpoint(file));
+		}
+
+		static bool dual_stack(const protocol::acceptor&) {
+			return true;
+		}
+
+		static protocol::acceptor make_v4_acceptor(boost::asio::io_service&, const protocol::acceptor&) {
+			throw unsupported_system("Unix domain sockets have no IPv4 variant.");
+		}
+
+		static unsigned short port(const protocol::acceptor& acceptor) {
+			const std::string file = acceptor.local_endpoint().path();
+			const std::size_t begin = file.rfind("/breep-") + 7;
+			return static_cast<unsigned short>(std::stoul(file.substr(begin, file.size() - begin - 5)));
+		}
+
+		/**
+		 * @brief Stops listening, and removes the socket file.
+		 */
+		static void close(protocol::acceptor& acceptor) {
+			boost::system::error_code ec;
+			protocol::endpoint endpoint = acceptor.local_endpoint(ec);
+			if (acceptor.is_open()) {
+				acceptor.close(ec);
+				if (!endpoint.path().empty()) {
+					std::remove(endpoint.path().c_str());
+				}
+			}
+		}
+
+		static protocol::endpoint endpoint(const boost::asio::ip::address&, unsigned short port) {
+			return protocol::endpoint(path(port));
+		}
+
+		static boost::asio::ip::address remote_address(const protocol::socket&, boost::system::error_code&) {
+			return boost::asio::ip::address_v4::loopback();
+		}
+
+	private:
+		static std::string& directory_path() {
+			static std::string directory("/tmp");
+			return directory;
+		}
+	};
+}}
+
+#endif //BREEP_NETWORK_LOCAL_UNIX_TRANSPORT_HPP
@@ -0,0 +1,197 @@
+#ifndef BREEP_NETWORK_LZ_CODEC_HPP
+#define BREEP_NETWORK_LZ_CODEC_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file lz_codec.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+#include "breep/network/codec.hpp"
+
+namespace breep {
+
+	/**
+	 * @brief Fast LZ77 codec, in the spirit of LZ4: favours speed over compression ratio.
+	 * @details The data is a list of sequences, each made of a token (literals count on the 4 high bits, match
+	 *          length - 4 on the 4 low bits, 15 meaning that the count goes on in the following octets), the
+	 *          literals, and the offset of the match (2 octets, little endian). The last sequence has no match.
+	 *
+	 * @since 1.1.0
+	 */
+	class lz_codec final : public codec {
+	public:
+		static constexpr uint8_t codec_id = 1;
+
+		uint8_t id() const override {
+			return codec_id;
+		}
+
+		void compress(const uint8_t* input, std::size_t size, std::vector<uint8_t>& output) const override {
+			output.reserve(output.size() + size + size / 255 + 16);
+
+			// positions (+1) of the last sequence of min_match octets seen with a given hash, 0 if none.
+			std::array<uint32_t, 1 << hash_log> table;
+			table.fill(0);
+
+			std::size_t anchor{0};
+			std::size_t position{0};
+			// skips faster through data that does not compress
+			unsigned int misses{0};
+			while (size >= min_match && position <= size - min_match) {
+				const uint32_t sequence = read32(input + position);
+				uint32_t& entry = table[hash(sequence)];
+				const std::size_t candidate = entry;
+				entry = static_cast<uint32_t>(position + 1);
+
+				if (candidate == 0 || position - (candidate - 1) > max_offset || read32(input + candidate - 1) != sequence) {
+					position += 1 + (misses++ >> 6);
+					continue;
+				}
+
+				const std::size_t match = candidate - 1;
+				std::size_t length = min_match;
+				while (position + length < size && input[match + length] == input[position + length]) {
+					++length;
+				}
+
+				write_sequence(output, input + anchor, position - anchor, position - match, length);
+				position += length;
+				anchor = position;
+				misses = 0;
+			}
+
+			write_sequence(output, input + anchor, size - anchor, 0, 0);
+		}
+
+		bool decompress(const uint8_t* input, std::size_t size, uint8_t* output, std::size_t output_size) const override {
+			std::size_t in{0};
+			std::size_t out{0};
+			while (in < size) {
+				const uint8_t token = input[in++];
+
+				std::size_t literals = token >> 4;
+				if (literals == 15 && !read_length(input, size, in, literals)) {
+					return false;
+				}
+				if (literals > size - in || literals > output_size - out) {
+					return false;
+				}
+				if (literals != 0) {
+					std::memcpy(output + out, input + in, literals);
+				}
+				in += literals;
+				out += literals;
+
+				if (in == size) {
+					// last sequence
+					return out == output_size;
+				}
+
+				if (size - in < 2) {
+					return false;
+				}
+				const std::size_t offset = static_cast<std::size_t>(input[in] | input[in + 1] << 8);
+				in += 2;
+				if (offset == 0 || offset > out) {
+					return false;
+				}
+
+				std::size_t length = token & 15;
+				if (length == 15 && !read_length(input, size, in, length)) {
+					return false;
+				}
+				length += min_match;
+				if (length > output_size - out) {
+					return false;
+				}
+
+				const uint8_t* match = output + out - offset;
+				if (offset >= length) {
+					std::memcpy(output + out, match, length);
+				} else {
+					// overlapping match: repeats the last offset octets
+					for (std::size_t i{0} ; i < length ; ++i) {
+						output[out + i] = match[i];
+					}
+				}
+				out += length;
+			}
+			return false;
+		}
+
+	private:
+		static constexpr std::size_t min_match = 4;
+		static constexpr std::size_t max_offset = 65535;
+		static constexpr unsigned int hash_log = 12;
+
+		static uint32_t read32(const uint8_t* ptr) {
+			uint32_t value;
+			std::memcpy(&value, ptr, sizeof(value));
+			return value;
+		}
+
+		static uint32_t hash(uint32_t sequence) {
+			return (sequence * 2654435761u) >> (32 - hash_log);
+		}
+
+		static void write_length(std::vector<uint8_t>& output, std::size_t length) {
+			for (; length >= 255 ; length -= 255) {
+				output.push_back(255);
+			}
+			output.push_back(static_cast<uint8_t>(length));
+		}
+
+		// reads the octets continuing a count of 15, adding them to \em length.
+		static bool read_length(const uint8_t* input, std::size_t size, std::size_t& in, std::size_t& length) {
+			uint8_t octet;
+			do {
+				if (in == size) {
+					return false;
+				}
+				octet = input[in++];
+				length += octet;
+			} while (octet == 255);
+			return true;
+		}
+
+		// a match \em length of 0 writes the last sequence.
+		static void write_sequence(std::vector<uint8_t>& output, const uint8_t* literals, std::size_t literals_count,
+		                           std::size_t offset, std::size_t length) {
+			const std::size_t match_code = length == 0 ? 0 : length - min_match;
+			output.push_back(static_cast<uint8_t>(std::min<std::size_t>(literals_count, 15) << 4 | std::min<std::size_t>(match_code, 15)));
+			if (literals_count >= 15) {
+				write_length(output, literals_count - 15);
+			}
+			output.insert(output.end(), literals, literals + literals_count);
+
+			if (length != 0) {
+				output.push_back(static_cast<uint8_t>(offset & 0xFF));
+				output.push_back(static_cast<uint8_t>(offset >> 8));
+				if (match_code >= 15) {
+					write_length(output, match_code - 15);
+				}
+			}
+		}
+	};
+}
+
+#endif //BREEP_NETWORK_LZ_CODEC_HPP
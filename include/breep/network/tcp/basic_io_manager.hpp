@@ -18,44 +18,157 @@
  */
 
 #include <cstdint>
-#include <unordered_map>
-#include <queue>
+#include <deque>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <memory>
 #include <limits>
 #include <chrono>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
 #include "breep/network/io_manager_base.hpp"
+#include "breep/network/typedefs.hpp"
 #include "breep/util/exceptions.hpp"
 #include "breep/network/detail/commands.hpp"
+#include "breep/network/detail/buffer_pool.hpp"
+#include "breep/network/detail/peer_table.hpp"
+#include "breep/network/detail/timing_wheel.hpp"
+#include "breep/network/detail/compression.hpp"
+#include "breep/network/tcp/ip_transport.hpp"
 
 
 namespace breep {
 	template <typename T>
 	class basic_peer_manager;
+
+	namespace detail {
+		template <typename T>
+		class peer_manager_attorney;
+	}
 }
 
 namespace breep { namespace tcp {
 
+	/**
+	 * Frame waiting to be sent. The header and the payload are kept in separate
+	 * buffers and handed together to the socket (gathered write).
+	 */
+	struct output_frame final {
+
+		// [command (1 octet)][payload size (varint)]
+		static constexpr std::size_t max_header_size = 1 + detail::max_varint_size;
+
+		output_frame(commands command, std::vector<uint8_t>&& payload_)
+				: header{}
+				, header_size{}
+				, payload(std::move(payload_))
+				, shared_payload()
+		{
+			make_header(command, payload.size());
+		}
+
+		// frame whose payload is shared with other frames (broadcasts).
+		output_frame(commands command, std::shared_ptr<const std::vector<uint8_t>> shared_payload_)
+				: header{}
+				, header_size{}
+				, payload()
+				, shared_payload(std::move(shared_payload_))
+		{
+			make_header(command, shared_payload->size());
+		}
+
+		const std::vector<uint8_t>& payload_data() const {
+			return shared_payload ? *shared_payload : payload;
+		}
+
+		std::size_t size() const {
+			return header_size + payload_data().size();
+		}
+
+		// command the frame was sent with, before it was compressed.
+		commands original_command() const {
+			const auto command = static_cast<commands>(header[0]);
+			return command == commands::compressed ? static_cast<commands>(payload_data()[0]) : command;
+		}
+
+		std::array<uint8_t, max_header_size> header;
+		std::size_t header_size;
+		std::vector<uint8_t> payload;
+		std::shared_ptr<const std::vector<uint8_t>> shared_payload;
+
+	private:
+		void make_header(commands command, std::size_t payload_size) {
+			header[0] = static_cast<uint8_t>(command);
+			header_size = 1 + detail::write_varint(header.data() + 1, payload_size);
+		}
+	};
+
+	/**
+	 * Frames sent to a peer: the ones being written, and the ones waiting in their send_priority lane.
+	 */
+	struct output_queue final {
+
+		/**
+		 * Lightweight ConstBufferSequence over \em gathered, so that asio does not copy the buffers list.
+		 */
+		struct buffers_view {
+			using value_type = boost::asio::const_buffer;
+			using const_iterator = const boost::asio::const_buffer*;
+
+			const_iterator begin() const {
+				return first;
+			}
+
+			const_iterator end() const {
+				return last;
+			}
+
+			const_iterator first;
+			const_iterator last;
+		};
+
+		buffers_view gathered_view() const {
+			return {gathered.data(), gathered.data() + gathered.size()};
+		}
+
+		bool waiting() const {
+			return std::any_of(lanes.cbegin(), lanes.cend(), [](const std::deque<output_frame>& lane) { return !lane.empty(); });
+		}
+
+		// frames being written
+		std::deque<output_frame> writing{};
+		// frames waiting to be written, by send_priority
+		std::array<std::deque<output_frame>, send_priority_count> lanes{};
+		std::vector<boost::asio::const_buffer> gathered{};
+	};
+
 	/**
 	 * io_manager_data, to be stored in peer<tcp::io_manager>.
 	 */
-	template <unsigned int BUFFER_LENGTH>
+	template <unsigned int BUFFER_LENGTH, typename Protocol = boost::asio::ip::tcp>
 	struct io_manager_data final {
 
 		io_manager_data() = delete;
 
-		explicit io_manager_data(boost::asio::ip::tcp::socket&& socket_, bool waiting_acceptance_ans = false)
+		io_manager_data(typename Protocol::socket&& socket_, boost::asio::io_service& io_service, bool waiting_acceptance_ans = false)
 				: socket(std::move(socket_))
+				, strand(io_service)
 				, waiting_acceptance_answer(waiting_acceptance_ans)
+				, cork_timer(io_service)
 		{}
 
-		explicit io_manager_data(std::shared_ptr<boost::asio::ip::tcp::socket>& socket_ptr, bool waiting_acceptance_ans = false)
+		io_manager_data(std::shared_ptr<typename Protocol::socket>& socket_ptr, boost::asio::io_service& io_service, bool waiting_acceptance_ans = false)
 				: socket(std::move(*socket_ptr.get()))
+				, strand(io_service)
 				, waiting_acceptance_answer(waiting_acceptance_ans)
+				, cork_timer(io_service)
 		{}
 
 		~io_manager_data() = default;
@@ -63,16 +176,72 @@ namespace breep { namespace tcp {
 		io_manager_data(const io_manager_data&) = delete;
 		io_manager_data& operator=(const io_manager_data&) = delete;
 
-		boost::asio::ip::tcp::socket socket;
+		typename Protocol::socket socket;
+		// serializes every handler related to this peer
+		boost::asio::io_service::strand strand;
 		std::array<uint8_t, BUFFER_LENGTH> fixed_buffer{};
 		std::vector<uint8_t> dynamic_buffer{};
 
 		std::size_t last_read{};
 		commands last_command{commands::null_command};
+		// octets of the current frame's payload that are yet to be received.
+		std::size_t frame_remaining{};
 
 		bool waiting_acceptance_answer;
 
-		std::chrono::milliseconds timestamp{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())};
+		// frames waiting to be sent, only touched from the strand.
+		output_queue queue{};
+		// flushes the frames held while corking (see basic_io_manager::cork). Only touched from the strand.
+		boost::asio::steady_timer cork_timer;
+		bool cork_timer_armed{false};
+		// octets held since the last write
+		std::size_t corked_octets{};
+
+		// slot of the io_manager's copy of the peer, set once it is connected.
+		detail::peer_handle handle{};
+
+		// octets and frames queued for sending, including the ones being written
+		std::atomic<std::size_t> queued_octets{};
+		std::atomic<std::size_t> queued_frames{};
+		// whether the send queue went over its high watermark and did not drain yet
+		std::atomic<bool> above_high_watermark{false};
+		std::atomic<bool> disconnected{false};
+		// senders blocked on a full queue wait on queue_drained
+		std::mutex queue_mutex{};
+		std::condition_variable queue_drained{};
+
+		// last time data was received from the peer
+		std::atomic<std::chrono::steady_clock::time_point> last_receive{std::chrono::steady_clock::now()};
+		// last time frames were handed to the socket
+		std::atomic<std::chrono::steady_clock::time_point> last_send{std::chrono::steady_clock::now()};
+
+		// codec agreed on during the handshake, nullptr if the frames exchanged with the peer are not compressed.
+		std::shared_ptr<const codec> link_codec{};
+		// payload of the last compressed frame received, once decompressed. Only touched from the strand.
+		std::vector<uint8_t> decompressed{};
+		detail::compression_counters compression{};
+	};
+
+	/**
+	 * Counters updated by the io_manager. They may be read from any thread.
+	 */
+	struct io_statistics final {
+		// number of gathered writes issued
+		std::atomic<uint64_t> writes{0};
+		// number of frames sent
+		std::atomic<uint64_t> frames_written{0};
+		// number of octets sent (headers included)
+		std::atomic<uint64_t> octets_written{0};
+		// number of payload octets copied into their frame (payloads not handed over by rvalue reference)
+		std::atomic<uint64_t> octets_copied{0};
+		// highest number of frames carried by a single write
+		std::atomic<uint64_t> max_frames_per_write{0};
+		// number of frames discarded because a send queue was full
+		std::atomic<uint64_t> frames_dropped{0};
+		// number of keep_alive frames sent
+		std::atomic<uint64_t> keep_alives_sent{0};
+		// number of keep_alive frames not sent because other frames were sent to the peer in the meantime
+		std::atomic<uint64_t> keep_alives_suppressed{0};
 	};
 
 	/**
@@ -81,20 +250,24 @@ namespace breep { namespace tcp {
 	 * @tparam BUFFER_LENGTH          Length of the local buffer
 	 * @tparam keep_alive_send_millis Time interval indicating the sending of keep_alive packets frequency (in milliseconds).
 	 * @tparam timeout_millis         Time interval after which a peer should be considered dead if no packets have been received from him (in milliseconds).
+	 * @tparam transport              Sockets used to reach the peers (see ip_transport). @since 1.1.0
 	 *
 	 * @since 0.1.0
 	 */
-	template <unsigned int BUFFER_LENGTH, unsigned long keep_alive_send_millis, unsigned long timeout_millis, unsigned long timeout_check_interval_millis>
-	class basic_io_manager final: public io_manager_base<basic_io_manager<BUFFER_LENGTH,keep_alive_send_millis,timeout_millis,timeout_check_interval_millis>> {
+	template <unsigned int BUFFER_LENGTH, unsigned long keep_alive_send_millis, unsigned long timeout_millis, unsigned long timeout_check_interval_millis, typename transport = ip_transport>
+	class basic_io_manager final: public io_manager_base<basic_io_manager<BUFFER_LENGTH,keep_alive_send_millis,timeout_millis,timeout_check_interval_millis,transport>> {
 	public:
 
 		// The protocol ID should be changed at each compatibility break.
 		static constexpr uint32_t IO_PROTOCOL_ID_1 =  755960664; // UPDATE THIS TOGETHER WITH THE HASHING FUNCTION +1 [util/type_traits.hpp]
-		static constexpr uint32_t IO_PROTOCOL_ID_2 = 1683390697; // +3
+		static constexpr uint32_t IO_PROTOCOL_ID_2 = 1683390702; // +8
 
-		using io_manager = basic_io_manager<BUFFER_LENGTH,keep_alive_send_millis,timeout_millis,timeout_check_interval_millis>;
+		using io_manager = basic_io_manager<BUFFER_LENGTH,keep_alive_send_millis,timeout_millis,timeout_check_interval_millis,transport>;
 		using peer = basic_peer<io_manager>;
-		using data_type = std::shared_ptr<io_manager_data<BUFFER_LENGTH>>;
+		using socket_type = typename transport::protocol::socket;
+		using acceptor_type = typename transport::protocol::acceptor;
+		using io_data_type = io_manager_data<BUFFER_LENGTH, typename transport::protocol>;
+		using data_type = std::shared_ptr<io_data_type>;
 
 		explicit basic_io_manager(unsigned short port);
 
@@ -106,13 +279,46 @@ namespace breep { namespace tcp {
 		io_manager& operator=(const io_manager&) = delete;
 
 		template <typename Container>
-		void send(commands command, const Container& data, const peer& target) const;
+		void send(commands command, const Container& data, const peer& target, send_priority priority = send_priority::normal) const;
 
 		template <typename InputIterator, typename size_type>
-		void send(commands command, InputIterator it, size_type size, const peer& target) const;
+		void send(commands command, InputIterator it, size_type size, const peer& target, send_priority priority = send_priority::normal) const;
+
+		/**
+		 * @brief Sends data to a peer, taking ownership of it (avoids copying the payload).
+		 */
+		void send(commands command, std::vector<uint8_t>&& data, const peer& target, send_priority priority = send_priority::normal) const;
+
+		/**
+		 * @brief Sends data shared with other peers: the queued frame points at it instead of copying it.
+		 *
+		 * @since 1.1.0
+		 */
+		void send_shared(commands command, std::shared_ptr<const std::vector<uint8_t>> data, const peer& target,
+		                 send_priority priority = send_priority::normal) const {
+			m_compression.compress_shared(target.io_data->link_codec.get(), command, data, target.io_data->compression, m_buffer_pool);
+			queue_frame(output_frame(command, std::move(data)), target, priority);
+		}
+
+		/**
+		 * @brief Releases the compressed form of the last shared payload (see send_shared()): like the payload,
+		 *        it goes back to the pool from whichever thread drops its last reference.
+		 */
+		void end_shared() const {
+			m_compression.end_shared();
+		}
 
 		detail::optional<peer> connect(const boost::asio::ip::address& address, unsigned short port) override;
 
+		/**
+		 * @brief Connects to a peer without blocking the network.
+		 * @details The connection and its handshake are bounded by handshake_timeout().
+		 *
+		 * @since 1.1.0
+		 */
+		void async_connect(const boost::asio::ip::address& address, unsigned short port,
+		                   std::function<void(detail::optional<peer>&&)> handler) override;
+
 		void process_connected_peer(peer& connected) final;
 
 		void process_connection_denial(peer& peer) final;
@@ -127,57 +333,607 @@ namespace breep { namespace tcp {
 			breep::logger<io_manager>.level(ll);
 		}
 
+		/**
+		 * @brief Sets the maximum number of queued frames that may be sent to a peer in a single (gathered) write.
+		 * @note Each frame takes two buffers. Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void max_write_frames(std::size_t frames) {
+			m_max_write_frames = std::max<std::size_t>(frames, 1);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t max_write_frames() const {
+			return m_max_write_frames;
+		}
+
+		/**
+		 * @brief Sets the maximum number of octets that may be sent to a peer in a single (gathered) write.
+		 * @details Frames of higher send_priority lanes wait for the write in progress: smaller writes let them
+		 *          through sooner.
+		 * @note A frame bigger than this limit is still sent, alone. Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void max_write_size(std::size_t octets) {
+			m_max_write_size = octets;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t max_write_size() const {
+			return m_max_write_size;
+		}
+
+		/**
+		 * @brief Sets the maximum size of the frames a peer may send (64 MiB by default). Peers announcing a bigger
+		 *        frame are disconnected before anything is allocated for it.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void max_frame_size(std::size_t octets) {
+			m_max_frame_size = octets;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t max_frame_size() const {
+			return m_max_frame_size;
+		}
+
+		/**
+		 * @brief Sets the number of threads running the network.
+		 * @details Handlers related to a given peer are never run concurrently, but handlers of different
+		 *          peers are. Listeners may thus be called from any of these threads.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void thread_count(unsigned int count) {
+			m_thread_count = std::max(count, 1u);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		unsigned int thread_count() const {
+			return m_thread_count;
+		}
+
+		/**
+		 * @brief Sets the number of independent event loops (shards) running the network.
+		 * @details Each shard has its own io_service, thread and SO_REUSEPORT acceptor on the network port.
+		 *          A peer is pinned to the shard that accepted or connected it: its socket, buffers and
+		 *          outgoing queue are then only touched by that shard's thread. Data sent from any thread
+		 *          is posted to the owning shard. The first shard is the one run by the thread_count() threads.
+		 * @throws invalid_state if the network is running.
+		 * @throws unsupported_system if SO_REUSEPORT is not available and count > 1.
+		 *
+		 * @since 1.1.0
+		 */
+		void shard_count(unsigned int count);
+
+		/**
+		 * @since 1.1.0
+		 */
+		unsigned int shard_count() const {
+			return static_cast<unsigned int>(m_shards.size() + 1);
+		}
+
+		/**
+		 * @brief Gives an empty buffer from the pool of recycled buffers.
+		 *
+		 * @since 1.1.0
+		 */
+		std::vector<uint8_t> acquire_buffer(std::size_t size) const {
+			return m_buffer_pool.acquire(size);
+		}
+
+		/**
+		 * @brief Gives a buffer back to the pool.
+		 *
+		 * @since 1.1.0
+		 */
+		void release_buffer(std::vector<uint8_t>&& buffer) const {
+			m_buffer_pool.release(std::move(buffer));
+		}
+
+		/**
+		 * @brief Turns a buffer into a payload for send_shared(), that goes back to the pool once every frame
+		 *        pointing at it was written.
+		 *
+		 * @since 1.1.0
+		 */
+		std::shared_ptr<const std::vector<uint8_t>> share_buffer(std::vector<uint8_t>&& buffer) const {
+			return m_buffer_pool.share(std::move(buffer));
+		}
+
+		/**
+		 * @return counters about the recycling of the buffers of sent frames.
+		 *
+		 * @since 1.1.0
+		 */
+		const detail::buffer_pool::statistics& buffer_statistics() const {
+			return m_buffer_pool.stats();
+		}
+
+		/**
+		 * @brief Bounds the per-peer send queues.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void send_queue_limits(const breep::send_queue_limits& limits) {
+			m_queue_limits = limits;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		const breep::send_queue_limits& send_queue_limits() const {
+			return m_queue_limits;
+		}
+
+		/**
+		 * @brief Sets the listener called when the send queue of a peer goes over its high watermark.
+		 * @details Called from the sending thread. Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void set_high_watermark_listener(std::function<void(const peer&)> listener) {
+			m_high_watermark_listener = std::move(listener);
+		}
+
+		/**
+		 * @brief Sets the listener called when the send queue of a peer that went over its high watermark
+		 *        is back under its low watermark.
+		 * @details Called from a network thread. Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void set_low_watermark_listener(std::function<void(const peer&)> listener) {
+			m_low_watermark_listener = std::move(listener);
+		}
+
+		/**
+		 * @brief Sets the time an incoming connection is given to complete its handshake.
+		 * @details Handshakes are processed asynchronously: a connection that does not complete it in
+		 *          time is closed, without delaying the other connections.
+		 *
+		 * @since 1.1.0
+		 */
+		void handshake_timeout(std::chrono::milliseconds timeout) {
+			m_handshake_timeout = timeout;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::chrono::milliseconds handshake_timeout() const {
+			return m_handshake_timeout;
+		}
+
+		/**
+		 * @brief Leaves keep-alives to the kernel (SO_KEEPALIVE, TCP_KEEPIDLE, TCP_KEEPINTVL and TCP_KEEPCNT).
+		 * @details keep_alive frames are not sent anymore, and dead connections are detected by the kernel
+		 *          (after idle + interval * probes) instead of timeout_millis. As peers still using timeout_millis
+		 *          would drop a peer that does not send keep_alive frames, this should be enabled on every peer
+		 *          of the network. Applies to the peers that connect afterwards.
+		 * @throws unsupported_system if TCP_KEEPIDLE or TCP_KEEPINTVL are not available.
+		 *
+		 * @since 1.1.0
+		 */
+		void kernel_keep_alive(std::chrono::seconds idle, std::chrono::seconds interval, unsigned int probes = 3) {
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+			m_kernel_keep_alive_idle = std::max(idle, std::chrono::seconds(1));
+			m_kernel_keep_alive_interval = std::max(interval, std::chrono::seconds(1));
+			m_kernel_keep_alive_probes = std::max(probes, 1u);
+#else
+			static_cast<void>(idle);
+			static_cast<void>(interval);
+			static_cast<void>(probes);
+			throw unsupported_system("TCP_KEEPIDLE or TCP_KEEPINTVL is not available on your system.");
+#endif
+		}
+
+		/**
+		 * @brief Goes back to keep_alive frames and timeout_millis, for the peers that connect afterwards.
+		 *
+		 * @since 1.1.0
+		 */
+		void disable_kernel_keep_alive() {
+			m_kernel_keep_alive_idle = std::chrono::seconds(0);
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		bool kernel_keep_alive() const {
+			return m_kernel_keep_alive_idle.count() != 0;
+		}
+
+		/**
+		 * @brief Enables corking: user data sent to a peer that is not being written to is held until \em octets
+		 *        are waiting, or for at most \em delay, then written at once.
+		 * @details Batches small messages (see statistics().max_frames_per_write) at the cost of up to \em delay of
+		 *          latency. The network's own commands are not held, and release the data held before them.
+		 *          May be called while the network is running.
+		 *
+		 * @since 1.1.0
+		 */
+		void cork(std::size_t octets, std::chrono::microseconds delay) {
+			m_cork_delay = std::max(delay, std::chrono::microseconds(1)).count();
+			m_cork_octets = std::max<std::size_t>(octets, 1);
+		}
+
+		/**
+		 * @brief Disables corking, and writes the data being held.
+		 *
+		 * @since 1.1.0
+		 */
+		void uncork() {
+			m_cork_octets = 0;
+			flush();
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		bool corked() const {
+			return m_cork_octets != 0;
+		}
+
+		/**
+		 * @brief Writes the data held by corking right away (typically at the end of a tick).
+		 *
+		 * @since 1.1.0
+		 */
+		void flush();
+
+		/**
+		 * @brief Sets the options of the peers' sockets (see breep::socket_options::low_latency() and
+		 *        breep::socket_options::bulk_throughput()).
+		 * @details Applied to every accepted or connected socket, as well as to the sockets of the peers already
+		 *          connected. May be called while the network is running. Buffer sizes set once a connection is
+		 *          established may not raise its TCP window scaling.
+		 *
+		 * @since 1.1.0
+		 */
+		void socket_options(const breep::socket_options& options);
+
+		/**
+		 * @since 1.1.0
+		 */
+		breep::socket_options socket_options() const {
+			std::lock_guard<std::mutex> lock(m_socket_options_mutex);
+			return m_socket_options;
+		}
+
+		/**
+		 * @return counters about the data sent by this io_manager.
+		 *
+		 * @since 1.1.0
+		 */
+		const io_statistics& statistics() const {
+			return m_statistics;
+		}
+
+		/**
+		 * @brief Compresses the payload of the frames of at least \em threshold octets with \em c (see breep::lz_codec).
+		 * @details The codec is advertised during the handshake: frames are only compressed with the peers that
+		 *          use a codec with the same id, and that connect afterwards. Payloads that compression does not
+		 *          make smaller are sent as they are. A nullptr codec disables compression.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void compression(std::shared_ptr<const codec> c, std::size_t threshold = 512) {
+			m_compression.configure(std::move(c), threshold);
+			if (m_owner != nullptr) {
+				make_id_packet();
+			}
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		const std::shared_ptr<const codec>& compression() const {
+			return m_compression.codec();
+		}
+
+		/**
+		 * @return counters about the compression of the frames exchanged with \em p.
+		 *
+		 * @since 1.1.0
+		 */
+		breep::compression_statistics compression_statistics(const peer& p) const {
+			return p.io_data ? p.io_data->compression.snapshot() : breep::compression_statistics();
+		}
+
 	private:
 
+		/**
+		 * An independent event loop, with its own acceptor (see shard_count(unsigned int)).
+		 */
+		struct shard {
+			explicit shard(unsigned short port)
+					: io_service()
+					, acceptor(make_acceptor(io_service, port, true))
+					, socket(std::make_shared<socket_type>(io_service))
+			{}
+
+			boost::asio::io_service io_service;
+			acceptor_type acceptor;
+			std::shared_ptr<socket_type> socket;
+		};
+
+		static acceptor_type make_acceptor(boost::asio::io_service& io_service, unsigned short port, bool reuse_port);
+
 		void port(unsigned short port) final {
 			make_id_packet();
 
-			m_acceptor.close();
-			m_acceptor = {m_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), port)};
-			m_acceptor.async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
+			transport::close(m_acceptor);
+			m_acceptor = make_acceptor(m_io_service, port, !m_shards.empty());
+			m_acceptor.async_accept(*m_socket, m_accept_strand.wrap(boost::bind(&io_manager::accept, this, _1)));
+
+			for (std::unique_ptr<shard>& s : m_shards) {
+				transport::close(s->acceptor);
+				s->acceptor = make_acceptor(s->io_service, port, true);
+				s->acceptor.async_accept(*s->socket, boost::bind(&io_manager::shard_accept, this, s.get(), _1));
+			}
 
 			if (m_acceptor_v4 != nullptr) {
-				m_acceptor_v4->close();
-				*m_acceptor_v4 = {m_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)};
-				m_acceptor_v4->async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
+				transport::close(*m_acceptor_v4);
+				*m_acceptor_v4 = transport::make_v4_acceptor(m_io_service, m_acceptor);
+				m_acceptor_v4->async_accept(*m_socket, m_accept_strand.wrap(boost::bind(&io_manager::accept, this, _1)));
+			}
+		}
+
+		/**
+		 * Keep-alive or timeout check of a peer, scheduled in m_timers.
+		 */
+		struct peer_timer {
+			enum class kind { keep_alive, timeout };
+
+			kind type;
+			detail::peer_handle handle;
+			std::weak_ptr<io_data_type> io_data;
+		};
+
+		// resolution of m_timers: deadlines are checked at this interval.
+		static constexpr unsigned long timers_resolution_millis = std::min(keep_alive_send_millis, timeout_check_interval_millis);
+		// octets of a big frame's payload read (and allocated) at once: the buffer grows as the payload arrives.
+		static constexpr std::size_t payload_read_step = 1024 * 1024;
+
+		void schedule_timer(peer_timer&& timer, std::chrono::steady_clock::time_point deadline) {
+			std::lock_guard<std::mutex> lock(m_timers_mutex);
+			m_timers.schedule(deadline, std::move(timer));
+		}
+
+		// advances m_timers, processing the peers whose deadline expired.
+		void timers_tick(boost::system::error_code ec);
+
+		void timer_expired(peer_timer&& timer, std::chrono::steady_clock::time_point now);
+
+		// sets the kernel keep-alive options on \em socket (see kernel_keep_alive()).
+		void apply_kernel_keep_alive(socket_type& socket) const;
+
+		// sets \em options on \em socket. Options left to 0 are only set if \em previous had set them.
+		static void apply_socket_options(socket_type& socket, const breep::socket_options& options,
+		                                 const breep::socket_options& previous = breep::socket_options());
+
+		void owner(basic_peer_manager<io_manager>* owner) override;
+
+		void process_read(detail::peer_handle handle, boost::system::error_code error, std::size_t read);
+
+		// completion of a step of the payload of a big frame, read straight into io_data->dynamic_buffer.
+		void process_payload_read(detail::peer_handle handle, boost::system::error_code error);
+
+		void process_read_error(peer& sender);
+
+		// hands a received frame to the owner, decompressing it first if needed. false if it is malformed.
+		bool dispatch(peer& sender, commands command, const detail::unowning_linear_container& frame);
+
+		// (re)arms the reading of \em sender's socket into its fixed buffer, after \em offset octets.
+		void read_some(peer& sender, std::size_t offset = 0) {
+			io_data_type& io_data = *sender.io_data;
+#ifdef TCP_QUICKACK
+			// TCP_QUICKACK is not permanent: the kernel may go back to delayed ACKs after a while.
+			if (m_quick_ack.load(std::memory_order_relaxed)) {
+				boost::system::error_code ec;
+				io_data.socket.set_option(boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>(true), ec);
 			}
+#endif
+			io_data.socket.async_read_some(
+					boost::asio::buffer(io_data.fixed_buffer.data() + offset, io_data.fixed_buffer.size() - offset),
+					io_data.strand.wrap(boost::bind(&io_manager::process_read, this, io_data.handle, _1, _2))
+			);
+		}
+
+		// reads the next step of the payload of a big frame (see payload_read_step) into its final buffer.
+		void read_payload(peer& sender) {
+			io_data_type& io_data = *sender.io_data;
+			const std::size_t received = io_data.dynamic_buffer.size();
+			const std::size_t step = std::min(io_data.frame_remaining, payload_read_step);
+			io_data.dynamic_buffer.resize(received + step);
+			boost::asio::async_read(
+					io_data.socket,
+					boost::asio::buffer(io_data.dynamic_buffer.data() + received, step),
+					io_data.strand.wrap(boost::bind(&io_manager::process_payload_read, this, io_data.handle, _1))
+			);
 		}
 
-		void keep_alive_impl() {
-			breep::logger<io_manager>.trace("Sending keep_alives");
-			for (const auto& peers_pair : m_owner->peers()) {
-				send(commands::keep_alive, constant::unused_param, peers_pair.second);
+		void write(const peer& target) const;
+
+		void write_done(detail::peer_handle handle) const;
+
+		// writes the frames held for \em target, if it is not being written to already.
+		void flush(const peer& target) const {
+			if (target.io_data->queue.writing.empty() && target.io_data->queue.waiting()) {
+				write(target);
 			}
-			m_keepalive_dlt.expires_from_now(boost::posix_time::millisec(keep_alive_send_millis));
-			m_keepalive_dlt.async_wait(boost::bind(&io_manager::keep_alive_impl, this));
 		}
 
-		void timeout_impl() {
-			std::chrono::milliseconds time_now =  std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-			for (const auto& peers_pair : m_owner->peers()) {
-				if (time_now - peers_pair.second.io_data->timestamp > std::chrono::milliseconds(timeout_millis)) {
-					breep::logger<io_manager>.trace(peers_pair.second.id_as_string() + " timed out");
-					peers_pair.second.io_data->socket.close();
-				}
+		void cork_expired(detail::peer_handle handle, boost::system::error_code ec) const;
+
+		// gives the payload of a frame that won't be written anymore back to the pool
+		// (shared payloads give themselves back once their last frame drops them, see share_buffer()).
+		void recycle(output_frame& frame) const {
+			if (frame.shared_payload) {
+				frame.shared_payload.reset();
+			} else {
+				m_buffer_pool.release(std::move(frame.payload));
 			}
-			m_timeout_dlt.expires_from_now(boost::posix_time::millisec(timeout_check_interval_millis));
-			m_timeout_dlt.async_wait(boost::bind(&io_manager::timeout_impl, this));
 		}
 
-		void owner(basic_peer_manager<io_manager>* owner) override;
+		// applies the send queue limits, then queues the frame from the peer's strand, in the lane of \em priority
+		// for user data, and in the control lane otherwise.
+		void queue_frame(output_frame&& frame, const peer& target, send_priority priority) const;
 
-		void process_read(peer& sender, boost::system::error_code error, std::size_t read);
+		// true if queuing \em octets more to \em io_data would take it over its high watermarks.
+		bool queue_full(const io_data_type& io_data, std::size_t octets) const {
+			const std::size_t queued_octets = io_data.queued_octets;
+			return (m_queue_limits.high_watermark_octets != 0 && queued_octets != 0 && queued_octets + octets > m_queue_limits.high_watermark_octets)
+			       || (m_queue_limits.high_watermark_messages != 0 && io_data.queued_frames + 1 > m_queue_limits.high_watermark_messages);
+		}
 
-		void write(const peer& target) const;
+		bool queue_above_high_watermark(const io_data_type& io_data) const {
+			return (m_queue_limits.high_watermark_octets != 0 && io_data.queued_octets >= m_queue_limits.high_watermark_octets)
+			       || (m_queue_limits.high_watermark_messages != 0 && io_data.queued_frames >= m_queue_limits.high_watermark_messages);
+		}
+
+		bool queue_below_low_watermark(const io_data_type& io_data) const {
+			return (m_queue_limits.high_watermark_octets == 0 || io_data.queued_octets <= m_queue_limits.low_watermark_octets)
+			       && (m_queue_limits.high_watermark_messages == 0 || io_data.queued_frames <= m_queue_limits.low_watermark_messages);
+		}
+
+		// to be called once frames were removed from the queue of \em target.
+		void queue_drained(const peer& target) const;
+
+		// drops user data from the lowest lanes first, except the frame that was just queued in \em newest_lane.
+		void drop_oldest_frames(const peer& target, output_queue& queue, std::size_t newest_lane) const;
 
-		void write_done(const peer& target) const;
+		// true if the calling thread is running one of the io_services.
+		bool in_network_thread() const;
 
 		void accept(boost::system::error_code ec);
 
+		void shard_accept(shard* s, boost::system::error_code ec);
+
+		/**
+		 * State of an incoming connection while its handshake is running.
+		 */
+		struct handshake_data {
+			handshake_data(std::shared_ptr<socket_type>&& socket_, boost::asio::io_service& io_service_, const std::string& id_packet_)
+					: socket(std::move(socket_))
+					, io_service(io_service_)
+					, strand(io_service_)
+					, deadline(io_service_)
+					, buffer{}
+					, length{}
+					, protocol_id()
+					, id_packet(id_packet_)
+			{
+				protocol_id.reserve(8);
+				detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_1);
+				detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_2);
+			}
+
+			std::shared_ptr<socket_type> socket;
+			boost::asio::io_service& io_service;
+			// serializes the handshake steps and the deadline
+			boost::asio::io_service::strand strand;
+			boost::asio::steady_timer deadline;
+			std::array<uint8_t, 128> buffer;
+			std::size_t length;
+			std::vector<uint8_t> protocol_id;
+			const std::string id_packet;
+		};
+
+		using handshake_ptr = std::shared_ptr<handshake_data>;
+
+		void handshake(std::shared_ptr<socket_type>&& socket, boost::asio::io_service& io_service);
+
+		void handshake_protocol_read(handshake_ptr hs, boost::system::error_code ec, std::size_t read);
+
+		void handshake_protocol_written(handshake_ptr hs, boost::system::error_code ec);
+
+		void handshake_id_read(handshake_ptr hs, boost::system::error_code ec, std::size_t read);
+
+		void handshake_id_written(handshake_ptr hs, boost::system::error_code ec);
+
+		void handshake_expired(handshake_ptr hs, boost::system::error_code ec);
+
+		void handshake_abort(handshake_ptr hs);
+
+		/**
+		 * State of an outgoing connection started by async_connect.
+		 */
+		struct connection_data {
+			enum class step { connect, send_protocol_id, check_protocol_id, send_id, read_id_size, read_id, read_answer, done };
+
+			connection_data(boost::asio::io_service& io_service_, const boost::asio::ip::address& address_, unsigned short port_,
+			                const std::string& id_packet_, std::function<void(detail::optional<peer>&&)>&& handler_)
+					: socket(io_service_)
+					, io_service(io_service_)
+					, strand(io_service_)
+					, deadline(io_service_)
+					, address(address_)
+					, port(port_)
+					, current_step(step::connect)
+					, buffer{}
+					, answer{}
+					, protocol_id()
+					, id_packet(id_packet_)
+					, handler(std::move(handler_))
+			{
+				protocol_id.reserve(8);
+				detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_1);
+				detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_2);
+			}
+
+			socket_type socket;
+			boost::asio::io_service& io_service;
+			// serializes the connection steps and the deadline
+			boost::asio::io_service::strand strand;
+			boost::asio::steady_timer deadline;
+			const boost::asio::ip::address address;
+			const unsigned short port;
+			step current_step;
+			std::array<uint8_t, 128> buffer;
+			std::underlying_type_t<commands> answer;
+			std::vector<uint8_t> protocol_id;
+			const std::string id_packet;
+			std::function<void(detail::optional<peer>&&)> handler;
+		};
+
+		using connection_ptr = std::shared_ptr<connection_data>;
+
+		void connection_step(connection_ptr co, boost::system::error_code ec);
+
+		void connection_expired(connection_ptr co, boost::system::error_code ec);
+
+		void connection_failed(connection_ptr co);
+
+		/**
+		 * @return the io_service a newly connected peer should be pinned to (round robin over the shards).
+		 */
+		boost::asio::io_service& next_io_service() {
+			std::size_t idx = m_next_shard++ % (m_shards.size() + 1);
+			return idx == 0 ? m_io_service : m_shards[idx - 1]->io_service;
+		}
+
 		void make_id_packet() {
 			m_id_packet.clear();
 			m_id_packet.resize(3, 0);
 			detail::make_little_endian(detail::unowning_linear_container(m_owner->self().id().data), m_id_packet);
+			m_id_packet.push_back(static_cast<char>(m_compression.codec_id()));
 
 			m_id_packet[0] = static_cast<uint8_t>(m_id_packet.size() - 1);
 			m_id_packet[1] = static_cast<uint8_t>(m_owner->port() >> 8) & std::numeric_limits<uint8_t>::max();
@@ -186,16 +942,58 @@ namespace breep { namespace tcp {
 
 		basic_peer_manager<io_manager>* m_owner;
 		mutable boost::asio::io_service m_io_service;
-		boost::asio::ip::tcp::acceptor m_acceptor;
-		boost::asio::ip::tcp::acceptor* m_acceptor_v4;
-		std::shared_ptr<boost::asio::ip::tcp::socket> m_socket;
+		acceptor_type m_acceptor;
+		acceptor_type* m_acceptor_v4;
+		std::shared_ptr<socket_type> m_socket;
+		boost::asio::io_service::strand m_accept_strand;
 
 		std::string m_id_packet;
 
-		boost::asio::deadline_timer m_timeout_dlt;
-		boost::asio::deadline_timer m_keepalive_dlt;
+		// keep-alive and timeout deadlines of the peers, advanced by m_timers_tick.
+		detail::timing_wheel<peer_timer> m_timers;
+		std::mutex m_timers_mutex;
+		boost::asio::steady_timer m_timers_tick;
+		// reused by timers_tick
+		std::vector<peer_timer> m_expired_timers;
+
+		// kernel keep-alive settings, disabled when m_kernel_keep_alive_idle is zero.
+		std::chrono::seconds m_kernel_keep_alive_idle;
+		std::chrono::seconds m_kernel_keep_alive_interval;
+		unsigned int m_kernel_keep_alive_probes;
+
+		// corking thresholds, disabled when m_cork_octets is 0.
+		std::atomic<std::size_t> m_cork_octets;
+		std::atomic<std::chrono::microseconds::rep> m_cork_delay;
+
+		breep::socket_options m_socket_options;
+		mutable std::mutex m_socket_options_mutex;
+		// copy of m_socket_options.quick_ack, read before each read
+		std::atomic<bool> m_quick_ack;
+
+		std::size_t m_max_write_frames;
+		std::size_t m_max_write_size;
+		// frames announced as bigger than this are refused
+		std::size_t m_max_frame_size;
+		mutable io_statistics m_statistics;
+
+		unsigned int m_thread_count;
+
+		std::vector<std::unique_ptr<shard>> m_shards;
+		std::atomic<std::size_t> m_next_shard;
+
+		std::chrono::milliseconds m_handshake_timeout;
+
+		breep::send_queue_limits m_queue_limits;
+		std::function<void(const peer&)> m_high_watermark_listener;
+		std::function<void(const peer&)> m_low_watermark_listener;
+
+		// buffers of the frames that were sent, reused for the next ones.
+		mutable detail::buffer_pool m_buffer_pool;
+
+		detail::frame_compressor m_compression;
 
-		mutable std::unordered_map<boost::uuids::uuid, std::queue<std::vector<uint8_t>>, boost::hash<boost::uuids::uuid>> m_data_queues;
+		// copies of the connected peers, referred to by the handlers of their asynchronous operations.
+		detail::peer_table<peer> m_peer_table;
 	};
 }} // namespace breep::tcp
 
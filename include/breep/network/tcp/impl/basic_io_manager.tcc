@@ -12,17 +12,20 @@
 #include "breep/network/tcp/basic_io_manager.hpp" // allows my IDE to work
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <limits>
 #include <array>
 #include <memory>
 #include <string>
 #include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <thread>
+#include <mutex>
 #include <boost/asio.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/array.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "breep/network/detail/utils.hpp"
 #include "breep/network/basic_peer_manager.hpp"
@@ -37,128 +40,251 @@
  */
 
 
-template <unsigned int BUFFER_LENGTH, unsigned long keep_alive_millis, unsigned long U, unsigned long timeout_chk_interval>
-breep::tcp::basic_io_manager<BUFFER_LENGTH,keep_alive_millis,U,timeout_chk_interval>::basic_io_manager(unsigned short port)
+template <unsigned int BUFFER_LENGTH, unsigned long U, unsigned long V, unsigned long W, typename X>
+breep::tcp::basic_io_manager<BUFFER_LENGTH,U,V,W,X>::basic_io_manager(unsigned short port)
 		: m_owner(nullptr)
 		, m_io_service{}
-		, m_acceptor(m_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), port))
+		, m_acceptor(make_acceptor(m_io_service, port, false))
 		, m_acceptor_v4(nullptr)
-		, m_socket{std::make_shared<boost::asio::ip::tcp::socket>(m_io_service)}
+		, m_socket{std::make_shared<socket_type>(m_io_service)}
+		, m_accept_strand(m_io_service)
 		, m_id_packet()
-		, m_timeout_dlt(m_io_service, boost::posix_time::millisec(timeout_chk_interval))
-		, m_keepalive_dlt(m_io_service, boost::posix_time::millisec(keep_alive_millis))
-		, m_data_queues()
+		, m_timers(std::chrono::milliseconds(timers_resolution_millis))
+		, m_timers_mutex()
+		, m_timers_tick(m_io_service)
+		, m_expired_timers()
+		, m_kernel_keep_alive_idle(0)
+		, m_kernel_keep_alive_interval(0)
+		, m_kernel_keep_alive_probes(0)
+		, m_cork_octets(0)
+		, m_cork_delay(0)
+		, m_socket_options()
+		, m_socket_options_mutex()
+		, m_quick_ack(false)
+		, m_max_write_frames(32)
+		, m_max_write_size(256 * 1024)
+		, m_max_frame_size(detail::default_max_frame_size)
+		, m_statistics()
+		, m_thread_count(1)
+		, m_shards()
+		, m_next_shard(0)
+		, m_handshake_timeout(5000)
+		, m_queue_limits()
+		, m_high_watermark_listener()
+		, m_low_watermark_listener()
+		, m_buffer_pool()
+		, m_compression()
+		, m_peer_table()
 {
-	static_assert(BUFFER_LENGTH > std::numeric_limits<uint8_t>::max(), "The buffer size is too small");
+	static_assert(BUFFER_LENGTH >= output_frame::max_header_size, "The buffer size is too small");
 
-	m_timeout_dlt.async_wait(boost::bind(&io_manager::timeout_impl, this));
-	m_keepalive_dlt.async_wait(boost::bind(&io_manager::keep_alive_impl,this));
+	m_timers_tick.expires_after(std::chrono::milliseconds(timers_resolution_millis));
+	m_timers_tick.async_wait(boost::bind(&io_manager::timers_tick, this, _1));
 
-	boost::system::error_code ec;
-	m_acceptor.set_option(boost::asio::ip::v6_only(false), ec);
-	if (ec) {
+	if (!X::dual_stack(m_acceptor)) {
 		breep::logger<io_manager>.debug("IP dual stack is unsupported on your system. Adding ipv4 listener.");
 	}
 
 }
 
 
-template <unsigned int BUFFER_LENGTH, unsigned long keep_alive_millis, unsigned long U, unsigned long timeout_chk_interval>
-breep::tcp::basic_io_manager<BUFFER_LENGTH,keep_alive_millis,U,timeout_chk_interval>::basic_io_manager(io_manager&& other) noexcept
+template <unsigned int BUFFER_LENGTH, unsigned long U, unsigned long V, unsigned long W, typename X>
+breep::tcp::basic_io_manager<BUFFER_LENGTH,U,V,W,X>::basic_io_manager(io_manager&& other) noexcept
 		: m_owner(other.m_owner)
 		, m_io_service()
-		, m_acceptor(std::move(other.m_acceptor))
+		, m_acceptor(m_io_service)
 		, m_acceptor_v4(nullptr)
-		, m_socket(std::make_shared<boost::asio::ip::tcp::socket>(m_io_service))
+		, m_socket(std::make_shared<socket_type>(m_io_service))
+		, m_accept_strand(m_io_service)
 		, m_id_packet(std::move(other.m_id_packet))
-		, m_timeout_dlt(m_io_service, boost::posix_time::millisec(timeout_chk_interval))
-		, m_keepalive_dlt(m_io_service, boost::posix_time::millisec(keep_alive_millis))
-		, m_data_queues(std::move(other.m_data_queues))
+		, m_timers(std::chrono::milliseconds(timers_resolution_millis))
+		, m_timers_mutex()
+		, m_timers_tick(m_io_service)
+		, m_expired_timers()
+		, m_kernel_keep_alive_idle(other.m_kernel_keep_alive_idle)
+		, m_kernel_keep_alive_interval(other.m_kernel_keep_alive_interval)
+		, m_kernel_keep_alive_probes(other.m_kernel_keep_alive_probes)
+		, m_cork_octets(other.m_cork_octets.load())
+		, m_cork_delay(other.m_cork_delay.load())
+		, m_socket_options(other.socket_options())
+		, m_socket_options_mutex()
+		, m_quick_ack(m_socket_options.quick_ack)
+		, m_max_write_frames(other.m_max_write_frames)
+		, m_max_write_size(other.m_max_write_size)
+		, m_max_frame_size(other.m_max_frame_size)
+		, m_statistics()
+		, m_thread_count(other.m_thread_count)
+		, m_shards()
+		, m_next_shard(0)
+		, m_handshake_timeout(other.m_handshake_timeout)
+		, m_queue_limits(other.m_queue_limits)
+		, m_high_watermark_listener(std::move(other.m_high_watermark_listener))
+		, m_low_watermark_listener(std::move(other.m_low_watermark_listener))
+		, m_buffer_pool()
+		, m_compression(std::move(other.m_compression))
+		, m_peer_table()
 {
 	other.m_socket->close();
 	other.m_io_service.stop();
-	unsigned short port = m_acceptor.local_endpoint().port();
-	m_acceptor.close();
-
-	m_timeout_dlt.async_wait(boost::bind(&io_manager::timeout_impl, this));
-	m_keepalive_dlt.async_wait(boost::bind(&io_manager::keep_alive_impl,this));
+	// The listening socket is handed over to our io_service.
+	auto protocol = other.m_acceptor.local_endpoint().protocol();
+	m_acceptor.assign(protocol, other.m_acceptor.release());
 
-	m_acceptor = {m_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), port)};
+	m_timers_tick.expires_after(std::chrono::milliseconds(timers_resolution_millis));
+	m_timers_tick.async_wait(boost::bind(&io_manager::timers_tick, this, _1));
 
 	if (m_owner != nullptr) {
-		m_acceptor.async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
+		m_acceptor.async_accept(*m_socket, m_accept_strand.wrap(boost::bind(&io_manager::accept, this, _1)));
 	}
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-breep::tcp::basic_io_manager<T,U,V,W>::~basic_io_manager() {
-	m_acceptor.close();
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+breep::tcp::basic_io_manager<T,U,V,W,X>::~basic_io_manager() {
+	X::close(m_acceptor);
 	m_socket->close();
 	m_io_service.stop();
 	if (m_acceptor_v4 != nullptr) {
-		m_acceptor_v4->close();
+		X::close(*m_acceptor_v4);
 		delete m_acceptor_v4;
 	}
+	for (std::unique_ptr<shard>& s : m_shards) {
+		X::close(s->acceptor);
+		s->socket->close();
+		s->io_service.stop();
+	}
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
 template <typename data_container>
-void breep::tcp::basic_io_manager<T,U,V,W>::send(commands command, const data_container& data, const peer& target) const {
-	send(command, data.cbegin(), data.size(), target);
+void breep::tcp::basic_io_manager<T,U,V,W,X>::send(commands command, const data_container& data, const peer& target, send_priority priority) const {
+	send(command, data.cbegin(), data.size(), target, priority);
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
 template <typename data_iterator, typename size_type>
-void breep::tcp::basic_io_manager<T,U,V,W>::send(commands command, data_iterator it, size_type size, const peer& target) const {
-
-	std::vector<uint8_t> buff;
-	buff.reserve(2 + size + size / std::numeric_limits<uint8_t>::max());
-
-	buff.push_back(static_cast<uint8_t>(command));
-	size_type current_index{0};
-	while (current_index < size) {
-		if (size - current_index > std::numeric_limits<uint8_t>::max()) {
-			buff.push_back(0);
-			for (uint8_t i = std::numeric_limits<uint8_t>::max() ; i-- ; ++current_index) {
-				buff.push_back(*it++);
-			}
-		} else {
-			buff.push_back(static_cast<uint8_t>(size - current_index));
-			while (current_index++ < size) {
-				buff.push_back(*it++);
+void breep::tcp::basic_io_manager<T,U,V,W,X>::send(commands command, data_iterator it, size_type size, const peer& target, send_priority priority) const {
+
+	std::vector<uint8_t> payload = m_buffer_pool.acquire(static_cast<std::size_t>(size));
+	std::copy_n(it, size, std::back_inserter(payload));
+	m_statistics.octets_copied.fetch_add(payload.size(), std::memory_order_relaxed);
+	send(command, std::move(payload), target, priority);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::send(commands command, std::vector<uint8_t>&& data, const peer& target, send_priority priority) const {
+	m_compression.compress(target.io_data->link_codec.get(), command, data, target.io_data->compression, m_buffer_pool);
+	queue_frame(output_frame(command, std::move(data)), target, priority);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::queue_frame(output_frame&& frame, const peer& target, send_priority priority) const {
+	io_data_type& io_data = *target.io_data;
+	const commands command = frame.original_command();
+	const bool bounded = command == commands::send_to || command == commands::send_to_all;
+	// stream chunks are bounded by the stream's window instead, and are never dropped.
+	const bool user_data = bounded || command == commands::stream_chunk;
+	const auto lane = static_cast<std::size_t>(user_data ? priority : send_priority::control);
+
+	if (bounded && queue_full(io_data, frame.size())) {
+		switch (m_queue_limits.policy) {
+			case overflow_policy::block:
+				if (!in_network_thread()) {
+					std::unique_lock<std::mutex> lock(io_data.queue_mutex);
+					io_data.queue_drained.wait(lock, [this, &io_data, &frame] {
+						return io_data.disconnected || !queue_full(io_data, frame.size());
+					});
+				}
+				break;
+			case overflow_policy::drop_newest:
+				++m_statistics.frames_dropped;
+				breep::logger<io_manager>.debug("Send queue of " + target.id_as_string() + " is full: dropping data");
+				return;
+			case overflow_policy::disconnect:
+			{
+				++m_statistics.frames_dropped;
+				breep::logger<io_manager>.warning("Send queue of " + target.id_as_string() + " is full: disconnecting");
+				data_type io_ptr = target.io_data;
+				// shutting the socket down (rather than closing it) lets the read handler report the disconnection.
+				io_ptr->strand.post([io_ptr] {
+					boost::system::error_code ec;
+					io_ptr->socket.shutdown(boost::asio::socket_base::shutdown_both, ec);
+				});
+				return;
 			}
+			case overflow_policy::drop_oldest:
+				// done once the frame is queued, from the peer's strand.
+				break;
 		}
 	}
 
-	m_io_service.post(
-			[this, target, local_buffer{std::move(buff)}] () mutable {
-				try {
-					std::queue<std::vector<uint8_t>>& buffers = m_data_queues.at(target.id());
-					bool being_lazy = buffers.empty();
-					buffers.push(std::move(local_buffer));
-					if (being_lazy) {
-						write(target);
+	io_data.queued_octets += frame.size();
+	++io_data.queued_frames;
+	if (queue_above_high_watermark(io_data) && !io_data.above_high_watermark.exchange(true) && m_high_watermark_listener) {
+		m_high_watermark_listener(target);
+	}
+
+	io_data.strand.post(
+			[this, handle = io_data.handle, bounded, lane, frame{std::move(frame)}] () mutable {
+				peer* target_ptr = m_peer_table.find(handle);
+				if (target_ptr == nullptr) {
+					recycle(frame);
+					return;
+				}
+				const peer& target = *target_ptr;
+				if (target.io_data->disconnected) {
+					recycle(frame);
+					return;
+				}
+				io_data_type& io_data = *target.io_data;
+				output_queue& queue = io_data.queue;
+				const std::size_t frame_size = frame.size();
+				queue.lanes[lane].push_back(std::move(frame));
+				if (bounded && m_queue_limits.policy == overflow_policy::drop_oldest) {
+					drop_oldest_frames(target, queue, lane);
+				}
+				if (!queue.writing.empty()) {
+					// written once the current write completes
+					return;
+				}
+
+				const std::size_t cork_octets = m_cork_octets.load(std::memory_order_relaxed);
+				if (bounded && cork_octets != 0) {
+					io_data.corked_octets += frame_size;
+					if (io_data.corked_octets < cork_octets) {
+						if (!io_data.cork_timer_armed) {
+							io_data.cork_timer_armed = true;
+							io_data.cork_timer.expires_after(std::chrono::microseconds(m_cork_delay.load(std::memory_order_relaxed)));
+							io_data.cork_timer.async_wait(io_data.strand.wrap(
+									boost::bind(&io_manager::cork_expired, this, io_data.handle, _1)
+							));
+						}
+						return;
 					}
-				} catch (const std::out_of_range&) {
-					breep::logger<io_manager>.warning("Peer " + target.id_as_string() + " disconnected unexpectedly while data was being sent");
 				}
+				write(target);
 			}
 	);
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-auto breep::tcp::basic_io_manager<T,U,V,W>::connect(const boost::asio::ip::address& address, unsigned short port) -> detail::optional<peer> {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+auto breep::tcp::basic_io_manager<T,U,V,W,X>::connect(const boost::asio::ip::address& address, unsigned short port) -> detail::optional<peer> {
 	std::vector<uint8_t> io_protocol;
 	io_protocol.reserve(8);
 	detail::insert_uint32(io_protocol, IO_PROTOCOL_ID_1);
 	detail::insert_uint32(io_protocol, IO_PROTOCOL_ID_2);
 
-	boost::asio::ip::tcp::resolver resolver(m_io_service);
-	auto endpoint_iterator = resolver.resolve({address.to_string(),std::to_string(port)});
-	boost::asio::ip::tcp::socket socket(m_io_service);
+	boost::asio::io_service& io_service = next_io_service();
+	socket_type socket(io_service);
 
+	// Opening the socket beforehand, for the buffer sizes to be taken into account by the TCP handshake.
+	auto endpoint = X::endpoint(address, port);
 	boost::system::error_code ec;
-	boost::asio::connect(socket, endpoint_iterator, ec);
+	socket.open(endpoint.protocol(), ec);
+	if (ec) {
+		return {};
+	}
+	apply_socket_options(socket, socket_options());
+	socket.connect(endpoint, ec);
 	if (ec) {
 		return {};
 	}
@@ -185,23 +311,26 @@ auto breep::tcp::basic_io_manager<T,U,V,W>::connect(const boost::asio::ip::addre
 	}
 
 	boost::asio::write(socket, boost::asio::buffer(m_id_packet));
-	len = 0;
-	do {
-		len += socket.read_some(boost::asio::buffer(buffer.data() + len, buffer.size() - len), error);
-		if (error) {
-			return {};
-		}
-	} while (len <= buffer[0]);
+	// Reading exactly the id packet, as the answer may follow it right away.
+	boost::asio::read(socket, boost::asio::buffer(buffer.data(), 1), error);
+	if (error || buffer[0] < 4 || buffer[0] >= buffer.size()) {
+		return {};
+	}
+	len = boost::asio::read(socket, boost::asio::buffer(buffer.data() + 1, buffer[0]), error) + 1;
+	if (error) {
+		return {};
+	}
 
+	// [size][port][id][codec]
 	std::string input;
-	detail::unmake_little_endian(detail::unowning_linear_container(buffer.data() + 3, len - 3), input);
+	detail::unmake_little_endian(detail::unowning_linear_container(buffer.data() + 3, len - 4), input);
+	const uint8_t remote_codec = buffer[len - 1];
 
 	boost::uuids::uuid uuid;
 	std::copy(input.data(), input.data() + input.size(), uuid.data);
 
-	// TODO: can trap here
 	std::underlying_type_t<commands> command[1];
-	if (!socket.read_some(boost::asio::buffer(command, sizeof(command)), error) || error) {
+	if (!boost::asio::read(socket, boost::asio::buffer(command, sizeof(command)), error) || error) {
 		return detail::optional<peer>();
 	}
 	if (static_cast<commands>(command[0]) == commands::connection_refused) {
@@ -214,18 +343,40 @@ auto breep::tcp::basic_io_manager<T,U,V,W>::connect(const boost::asio::ip::addre
 		return {};
 	}
 
+	auto io_data = std::make_shared<io_data_type>(std::move(socket), io_service);
+	io_data->link_codec = m_compression.negotiate(remote_codec);
 	return detail::optional<peer>(peer(
 			std::move(uuid),
 			boost::asio::ip::address(address),
 			static_cast<unsigned short>(buffer[1] << 8 | buffer[2]),
-			std::make_shared<tcp::io_manager_data<T>>(std::move(socket))
+			std::move(io_data)
 	));
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::process_connected_peer(peer& connected) {
-	m_data_queues.insert(std::make_pair(connected.id(), std::queue<std::vector<uint8_t>>()));
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::async_connect(const boost::asio::ip::address& address, unsigned short port,
+                                                          std::function<void(detail::optional<peer>&&)> handler) {
+	auto co = std::make_shared<connection_data>(next_io_service(), address, port, m_id_packet, std::move(handler));
+
+	co->deadline.expires_after(m_handshake_timeout);
+	co->deadline.async_wait(co->strand.wrap(boost::bind(&io_manager::connection_expired, this, co, _1)));
+
+	// Opening the socket beforehand, for the buffer sizes to be taken into account by the TCP handshake.
+	auto endpoint = X::endpoint(address, port);
+	boost::system::error_code ec;
+	co->socket.open(endpoint.protocol(), ec);
+	if (!ec) {
+		apply_socket_options(co->socket, socket_options());
+	}
 
+	co->socket.async_connect(
+			endpoint,
+			co->strand.wrap(boost::bind(&io_manager::connection_step, this, co, _1))
+	);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::process_connected_peer(peer& connected) {
 	if (connected.io_data->waiting_acceptance_answer) {
 		std::underlying_type_t<commands> command[] = {
 				static_cast<std::underlying_type_t<commands>>(commands::connection_accepted)
@@ -233,14 +384,26 @@ void breep::tcp::basic_io_manager<T,U,V,W>::process_connected_peer(peer& connect
 		boost::asio::write(connected.io_data->socket, boost::asio::buffer(command, sizeof(command)));
 	}
 
-	connected.io_data->socket.async_read_some(
-			boost::asio::buffer(connected.io_data->fixed_buffer),
-			boost::bind(&io_manager::process_read, this, connected, _1, _2)
-	);
+	// The handlers only carry the handle of the peer, instead of a copy of it.
+	connected.io_data->handle = m_peer_table.insert(connected);
+
+	if (kernel_keep_alive()) {
+		apply_kernel_keep_alive(connected.io_data->socket);
+	} else {
+		const auto now = std::chrono::steady_clock::now();
+		connected.io_data->last_receive = now;
+		connected.io_data->last_send = now;
+		schedule_timer(peer_timer{peer_timer::kind::keep_alive, connected.io_data->handle, connected.io_data},
+		               now + std::chrono::milliseconds(U));
+		schedule_timer(peer_timer{peer_timer::kind::timeout, connected.io_data->handle, connected.io_data},
+		               now + std::chrono::milliseconds(V));
+	}
+
+	read_some(*m_peer_table.find(connected.io_data->handle));
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::process_connection_denial(basic_peer<io_manager>& peer) {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::process_connection_denial(basic_peer<io_manager>& peer) {
 
 	if (peer.io_data->waiting_acceptance_answer) {
 		std::underlying_type_t<commands> command[] = {
@@ -251,276 +414,894 @@ void breep::tcp::basic_io_manager<T,U,V,W>::process_connection_denial(basic_peer
 }
 
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::disconnect() {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::disconnect() {
 	m_io_service.stop();
+	for (std::unique_ptr<shard>& s : m_shards) {
+		s->io_service.stop();
+	}
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::disconnect(peer& p) {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::disconnect(peer& p) {
+	p.io_data->disconnected = true;
+	queue_drained(p);
 	boost::system::error_code error;
-	p.io_data->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+	p.io_data->socket.shutdown(boost::asio::socket_base::shutdown_both, error);
 	p.io_data->socket.close(error);
 	p.io_data->dynamic_buffer.clear();
 	p.io_data->dynamic_buffer.shrink_to_fit();
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::run() {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::run() {
 	m_io_service.reset();
+	for (std::unique_ptr<shard>& s : m_shards) {
+		s->io_service.reset();
+	}
 	breep::logger<io_manager>.info("The network is now online.");
+
+	std::vector<std::thread> pool;
+	pool.reserve(m_thread_count - 1 + m_shards.size());
+	for (unsigned int i{1} ; i < m_thread_count ; ++i) {
+		pool.emplace_back([this] { m_io_service.run(); });
+	}
+	for (std::unique_ptr<shard>& s : m_shards) {
+		boost::asio::io_service* io_service = &s->io_service;
+		pool.emplace_back([io_service] { io_service->run(); });
+	}
 	m_io_service.run();
+	for (std::thread& thread : pool) {
+		thread.join();
+	}
+	// Handlers that did not run will find stale handles.
+	m_peer_table.clear();
+
 	breep::logger<io_manager>.info("The network is now offline.");
 }
 
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::flush() {
+	if (m_owner == nullptr) {
+		return;
+	}
+	auto lock = detail::peer_manager_attorney<io_manager>::peers_lock(*m_owner);
+	for (const auto& peers_pair : m_owner->peers()) {
+		const data_type& io_data = peers_pair.second.io_data;
+		if (io_data) {
+			io_data->strand.post([this, handle = io_data->handle] {
+				const peer* target = m_peer_table.find(handle);
+				if (target != nullptr) {
+					flush(*target);
+				}
+			});
+		}
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::socket_options(const breep::socket_options& options) {
+	breep::socket_options previous;
+	{
+		std::lock_guard<std::mutex> lock(m_socket_options_mutex);
+		previous = m_socket_options;
+		m_socket_options = options;
+	}
+	m_quick_ack = options.quick_ack;
+
+	if (m_owner == nullptr) {
+		return;
+	}
+	auto lock = detail::peer_manager_attorney<io_manager>::peers_lock(*m_owner);
+	for (const auto& peers_pair : m_owner->peers()) {
+		data_type io_data = peers_pair.second.io_data;
+		if (io_data) {
+			io_data->strand.post([io_data, options, previous] {
+				apply_socket_options(io_data->socket, options, previous);
+			});
+		}
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::shard_count(unsigned int count) {
+	if (m_owner != nullptr && m_owner->is_running()) {
+		throw invalid_state("Tried to change the number of shards of a running network.");
+	}
+	count = std::max(count, 1u);
+	if (count == shard_count()) {
+		return;
+	}
+
+	unsigned short port = X::port(m_acceptor);
+	for (std::unique_ptr<shard>& s : m_shards) {
+		X::close(s->acceptor);
+		s->socket->close();
+	}
+	m_shards.clear();
+
+	// Every acceptor bound to the port, including the first one, has to be opened with SO_REUSEPORT.
+	X::close(m_acceptor);
+	m_acceptor = make_acceptor(m_io_service, port, count > 1);
+	if (m_owner != nullptr) {
+		m_acceptor.async_accept(*m_socket, m_accept_strand.wrap(boost::bind(&io_manager::accept, this, _1)));
+	}
+
+	m_shards.reserve(count - 1);
+	while (m_shards.size() + 1 < count) {
+		m_shards.push_back(std::make_unique<shard>(port));
+		if (m_owner != nullptr) {
+			shard* s = m_shards.back().get();
+			s->acceptor.async_accept(*s->socket, boost::bind(&io_manager::shard_accept, this, s, _1));
+		}
+	}
+}
+
 /* PRIVATE */
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::owner(basic_peer_manager<io_manager>* owner) {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::timers_tick(boost::system::error_code ec) {
+	if (ec == boost::asio::error::operation_aborted) {
+		return;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(m_timers_mutex);
+		m_timers.advance(now, [this](peer_timer&& timer) {
+			m_expired_timers.push_back(std::move(timer));
+		});
+	}
+	// Expired timers are processed without the lock, as they may be scheduled again.
+	for (peer_timer& timer : m_expired_timers) {
+		timer_expired(std::move(timer), now);
+	}
+	m_expired_timers.clear();
+
+	m_timers_tick.expires_at(m_timers_tick.expiry() + std::chrono::milliseconds(timers_resolution_millis));
+	m_timers_tick.async_wait(boost::bind(&io_manager::timers_tick, this, _1));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::timer_expired(peer_timer&& timer, std::chrono::steady_clock::time_point now) {
+	data_type io_data = timer.io_data.lock();
+	if (!io_data || io_data->disconnected) {
+		// The peer is gone: its timers are not scheduled again.
+		return;
+	}
+
+	switch (timer.type) {
+		case peer_timer::kind::keep_alive:
+		{
+			// Any frame sent to the peer does the job of a keep_alive.
+			const auto next_keep_alive = io_data->last_send.load(std::memory_order_relaxed) + std::chrono::milliseconds(U);
+			if (next_keep_alive > now || io_data->queued_frames != 0) {
+				m_statistics.keep_alives_suppressed.fetch_add(1, std::memory_order_relaxed);
+				schedule_timer(std::move(timer), std::max(next_keep_alive, now + std::chrono::milliseconds(1)));
+				break;
+			}
+			m_statistics.keep_alives_sent.fetch_add(1, std::memory_order_relaxed);
+			io_data->strand.post([this, handle = timer.handle] {
+				peer* target = m_peer_table.find(handle);
+				if (target != nullptr) {
+					send(commands::keep_alive, constant::unused_param, *target);
+				}
+			});
+			schedule_timer(std::move(timer), now + std::chrono::milliseconds(U));
+			break;
+		}
+
+		case peer_timer::kind::timeout:
+		{
+			const auto deadline = io_data->last_receive.load(std::memory_order_relaxed) + std::chrono::milliseconds(V);
+			if (deadline > now) {
+				schedule_timer(std::move(timer), deadline);
+				break;
+			}
+			// shutting the socket down (rather than closing it) lets the read handler report the disconnection.
+			io_data->strand.post([this, io_data, handle = timer.handle] {
+				const peer* target = m_peer_table.find(handle);
+				if (target != nullptr) {
+					breep::logger<io_manager>.trace(target->id_as_string() + " timed out");
+				}
+				boost::system::error_code shutdown_ec;
+				io_data->socket.shutdown(boost::asio::socket_base::shutdown_both, shutdown_ec);
+			});
+			break;
+		}
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::apply_socket_options(socket_type& socket, const breep::socket_options& options,
+                                                                 const breep::socket_options& previous) {
+	using boost::asio::detail::socket_option::boolean;
+	using boost::asio::detail::socket_option::integer;
+
+	if (!X::tcp_options) {
+		return;
+	}
+
+	boost::system::error_code ec;
+	auto check = [&ec](const char* option) {
+		if (ec) {
+			breep::logger<io_manager>.debug(std::string("Failed to set ") + option + ": " + ec.message());
+			ec.clear();
+		}
+	};
+
+	// Options equal to 0 keep the system's default, unless the previous profile had set them: they are then reset.
+	if (options.no_delay || previous.no_delay) {
+		socket.set_option(boost::asio::ip::tcp::no_delay(options.no_delay), ec);
+		check("TCP_NODELAY");
+	}
+	if (options.send_buffer_size > 0) {
+		socket.set_option(boost::asio::socket_base::send_buffer_size(options.send_buffer_size), ec);
+		check("SO_SNDBUF");
+	}
+	if (options.receive_buffer_size > 0) {
+		socket.set_option(boost::asio::socket_base::receive_buffer_size(options.receive_buffer_size), ec);
+		check("SO_RCVBUF");
+	}
+#ifdef TCP_QUICKACK
+	if (options.quick_ack || previous.quick_ack) {
+		socket.set_option(boolean<IPPROTO_TCP, TCP_QUICKACK>(options.quick_ack), ec);
+		check("TCP_QUICKACK");
+	}
+#endif
+#ifdef TCP_USER_TIMEOUT
+	if (options.user_timeout.count() != 0 || previous.user_timeout.count() != 0) {
+		socket.set_option(integer<IPPROTO_TCP, TCP_USER_TIMEOUT>(static_cast<int>(options.user_timeout.count())), ec);
+		check("TCP_USER_TIMEOUT");
+	}
+#endif
+#ifdef SO_BUSY_POLL
+	if (options.busy_poll.count() != 0 || previous.busy_poll.count() != 0) {
+		socket.set_option(integer<SOL_SOCKET, SO_BUSY_POLL>(static_cast<int>(options.busy_poll.count())), ec);
+		check("SO_BUSY_POLL");
+	}
+#endif
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::apply_kernel_keep_alive(socket_type& socket) const {
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+	if (!X::tcp_options) {
+		return;
+	}
+	boost::system::error_code ec;
+	socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
+	if (!ec) {
+		socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPIDLE>(static_cast<int>(m_kernel_keep_alive_idle.count())), ec);
+	}
+	if (!ec) {
+		socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPINTVL>(static_cast<int>(m_kernel_keep_alive_interval.count())), ec);
+	}
+	if (!ec) {
+		socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPCNT>(static_cast<int>(m_kernel_keep_alive_probes)), ec);
+	}
+	if (ec) {
+		breep::logger<io_manager>.warning("Failed to set the kernel keep-alive options: " + ec.message());
+	}
+#else
+	static_cast<void>(socket);
+#endif
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+auto breep::tcp::basic_io_manager<T,U,V,W,X>::make_acceptor(boost::asio::io_service& io_service, unsigned short port, bool reuse_port) -> acceptor_type {
+	acceptor_type acceptor = X::make_acceptor(io_service, port, reuse_port);
+	if (reuse_port && !X::dual_stack(acceptor)) {
+		breep::logger<io_manager>.warning("IP dual stack is unsupported on your system: shards only listen to ipv6.");
+	}
+	return acceptor;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::owner(basic_peer_manager<io_manager>* owner) {
 	if (m_owner == nullptr) {
 		m_owner = owner;
 
 		make_id_packet();
 
-		m_acceptor.async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
-		boost::asio::ip::v6_only v6_only;
-		m_acceptor.get_option(v6_only);
-
-		if (v6_only) {
+		m_acceptor.async_accept(*m_socket, m_accept_strand.wrap(boost::bind(&io_manager::accept, this, _1)));
+		if (!X::dual_stack(m_acceptor)) {
 			if (m_acceptor_v4 != nullptr) {
 				delete m_acceptor_v4;
 			}
-			m_acceptor_v4 = new boost::asio::ip::tcp::acceptor(m_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), m_acceptor.local_endpoint().port()));
-			m_acceptor_v4->async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
+			m_acceptor_v4 = new acceptor_type(X::make_v4_acceptor(m_io_service, m_acceptor));
+			m_acceptor_v4->async_accept(*m_socket, m_accept_strand.wrap(boost::bind(&io_manager::accept, this, _1)));
+		}
+
+		for (std::unique_ptr<shard>& s : m_shards) {
+			s->acceptor.async_accept(*s->socket, boost::bind(&io_manager::shard_accept, this, s.get(), _1));
 		}
 	} else {
 		throw invalid_state("Tried to set an already set owner. This object shouldn't be shared.");
 	}
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::process_read(peer& sender, boost::system::error_code error, std::size_t read) {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::process_read(detail::peer_handle handle, boost::system::error_code error, std::size_t read) {
+	peer* sender_ptr = m_peer_table.find(handle);
+	if (sender_ptr == nullptr) {
+		return;
+	}
+	peer& sender = *sender_ptr;
 
-	if (!error) {
-		sender.io_data->timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-		std::vector<uint8_t>& dyn_buff = sender.io_data->dynamic_buffer;
-		std::array<uint8_t, T>& fixed_buff = sender.io_data->fixed_buffer;
+	if (error) {
+		process_read_error(sender);
+		return;
+	}
 
-		read += sender.io_data->last_read;
+	sender.io_data->last_receive.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+	std::vector<uint8_t>& dyn_buff = sender.io_data->dynamic_buffer;
+	std::array<uint8_t, T>& fixed_buff = sender.io_data->fixed_buffer;
+
+	read += sender.io_data->last_read;
+	sender.io_data->last_read = 0;
+
+	std::size_t current_index{0};
+	while (current_index < read) {
 
-		typename std::array<uint8_t, T>::size_type current_index{0};
 		if (sender.io_data->last_command == commands::null_command) {
-			sender.io_data->last_command = static_cast<commands>(fixed_buff[current_index++]);
-			if (read == 1) {
-				sender.io_data->socket.async_read_some(
-						boost::asio::buffer(fixed_buff.data(), fixed_buff.size()),
-						boost::bind(&io_manager::process_read, this, sender, _1, _2)
-				);
+			// Reading the frame header
+			uint64_t frame_size;
+			std::size_t varint_size = detail::read_varint(fixed_buff.data() + current_index + 1, read - current_index - 1, frame_size);
+
+			if (varint_size > detail::max_varint_size) {
+				breep::logger<io_manager>.warning("Received a malformed frame from " + sender.id_as_string() + ". Disconnecting.");
+				process_read_error(sender);
 				return;
 			}
-		}
 
-		uint8_t to_be_read;
-		bool has_work = true;
-
-		// Reads part of the packet
-		auto process_partial_read = [&] {
-			--current_index;
-
-			if (current_index == 1) {
-				sender.io_data->last_command = commands::null_command;
-				sender.io_data->last_read = read;
-				sender.io_data->socket.async_read_some(
-						boost::asio::buffer(fixed_buff.data() + read, fixed_buff.size() - read),
-						boost::bind(&io_manager::process_read, this, sender, _1, _2)
-				);
-			} else {
-				// shifting the buffer so we can use the end of it to store the up coming bits
-				uint8_t count{0};
-				while (read > current_index) {
-					fixed_buff[count++] = fixed_buff[current_index++];
-				}
+			if (varint_size == 0) {
+				// Incomplete header: moving it at the beginning of the buffer and waiting for the rest.
+				std::size_t count = read - current_index;
+				std::memmove(fixed_buff.data(), fixed_buff.data() + current_index, count);
 				sender.io_data->last_read = count;
+				read_some(sender, count);
+				return;
+			}
 
-				sender.io_data->socket.async_read_some(
-						boost::asio::buffer(fixed_buff.data() + count, fixed_buff.size() - count),
-						boost::bind(&io_manager::process_read, this, sender, _1, _2)
-				);
+			if (frame_size > m_max_frame_size) {
+				breep::logger<io_manager>.warning("Received a frame of " + std::to_string(frame_size) + " octets from " + sender.id_as_string()
+				                                  + " (maximum: " + std::to_string(m_max_frame_size) + "). Disconnecting.");
+				process_read_error(sender);
+				return;
 			}
-			has_work = false;
-		};
 
-		// Reads all the packet
-		auto process_read_all = [&] {
-			while (to_be_read--) {
-				dyn_buff.push_back(fixed_buff[current_index++]);
+			commands command = static_cast<commands>(fixed_buff[current_index]);
+			current_index += 1 + varint_size;
+
+			if (frame_size <= read - current_index) {
+				// The whole frame is in the fixed buffer: dispatching it from there.
+				detail::unowning_linear_container frame(fixed_buff.data() + current_index, static_cast<std::size_t>(frame_size));
+				current_index += frame.size();
+				if (!dispatch(sender, command, frame)) {
+					process_read_error(sender);
+					return;
+				}
+				continue;
 			}
-			sender.io_data->last_read = 0;
-		};
 
-		// Ends the full packet read process
-		auto packet_processed = [&] {
-			detail::peer_manager_attorney<tcp::basic_io_manager <T,U,V,W>>::data_received(*m_owner, sender, sender.io_data->last_command, dyn_buff);
+			sender.io_data->last_command = command;
+			sender.io_data->frame_remaining = static_cast<std::size_t>(frame_size);
+			dyn_buff.reserve(std::min(sender.io_data->frame_remaining, payload_read_step));
+		}
 
-			dyn_buff.clear();
+		std::size_t available = std::min(read - current_index, sender.io_data->frame_remaining);
+		dyn_buff.insert(dyn_buff.end(), fixed_buff.data() + current_index, fixed_buff.data() + current_index + available);
+		current_index += available;
+		sender.io_data->frame_remaining -= available;
+
+		if (sender.io_data->frame_remaining == 0) {
+			// The full frame was read
+			commands command = sender.io_data->last_command;
 			sender.io_data->last_command = commands::null_command;
-			sender.io_data->last_read = 0;
+			if (!dispatch(sender, command, detail::unowning_linear_container(dyn_buff.data(), dyn_buff.size()))) {
+				process_read_error(sender);
+				return;
+			}
+			dyn_buff.clear();
 
-			if (current_index < read) {
-				// we still have some extra data in the buffer
-				for (auto j = 0u ; j < read - current_index ; ++j) {
-					fixed_buff[j] = fixed_buff[current_index + j];
-				}
-				process_read(sender, error, read - current_index);
+		} else if (sender.io_data->frame_remaining > fixed_buff.size()) {
+			// Big frame: reading the rest of its payload straight into its final buffer, bounded by m_max_frame_size.
+			read_payload(sender);
+			return;
+		}
+	}
 
-			} else {
-				sender.io_data->socket.async_read_some(
-						boost::asio::buffer(fixed_buff.data(), fixed_buff.size()),
-						boost::bind(&io_manager::process_read, this, sender, _1, _2)
-				);
-			}
-			has_work = false;
-		};
+	read_some(sender);
+}
 
-		do {
-			to_be_read = fixed_buff[current_index++];
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::process_payload_read(detail::peer_handle handle, boost::system::error_code error) {
+	peer* sender_ptr = m_peer_table.find(handle);
+	if (sender_ptr == nullptr) {
+		return;
+	}
+	peer& sender = *sender_ptr;
 
-			if (to_be_read) {
+	if (error) {
+		process_read_error(sender);
+		return;
+	}
 
-				if (to_be_read + current_index <= read) {
-					// We can reach the end of the packet.
-					process_read_all();
-					packet_processed();
+	sender.io_data->last_receive.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+	std::vector<uint8_t>& dyn_buff = sender.io_data->dynamic_buffer;
 
-				} else {
-					// We still have to wait for some more input
-					process_partial_read();
-				}
-			} else {
-				// to_be_red == 0 <=> more than std::numeric_limits octets to process.
-				to_be_read = std::numeric_limits<uint8_t>::max();
-				if (to_be_read + current_index <= read) {
-					// We can reach the end of the sub packet
-					process_read_all();
-
-				} else {
-					// We still have to wait for some more input
-					process_partial_read();
-				}
-			}
-		} while (has_work);
+	sender.io_data->frame_remaining -= std::min(sender.io_data->frame_remaining, payload_read_step);
+	if (sender.io_data->frame_remaining != 0) {
+		read_payload(sender);
+		return;
+	}
 
-	} else {
-		// error
-		if (sender.io_data->socket.is_open()) {
-			boost::system::error_code ec;
-			sender.io_data->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-			sender.io_data->socket.close(ec);
-			detail::peer_manager_attorney<io_manager>::peer_disconnected(*m_owner, sender);
+	commands command = sender.io_data->last_command;
+	sender.io_data->last_command = commands::null_command;
+	if (!dispatch(sender, command, detail::unowning_linear_container(dyn_buff.data(), dyn_buff.size()))) {
+		process_read_error(sender);
+		return;
+	}
+	dyn_buff.clear();
+
+	read_some(sender);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+bool breep::tcp::basic_io_manager<T,U,V,W,X>::dispatch(peer& sender, commands command, const detail::unowning_linear_container& frame) {
+	if (command != commands::compressed) {
+		detail::peer_manager_attorney<io_manager>::data_received(*m_owner, sender, command, frame);
+		return true;
+	}
+
+	io_data_type& io_data = *sender.io_data;
+	if (!io_data.link_codec || !detail::frame_compressor::decompress(*io_data.link_codec, frame, command, io_data.decompressed, io_data.compression)) {
+		breep::logger<io_manager>.warning("Received a malformed compressed frame from " + sender.id_as_string() + ". Disconnecting.");
+		return false;
+	}
+	detail::peer_manager_attorney<io_manager>::data_received(*m_owner, sender, command,
+	                                                         detail::unowning_linear_container(io_data.decompressed.data(), io_data.decompressed.size()));
+	return true;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::process_read_error(peer& sender) {
+	if (sender.io_data->socket.is_open()) {
+		boost::system::error_code ec;
+		sender.io_data->socket.shutdown(boost::asio::socket_base::shutdown_both, ec);
+		sender.io_data->socket.close(ec);
+		sender.io_data->disconnected = true;
+		queue_drained(sender);
+		detail::peer_manager_attorney<io_manager>::peer_disconnected(*m_owner, sender);
+	}
+	// The socket is closed: the frames still queued will not be sent, and their buffers are not used anymore.
+	output_queue& queue = sender.io_data->queue;
+	for (output_frame& frame : queue.writing) {
+		recycle(frame);
+	}
+	queue.writing.clear();
+	for (std::deque<output_frame>& lane : queue.lanes) {
+		for (output_frame& frame : lane) {
+			recycle(frame);
 		}
+		lane.clear();
 	}
+
+	// No read is pending anymore: pending writes and sends will find a stale handle.
+	m_peer_table.erase(sender.io_data->handle);
 }
 
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::write(const peer& target) const {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::write(const peer& target) const {
 
-	try {
-		auto& buffers = m_data_queues.at(target.id());
-		boost::asio::async_write(
-				target.io_data->socket,
-				boost::asio::buffer(buffers.front().data(), buffers.front().size()),
-				boost::bind(&io_manager::write_done, this, target)
-		);
-	} catch (const std::out_of_range&) {
-		breep::logger<io_manager>.warning("Peer " + target.id_as_string() + " disconnected unexpectedly while data was being sent");
+	output_queue& queue = target.io_data->queue;
+	target.io_data->corked_octets = 0;
+
+	// Taking as many queued frames as allowed in a single write, from the highest lanes first
+	std::size_t octets{0};
+	for (std::deque<output_frame>& lane : queue.lanes) {
+		while (!lane.empty() && queue.writing.size() < m_max_write_frames
+		       && (queue.writing.empty() || octets + lane.front().size() <= m_max_write_size)) {
+			octets += lane.front().size();
+			queue.writing.push_back(std::move(lane.front()));
+			lane.pop_front();
+		}
+	}
+
+	// Gathered once the frames moved: their headers are stored inline.
+	queue.gathered.clear();
+	for (const output_frame& frame : queue.writing) {
+		queue.gathered.push_back(boost::asio::buffer(frame.header.data(), frame.header_size));
+		queue.gathered.push_back(boost::asio::buffer(frame.payload_data()));
+	}
+
+	const std::size_t frames = queue.writing.size();
+	m_statistics.writes.fetch_add(1, std::memory_order_relaxed);
+	m_statistics.frames_written.fetch_add(frames, std::memory_order_relaxed);
+	m_statistics.octets_written.fetch_add(octets, std::memory_order_relaxed);
+	uint64_t max_frames = m_statistics.max_frames_per_write.load(std::memory_order_relaxed);
+	while (frames > max_frames
+	       && !m_statistics.max_frames_per_write.compare_exchange_weak(max_frames, frames, std::memory_order_relaxed));
+
+	target.io_data->last_send.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+
+	breep::logger<io_manager>.trace("Writing " + std::to_string(frames) + " frames (" + std::to_string(octets)
+	                                + " octets) to " + target.id_as_string());
+
+	boost::asio::async_write(
+			target.io_data->socket,
+			queue.gathered_view(),
+			target.io_data->strand.wrap(boost::bind(&io_manager::write_done, this, target.io_data->handle))
+	);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::write_done(detail::peer_handle handle) const {
+	const peer* target_ptr = m_peer_table.find(handle);
+	if (target_ptr == nullptr) {
+		return;
+	}
+	const peer& target = *target_ptr;
+	output_queue& queue = target.io_data->queue;
+	std::size_t octets{0};
+	for (output_frame& frame : queue.writing) {
+		octets += frame.size();
+		recycle(frame);
+	}
+	target.io_data->queued_octets -= octets;
+	target.io_data->queued_frames -= queue.writing.size();
+	queue.writing.clear();
+	queue_drained(target);
+	if (queue.waiting()) {
+		write(target);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::cork_expired(detail::peer_handle handle, boost::system::error_code /*ec*/) const {
+	const peer* target = m_peer_table.find(handle);
+	if (target != nullptr) {
+		target->io_data->cork_timer_armed = false;
+		flush(*target);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::queue_drained(const peer& target) const {
+	io_data_type& io_data = *target.io_data;
+	if (m_queue_limits.policy == overflow_policy::block) {
+		{
+			std::lock_guard<std::mutex> lock(io_data.queue_mutex);
+		}
+		io_data.queue_drained.notify_all();
+	}
+
+	if (io_data.above_high_watermark && !io_data.disconnected && queue_below_low_watermark(io_data)
+	    && io_data.above_high_watermark.exchange(false) && m_low_watermark_listener) {
+		m_low_watermark_listener(target);
 	}
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::write_done(const peer& target) const {
-	try {
-		auto& buffers = m_data_queues.at(target.id());
-		buffers.pop();
-		if (!buffers.empty()) {
-			write(target);
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::drop_oldest_frames(const peer& target, output_queue& queue, std::size_t newest_lane) const {
+	io_data_type& io_data = *target.io_data;
+	auto is_over_capacity = [this, &io_data] {
+		return (m_queue_limits.high_watermark_octets != 0 && io_data.queued_octets > m_queue_limits.high_watermark_octets)
+		       || (m_queue_limits.high_watermark_messages != 0 && io_data.queued_frames > m_queue_limits.high_watermark_messages);
+	};
+
+	// Frames being written and the network's own commands are kept, as well as the newest frame.
+	for (std::size_t idx = queue.lanes.size() ; idx-- > 0 && is_over_capacity() ;) {
+		std::deque<output_frame>& lane = queue.lanes[idx];
+		auto it = lane.begin();
+		while (is_over_capacity() && it != lane.end() && !(idx == newest_lane && it == lane.end() - 1)) {
+			commands command = it->original_command();
+			if (command == commands::send_to || command == commands::send_to_all) {
+				io_data.queued_octets -= it->size();
+				--io_data.queued_frames;
+				++m_statistics.frames_dropped;
+				recycle(*it);
+				it = lane.erase(it);
+			} else {
+				++it;
+			}
 		}
-	} catch (const std::out_of_range&) {
-		breep::logger<io_manager>.warning("Peer " + target.id_as_string() + " disconnected unexpectedly while data was being sent");
 	}
 }
 
-template <unsigned int T, unsigned long U, unsigned long V, unsigned long W>
-void breep::tcp::basic_io_manager<T,U,V,W>::accept(boost::system::error_code ec) {
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+bool breep::tcp::basic_io_manager<T,U,V,W,X>::in_network_thread() const {
+	if (m_io_service.get_executor().running_in_this_thread()) {
+		return true;
+	}
+	return std::any_of(m_shards.cbegin(), m_shards.cend(), [](const std::unique_ptr<shard>& s) {
+		return s->io_service.get_executor().running_in_this_thread();
+	});
+}
 
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::accept(boost::system::error_code ec) {
+	if (ec == boost::asio::error::operation_aborted) {
+		// The acceptor was closed, and is re-armed by whoever closed it.
+		return;
+	}
 	if (!ec) {
-		boost::array<uint8_t, 128> buffer;
-		size_t len = m_socket->read_some(boost::asio::buffer(buffer), ec);
+		handshake(std::move(m_socket), m_io_service);
+	}
+	// reset the socket.
+	m_socket = std::make_shared<socket_type>(m_io_service);
+	m_acceptor.async_accept(*m_socket, m_accept_strand.wrap(boost::bind(&io_manager::accept, this, _1)));
+}
 
-		if (ec) {
-			breep::logger<io_manager>.warning("Failed to read data from incomming connection: ["
-			                                  + m_socket->remote_endpoint().address().to_string() + "].");
-			m_socket->close();
-		} else {
-			std::vector<uint8_t> protocol_id;
-			protocol_id.reserve(8);
-			detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_1);
-			detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_2);
-			m_socket->write_some(boost::asio::buffer(protocol_id), ec);
-
-			// Reading the protocol ID
-			if (len != 8) {
-				breep::logger<io_manager>.warning("Incomming connection from [" + m_socket->remote_endpoint().address().to_string()
-				                                  + "]: they don't have the same protocol ID format than us!");
-				m_socket = std::make_shared<boost::asio::ip::tcp::socket>(m_io_service);
-				m_acceptor.async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::shard_accept(shard* s, boost::system::error_code ec) {
+	if (ec == boost::asio::error::operation_aborted) {
+		return;
+	}
+	if (!ec) {
+		handshake(std::move(s->socket), s->io_service);
+	}
+	s->socket = std::make_shared<socket_type>(s->io_service);
+	s->acceptor.async_accept(*s->socket, boost::bind(&io_manager::shard_accept, this, s, _1));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::connection_step(connection_ptr co, boost::system::error_code ec) {
+	using step = typename connection_data::step;
+
+	if (co->current_step == step::done) {
+		return;
+	}
+	if (ec) {
+		connection_failed(co);
+		return;
+	}
+
+	auto next_step = co->strand.wrap(boost::bind(&io_manager::connection_step, this, co, _1));
+	switch (co->current_step) {
+		case step::connect:
+			co->current_step = step::send_protocol_id;
+			boost::asio::async_write(co->socket, boost::asio::buffer(co->protocol_id), next_step);
+			break;
+
+		case step::send_protocol_id:
+			co->current_step = step::check_protocol_id;
+			boost::asio::async_read(co->socket, boost::asio::buffer(co->buffer.data(), co->protocol_id.size()), next_step);
+			break;
+
+		case step::check_protocol_id:
+			if (!std::equal(co->protocol_id.cbegin(), co->protocol_id.cend(), co->buffer.cbegin())) {
+				breep::logger<io_manager>.warning("Target peer has not the same io_manager protocol ID than us (["
+				                                  + co->address.to_string() + "]:" + std::to_string(co->port) + ").");
+				breep::logger<io_manager>.warning("Our protocol ID: " + std::to_string(IO_PROTOCOL_ID_1) + " " +
+				                                  std::to_string(IO_PROTOCOL_ID_2) + ". Their protocol ID: "
+				                                  + std::to_string(detail::read_uint32(co->buffer)) + " "
+				                                  + std::to_string(detail::read_uint32(co->buffer, sizeof(uint32_t))) + ".");
+				connection_failed(co);
 				return;
 			}
-			while(len--) {
-				if (buffer[len] != protocol_id[len]) {
-					breep::logger<io_manager>.warning("Incomming peer has not the same io_manager protocol ID than us (["
-					                                  + m_socket->remote_endpoint().address().to_string() + "]).");
-					breep::logger<io_manager>.warning("Our protocol ID: " + std::to_string(IO_PROTOCOL_ID_1) + " " +
-					                                  std::to_string(IO_PROTOCOL_ID_2) + ". Their protocol ID: "
-					                                  + std::to_string(detail::read_uint32(buffer)) + " "
-					                                  + std::to_string(detail::read_uint32(buffer, sizeof(uint32_t))) + ".");
-					m_socket = std::make_shared<boost::asio::ip::tcp::socket>(m_io_service);
-					m_acceptor.async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
-					return;
-				}
+			co->current_step = step::send_id;
+			boost::asio::async_write(co->socket, boost::asio::buffer(co->id_packet), next_step);
+			break;
+
+		case step::send_id:
+			co->current_step = step::read_id_size;
+			boost::asio::async_read(co->socket, boost::asio::buffer(co->buffer.data(), 1), next_step);
+			break;
+
+		case step::read_id_size:
+			if (co->buffer[0] >= co->buffer.size()) {
+				connection_failed(co);
+				return;
 			}
+			co->current_step = step::read_id;
+			boost::asio::async_read(co->socket, boost::asio::buffer(co->buffer.data() + 1, co->buffer[0]), next_step);
+			break;
+
+		case step::read_id:
+			co->current_step = step::read_answer;
+			boost::asio::async_read(co->socket, boost::asio::buffer(&co->answer, sizeof(co->answer)), next_step);
+			break;
+
+		case step::read_answer:
+		{
+			co->current_step = step::done;
+			if (static_cast<commands>(co->answer) == commands::connection_refused) {
+				breep::logger<io_manager>.info("Connection refused ([" + co->address.to_string() + "]:" + std::to_string(co->port) + ")");
+				connection_failed(co);
+				return;
+			}
+			if (static_cast<commands>(co->answer) != commands::connection_accepted || co->buffer[0] < 4) {
+				breep::logger<io_manager>.warning("Incompatible protocol, but protocol id match."
+				                                  "(when connecting to [" + co->address.to_string() + "]:" + std::to_string(co->port) + ")");
+				connection_failed(co);
+				return;
+			}
+			co->deadline.cancel();
 
-			// Reading the id
-			len = 0;
-			do {
-				len += m_socket->read_some(boost::asio::buffer(buffer.data() + len, buffer.size() - len), ec);
-				if (ec) {
-					m_socket = std::make_shared<boost::asio::ip::tcp::socket>(m_io_service);
-					m_acceptor.async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
-					return;
-				}
-			} while (len <= buffer[0]);
-
+			// [size][port][id][codec]
 			std::string input;
-			detail::unmake_little_endian(detail::unowning_linear_container(buffer.data() + 3, len - 3), input);
-			boost::asio::write(*m_socket, boost::asio::buffer(m_id_packet));
+			detail::unmake_little_endian(detail::unowning_linear_container(co->buffer.data() + 3, co->buffer[0] - 3), input);
 
 			boost::uuids::uuid uuid;
 			std::copy(input.data(), input.data() + input.size(), uuid.data);
 
-			auto addr = m_socket->remote_endpoint().address();
-			detail::peer_manager_attorney<io_manager>::peer_connected(
-					*m_owner,
-					peer(
-							std::move(uuid),
-							std::move(addr),
-							static_cast<unsigned short>(buffer[1] << 8 | buffer[2]),
-							std::make_shared<tcp::io_manager_data<T>>(m_socket, true)
-					)
-			);
+			auto io_data = std::make_shared<io_data_type>(std::move(co->socket), co->io_service);
+			io_data->link_codec = m_compression.negotiate(co->buffer[co->buffer[0]]);
+			co->handler(detail::optional<peer>(peer(
+					std::move(uuid),
+					boost::asio::ip::address(co->address),
+					static_cast<unsigned short>(co->buffer[1] << 8 | co->buffer[2]),
+					std::move(io_data)
+			)));
+			break;
 		}
+
+		case step::done:
+			break;
 	}
-	// reset the socket.
-	m_socket = std::make_shared<boost::asio::ip::tcp::socket>(m_io_service);
-	m_acceptor.async_accept(*m_socket, boost::bind(&io_manager::accept, this, _1));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::connection_expired(connection_ptr co, boost::system::error_code ec) {
+	if (ec != boost::asio::error::operation_aborted && co->current_step != connection_data::step::done) {
+		breep::logger<io_manager>.warning("Connection to [" + co->address.to_string() + "]:" + std::to_string(co->port) + " timed out.");
+		boost::system::error_code close_ec;
+		co->socket.close(close_ec);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::connection_failed(connection_ptr co) {
+	co->current_step = connection_data::step::done;
+	co->deadline.cancel();
+	boost::system::error_code ec;
+	co->socket.close(ec);
+	co->handler(detail::optional<peer>());
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::handshake(std::shared_ptr<socket_type>&& socket, boost::asio::io_service& io_service) {
+	apply_socket_options(*socket, socket_options());
+	auto hs = std::make_shared<handshake_data>(std::move(socket), io_service, m_id_packet);
+
+	hs->deadline.expires_after(m_handshake_timeout);
+	hs->deadline.async_wait(hs->strand.wrap(boost::bind(&io_manager::handshake_expired, this, hs, _1)));
+
+	// Reading the protocol ID
+	hs->socket->async_read_some(
+			boost::asio::buffer(hs->buffer),
+			hs->strand.wrap(boost::bind(&io_manager::handshake_protocol_read, this, hs, _1, _2))
+	);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::handshake_protocol_read(handshake_ptr hs, boost::system::error_code ec, std::size_t read) {
+	if (ec) {
+		breep::logger<io_manager>.warning("Failed to read data from incomming connection.");
+		handshake_abort(hs);
+		return;
+	}
+	hs->length = read;
+
+	// Our protocol ID is sent in any case, for the remote peer to know why it is rejected.
+	boost::asio::async_write(
+			*hs->socket,
+			boost::asio::buffer(hs->protocol_id),
+			hs->strand.wrap(boost::bind(&io_manager::handshake_protocol_written, this, hs, _1))
+	);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::handshake_protocol_written(handshake_ptr hs, boost::system::error_code ec) {
+	if (ec) {
+		handshake_abort(hs);
+		return;
+	}
+
+	boost::system::error_code endpoint_ec;
+	std::string remote_address = X::remote_address(*hs->socket, endpoint_ec).to_string();
+	if (hs->length != 8) {
+		breep::logger<io_manager>.warning("Incomming connection from [" + remote_address
+		                                  + "]: they don't have the same protocol ID format than us!");
+		handshake_abort(hs);
+		return;
+	}
+
+	if (!std::equal(hs->protocol_id.cbegin(), hs->protocol_id.cend(), hs->buffer.cbegin())) {
+		breep::logger<io_manager>.warning("Incomming peer has not the same io_manager protocol ID than us (["
+		                                  + remote_address + "]).");
+		breep::logger<io_manager>.warning("Our protocol ID: " + std::to_string(IO_PROTOCOL_ID_1) + " " +
+		                                  std::to_string(IO_PROTOCOL_ID_2) + ". Their protocol ID: "
+		                                  + std::to_string(detail::read_uint32(hs->buffer)) + " "
+		                                  + std::to_string(detail::read_uint32(hs->buffer, sizeof(uint32_t))) + ".");
+		handshake_abort(hs);
+		return;
+	}
+
+	// Reading the id
+	hs->length = 0;
+	hs->socket->async_read_some(
+			boost::asio::buffer(hs->buffer),
+			hs->strand.wrap(boost::bind(&io_manager::handshake_id_read, this, hs, _1, _2))
+	);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::handshake_id_read(handshake_ptr hs, boost::system::error_code ec, std::size_t read) {
+	if (ec) {
+		handshake_abort(hs);
+		return;
+	}
+
+	hs->length += read;
+	if (hs->length <= hs->buffer[0]) {
+		if (hs->length == hs->buffer.size()) {
+			handshake_abort(hs);
+			return;
+		}
+		hs->socket->async_read_some(
+				boost::asio::buffer(hs->buffer.data() + hs->length, hs->buffer.size() - hs->length),
+				hs->strand.wrap(boost::bind(&io_manager::handshake_id_read, this, hs, _1, _2))
+		);
+		return;
+	}
+	if (hs->buffer[0] < 4) {
+		handshake_abort(hs);
+		return;
+	}
+
+	boost::asio::async_write(
+			*hs->socket,
+			boost::asio::buffer(hs->id_packet),
+			hs->strand.wrap(boost::bind(&io_manager::handshake_id_written, this, hs, _1))
+	);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::handshake_id_written(handshake_ptr hs, boost::system::error_code ec) {
+	boost::system::error_code endpoint_ec;
+	auto addr = X::remote_address(*hs->socket, endpoint_ec);
+	if (ec || endpoint_ec) {
+		handshake_abort(hs);
+		return;
+	}
+	hs->deadline.cancel();
+
+	// [size][port][id][codec]
+	std::string input;
+	detail::unmake_little_endian(detail::unowning_linear_container(hs->buffer.data() + 3, hs->buffer[0] - 3), input);
+
+	boost::uuids::uuid uuid;
+	std::copy(input.data(), input.data() + input.size(), uuid.data);
+
+	auto io_data = std::make_shared<io_data_type>(hs->socket, hs->io_service, true);
+	io_data->link_codec = m_compression.negotiate(hs->buffer[hs->buffer[0]]);
+	detail::peer_manager_attorney<io_manager>::peer_connected(
+			*m_owner,
+			peer(
+					std::move(uuid),
+					std::move(addr),
+					static_cast<unsigned short>(hs->buffer[1] << 8 | hs->buffer[2]),
+					std::move(io_data)
+			)
+	);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::handshake_expired(handshake_ptr hs, boost::system::error_code ec) {
+	if (ec != boost::asio::error::operation_aborted) {
+		breep::logger<io_manager>.warning("Incomming connection did not complete its handshake in time.");
+		boost::system::error_code close_ec;
+		hs->socket->close(close_ec);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V, unsigned long W, typename X>
+void breep::tcp::basic_io_manager<T,U,V,W,X>::handshake_abort(handshake_ptr hs) {
+	hs->deadline.cancel();
+	boost::system::error_code ec;
+	hs->socket->close(ec);
 }
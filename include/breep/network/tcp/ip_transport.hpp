@@ -0,0 +1,107 @@
+#ifndef BREEP_NETWORK_TCP_IP_TRANSPORT_HPP
+#define BREEP_NETWORK_TCP_IP_TRANSPORT_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file tcp/ip_transport.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <boost/asio.hpp>
+
+#include "breep/util/exceptions.hpp"
+
+namespace breep { namespace tcp {
+
+	/**
+	 * @brief Default transport of tcp::basic_io_manager: TCP over IPv6, and IPv4.
+	 * @details A transport tells basic_io_manager which stream sockets to use, how to listen to a port
+	 *          and how to reach a peer given its address and port. Transports are stateless.
+	 *
+	 * @sa breep::local::unix_transport
+	 *
+	 * @since 1.1.0
+	 */
+	struct ip_transport final {
+		using protocol = boost::asio::ip::tcp;
+
+		// whether breep::socket_options and kernel keep-alives apply to the sockets.
+		static constexpr bool tcp_options = true;
+
+		/**
+		 * @brief Listens to \em port.
+		 * @param reuse_port whether other acceptors may listen to the same port (SO_REUSEPORT).
+		 * @throws unsupported_system if \em reuse_port is requested, but unavailable.
+		 */
+		static protocol::acceptor make_acceptor(boost::asio::io_service& io_service, unsigned short port, bool reuse_port) {
+			protocol::acceptor acceptor(io_service);
+			acceptor.open(protocol::v6());
+			acceptor.set_option(protocol::acceptor::reuse_address(true));
+			if (reuse_port) {
+#ifdef SO_REUSEPORT
+				acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#else
+				throw unsupported_system("SO_REUSEPORT is not available on your system: network can't be sharded.");
+#endif
+			}
+
+			boost::system::error_code ec;
+			acceptor.set_option(boost::asio::ip::v6_only(false), ec);
+			acceptor.bind(protocol::endpoint(protocol::v6(), port));
+			acceptor.listen();
+			return acceptor;
+		}
+
+		/**
+		 * @return whether \em acceptor also accepts IPv4 connections.
+		 */
+		static bool dual_stack(const protocol::acceptor& acceptor) {
+			boost::asio::ip::v6_only v6_only;
+			boost::system::error_code ec;
+			acceptor.get_option(v6_only, ec);
+			return !ec && !v6_only;
+		}
+
+		/**
+		 * @brief Listens to IPv4 connections on the port of \em acceptor, for systems without dual stack.
+		 */
+		static protocol::acceptor make_v4_acceptor(boost::asio::io_service& io_service, const protocol::acceptor& acceptor) {
+			return protocol::acceptor(io_service, protocol::endpoint(protocol::v4(), acceptor.local_endpoint().port()));
+		}
+
+		/**
+		 * @return the port \em acceptor listens to.
+		 */
+		static unsigned short port(const protocol::acceptor& acceptor) {
+			return acceptor.local_endpoint().port();
+		}
+
+		/**
+		 * @brief Stops listening.
+		 */
+		static void close(protocol::acceptor& acceptor) {
+			boost::system::error_code ec;
+			acceptor.close(ec);
+		}
+
+		static protocol::endpoint endpoint(const boost::asio::ip::address& address, unsigned short port) {
+			return protocol::endpoint(address, port);
+		}
+
+		static boost::asio::ip::address remote_address(const protocol::socket& socket, boost::system::error_code& ec) {
+			return socket.remote_endpoint(ec).address();
+		}
+	};
+}}
+
+#endif //BREEP_NETWORK_TCP_IP_TRANSPORT_HPP
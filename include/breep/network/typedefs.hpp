@@ -18,7 +18,9 @@
  */
 
 #include <cstdint>
+#include <cstddef>
 #include <utility>
+#include <chrono>
 
 namespace breep {
 
@@ -33,5 +35,141 @@ namespace breep {
 		// hash of the type listened by the listener
 		uint64_t type_hash() const { return second; }
 	};
+
+	/**
+	 * @brief What to do with data sent to a peer whose send queue is full.
+	 *
+	 * @since 1.1.0
+	 */
+	enum class overflow_policy {
+		// wait for the queue to drain (network threads never wait: their data is queued anyway)
+		block,
+		// discard the data being sent
+		drop_newest,
+		// discard the oldest queued data that is not being written yet
+		drop_oldest,
+		// disconnect the peer
+		disconnect
+	};
+
+	/**
+	 * @brief Lane of the per-peer send queues data is sent in. Lanes are written in order: data of a lane is only
+	 *        written once the lanes above it are empty (the frame being written is never interrupted).
+	 * @details The network's own commands (keep-alives, routing updates...) are always sent in the control lane.
+	 *          Data sent with the same priority is received in order, but data sent with different priorities may not.
+	 *          io_managers without per-peer send queues (breep::udp and breep::inproc) ignore it.
+	 *
+	 * @since 1.1.0
+	 */
+	enum class send_priority : uint8_t {
+		control,
+		high,
+		normal,
+		low
+	};
+
+	/**
+	 * @brief Number of send_priority lanes.
+	 *
+	 * @since 1.1.0
+	 */
+	constexpr std::size_t send_priority_count = 4;
+
+	/**
+	 * @brief Identifier of a stream, chosen by its sender (see basic_network::send_stream). Streams are told apart
+	 *        by their sender and their id.
+	 *
+	 * @since 1.1.0
+	 */
+	using stream_id = uint64_t;
+
+	/**
+	 * @brief Bounds of the per-peer send queues.
+	 * @details A queue is full when it goes over any of its high watermarks, and drained once it is back
+	 *          under all its low watermarks. A watermark of 0 means unbounded. Only user data is bounded:
+	 *          the network's own commands are always queued.
+	 *
+	 * @since 1.1.0
+	 */
+	struct send_queue_limits {
+		std::size_t high_watermark_octets{0};
+		std::size_t low_watermark_octets{0};
+		std::size_t high_watermark_messages{0};
+		std::size_t low_watermark_messages{0};
+		overflow_policy policy{overflow_policy::block};
+	};
+
+	/**
+	 * @brief Options set on the sockets of the peers. A value of 0 (or false) keeps the system's default.
+	 * @details Options that are not available on the system are ignored. When the options change at runtime,
+	 *          those the previous options had set and the new ones leave to 0 are reset to 0 (or false),
+	 *          except for the buffer sizes, which keep their last value.
+	 *
+	 * @since 1.1.0
+	 */
+	struct socket_options {
+		// TCP_NODELAY: sends small frames right away instead of coalescing them (Nagle's algorithm)
+		bool no_delay{false};
+		// SO_SNDBUF and SO_RCVBUF, in octets
+		int send_buffer_size{0};
+		int receive_buffer_size{0};
+		// TCP_QUICKACK (Linux): acknowledges received data right away instead of delaying the ACK
+		bool quick_ack{false};
+		// TCP_USER_TIMEOUT (Linux): time written data may stay unacknowledged before the connection is dropped
+		std::chrono::milliseconds user_timeout{0};
+		// SO_BUSY_POLL (Linux): time spent busy polling the device queue on blocking reads
+		std::chrono::microseconds busy_poll{0};
+
+		/**
+		 * @brief Favours latency: no coalescing of small frames, immediate ACKs and busy polling.
+		 */
+		static socket_options low_latency() {
+			socket_options options;
+			options.no_delay = true;
+			options.quick_ack = true;
+			options.busy_poll = std::chrono::microseconds(50);
+			return options;
+		}
+
+		/**
+		 * @brief Favours throughput: large kernel buffers, and small frames are coalesced.
+		 */
+		static socket_options bulk_throughput() {
+			socket_options options;
+			options.send_buffer_size = 4 * 1024 * 1024;
+			options.receive_buffer_size = 4 * 1024 * 1024;
+			return options;
+		}
+	};
+
+	/**
+	 * @brief Compression of the frames exchanged with a peer (see breep::codec).
+	 * @details Sizes are the ones of the payloads, frame headers excluded.
+	 *
+	 * @since 1.1.0
+	 */
+	struct compression_statistics {
+		// frames sent compressed, and the size of their payload before and after compression
+		uint64_t frames_compressed{0};
+		uint64_t octets_before_compression{0};
+		uint64_t octets_after_compression{0};
+		// frames above the threshold that were sent as they were, as compressing them did not make them smaller
+		uint64_t frames_incompressible{0};
+		// time spent compressing, incompressible frames included
+		std::chrono::nanoseconds compression_time{0};
+
+		// frames received compressed, and the size of their payload before and after decompression
+		uint64_t frames_decompressed{0};
+		uint64_t octets_before_decompression{0};
+		uint64_t octets_after_decompression{0};
+		std::chrono::nanoseconds decompression_time{0};
+
+		/**
+		 * @return the size of the frames sent compressed over their original size (1 if none were).
+		 */
+		double ratio() const {
+			return octets_before_compression == 0 ? 1. : static_cast<double>(octets_after_compression) / static_cast<double>(octets_before_compression);
+		}
+	};
 }
 #endif //BREEP_NETWORK_TYPEDEFS_HPP
@@ -0,0 +1,433 @@
+#ifndef BREEP_NETWORK_UDP_BASIC_IO_MANAGER_HPP
+#define BREEP_NETWORK_UDP_BASIC_IO_MANAGER_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file udp/basic_io_manager.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <chrono>
+#include <array>
+#include <string>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include "breep/network/io_manager_base.hpp"
+#include "breep/network/typedefs.hpp"
+#include "breep/util/exceptions.hpp"
+#include "breep/network/detail/commands.hpp"
+
+
+namespace breep {
+	template <typename T>
+	class basic_peer_manager;
+
+	namespace detail {
+		template <typename T>
+		class peer_manager_attorney;
+	}
+}
+
+namespace breep { namespace udp {
+
+	/**
+	 * @brief How the data sent to a peer is delivered.
+	 *
+	 * @since 1.1.0
+	 */
+	enum class delivery {
+		// retransmitted until acknowledged, and received in the order it was sent.
+		reliable_ordered,
+		// sent once, in a single datagram: it may be lost, or received out of order.
+		unreliable_unordered
+	};
+
+	/**
+	 * @brief Sets how the user data sent from the calling thread is delivered, until the scope ends.
+	 * @details Only applies to user data (basic_network::send_object, send_object_to, ...): the network's
+	 *          own commands are always delivered reliably. Overrides basic_io_manager::user_data_delivery().
+	 *
+	 * @code{.cpp}
+	 * {
+	 *     breep::udp::delivery_scope scope(breep::udp::delivery::unreliable_unordered);
+	 *     network.send_object(position);
+	 * }
+	 * @endcode
+	 *
+	 * @since 1.1.0
+	 */
+	class delivery_scope final {
+	public:
+		explicit delivery_scope(delivery d)
+				: m_delivery(d)
+				, m_previous(current())
+		{
+			current() = &m_delivery;
+		}
+
+		delivery_scope(const delivery_scope&) = delete;
+		delivery_scope& operator=(const delivery_scope&) = delete;
+
+		~delivery_scope() {
+			current() = m_previous;
+		}
+
+		/**
+		 * @return the delivery set by the innermost scope of the calling thread, or nullptr.
+		 */
+		static const delivery*& current() {
+			static thread_local const delivery* scoped = nullptr;
+			return scoped;
+		}
+
+	private:
+		const delivery m_delivery;
+		const delivery* m_previous;
+	};
+
+	/**
+	 * Reliable datagram waiting to be acknowledged.
+	 */
+	struct segment final {
+		uint32_t seq;
+		// [datagram type][seq (4 octets)][frame octets]
+		std::vector<uint8_t> datagram;
+		std::chrono::steady_clock::time_point sent_at;
+		unsigned int transmissions;
+	};
+
+	/**
+	 * State of a peer, as kept by the io_manager.
+	 * Apart from disconnected, it is only accessed from the network thread.
+	 */
+	struct io_manager_data final {
+
+		io_manager_data(const boost::asio::ip::udp::endpoint& endpoint_, boost::asio::io_service& io_service, bool waiting_acceptance_ans = false)
+				: endpoint(endpoint_)
+				, waiting_acceptance_answer(waiting_acceptance_ans)
+				, timer(io_service)
+		{}
+
+		const boost::asio::ip::udp::endpoint endpoint;
+		// true for peers that connected to us, until the connection is accepted or refused.
+		bool waiting_acceptance_answer;
+		std::atomic<bool> disconnected{false};
+
+		// reliable datagrams sent and not acknowledged yet, the first \em transmitted of them were sent.
+		std::deque<segment> unacked{};
+		std::size_t transmitted{0};
+		uint32_t next_seq{0};
+		uint32_t last_ack{0};
+		unsigned int duplicate_acks{0};
+		bool has_rtt{false};
+		std::chrono::steady_clock::duration srtt{};
+		std::chrono::steady_clock::duration rttvar{};
+		std::chrono::steady_clock::duration rto{std::chrono::milliseconds(200)};
+		// congestion window and slow start threshold (in datagrams), and the end of the loss being recovered from.
+		std::size_t cwnd{16};
+		std::size_t ssthresh{std::numeric_limits<std::size_t>::max()};
+		std::size_t cwnd_credit{0};
+		bool recovering{false};
+		uint32_t recover{0};
+
+		// next reliable datagram expected, those received ahead of it, and the in order octets not yet parsed.
+		uint32_t expected_seq{0};
+		std::map<uint32_t, std::vector<uint8_t>> out_of_order{};
+		std::vector<uint8_t> stream{};
+
+		std::chrono::steady_clock::time_point last_receive{std::chrono::steady_clock::now()};
+		std::chrono::steady_clock::time_point last_send{std::chrono::steady_clock::now()};
+
+		// keep-alive, timeout and retransmission deadline.
+		boost::asio::steady_timer timer;
+		bool timer_armed{false};
+		std::chrono::steady_clock::time_point timer_deadline{};
+	};
+
+	/**
+	 * Counters updated by the io_manager. They may be read from any thread.
+	 */
+	struct io_statistics final {
+		// number of datagrams sent
+		std::atomic<uint64_t> datagrams_sent{0};
+		// number of datagrams received
+		std::atomic<uint64_t> datagrams_received{0};
+		// number of reliable datagrams sent again
+		std::atomic<uint64_t> retransmissions{0};
+		// number of frames sent unreliably
+		std::atomic<uint64_t> unreliable_frames_sent{0};
+		// number of frames to be sent unreliably, sent reliably as they do not fit in a datagram
+		std::atomic<uint64_t> unreliable_frames_too_big{0};
+		// number of keep_alive frames sent
+		std::atomic<uint64_t> keep_alives_sent{0};
+	};
+
+	/**
+	 * @brief udp network_manager implementation
+	 * @details Peers share a single socket. Frames are delivered either reliably and in order, over a stream of
+	 *          sequenced and acknowledged datagrams that are retransmitted until acknowledged, or unreliably in a
+	 *          single datagram (see delivery_scope). The network commands are always delivered reliably.
+	 *          Peers are handled by a single network thread.
+	 *
+	 * @tparam MAX_DATAGRAM_SIZE      Maximal size of the datagrams sent (in octets). Should fit in the path MTU.
+	 * @tparam keep_alive_send_millis Time interval indicating the sending of keep_alive packets frequency (in milliseconds).
+	 * @tparam timeout_millis         Time interval after which a peer should be considered dead if no packets have been received from him (in milliseconds).
+	 *
+	 * @since 1.1.0
+	 */
+	template <unsigned int MAX_DATAGRAM_SIZE, unsigned long keep_alive_send_millis, unsigned long timeout_millis>
+	class basic_io_manager final: public io_manager_base<basic_io_manager<MAX_DATAGRAM_SIZE,keep_alive_send_millis,timeout_millis>> {
+	public:
+
+		// The protocol ID should be changed at each compatibility break.
+		static constexpr uint32_t IO_PROTOCOL_ID_1 =  755960664; // UPDATE THIS TOGETHER WITH THE HASHING FUNCTION +1 [util/type_traits.hpp]
+		static constexpr uint32_t IO_PROTOCOL_ID_2 =  491035773;
+
+		// [datagram type][seq (4 octets)]
+		static constexpr std::size_t segment_header_size = 1 + sizeof(uint32_t);
+		// maximal number of reliable datagrams sent and not yet acknowledged, per peer (the congestion window may be smaller).
+		static constexpr std::size_t window_size = 256;
+
+		static_assert(MAX_DATAGRAM_SIZE > segment_header_size + 1 + detail::max_varint_size, "MAX_DATAGRAM_SIZE is too small.");
+
+		using io_manager = basic_io_manager<MAX_DATAGRAM_SIZE, keep_alive_send_millis, timeout_millis>;
+		using peer = basic_peer<io_manager>;
+		using data_type = std::shared_ptr<io_manager_data>;
+
+		explicit basic_io_manager(unsigned short port);
+
+		basic_io_manager(io_manager&& other) noexcept;
+
+		~basic_io_manager() final;
+
+		template <typename Container>
+		void send(commands command, const Container& container, const peer& peer, send_priority priority = send_priority::normal) const;
+
+		template <typename InputIterator, typename size_type>
+		void send(commands command, InputIterator begin, size_type size, const peer& peer, send_priority priority = send_priority::normal) const;
+
+		void send(commands command, std::vector<uint8_t>&& data, const peer& peer, send_priority priority = send_priority::normal) const;
+
+		detail::optional<peer> connect(const boost::asio::ip::address& address, unsigned short port) final;
+
+		/**
+		 * @brief Connects without blocking: the connection request is sent again until it is answered, or
+		 *        until handshake_timeout() passed.
+		 *
+		 * @since 1.1.0
+		 */
+		void async_connect(const boost::asio::ip::address& address, unsigned short port,
+		                   std::function<void(detail::optional<peer>&&)> handler) final;
+
+		void process_connected_peer(peer& peer) final;
+
+		void process_connection_denial(peer& peer) final;
+
+		void disconnect() final;
+
+		void disconnect(peer& peer) final;
+
+		void run() final;
+
+		void set_log_level(log_level ll) const final {
+			breep::logger<io_manager>.level(ll);
+		}
+
+		/**
+		 * @brief Sets how the user data is delivered, when no delivery_scope is active.
+		 * @details Unreliable frames that do not fit in a single datagram are sent reliably.
+		 *          Defaults to delivery::reliable_ordered.
+		 *
+		 * @since 1.1.0
+		 */
+		void user_data_delivery(delivery d) {
+			m_user_data_delivery = d;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		delivery user_data_delivery() const {
+			return m_user_data_delivery;
+		}
+
+		/**
+		 * @brief Sets the time a connection request is given to be answered.
+		 *
+		 * @since 1.1.0
+		 */
+		void handshake_timeout(std::chrono::milliseconds timeout) {
+			m_handshake_timeout = timeout;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::chrono::milliseconds handshake_timeout() const {
+			return m_handshake_timeout;
+		}
+
+		/**
+		 * @brief Sets the maximum size of the frames a peer may send (64 MiB by default). Peers announcing a bigger
+		 *        frame are disconnected instead of being buffered.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void max_frame_size(std::size_t octets) {
+			m_max_frame_size = octets;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t max_frame_size() const {
+			return m_max_frame_size;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		const io_statistics& statistics() const {
+			return m_statistics;
+		}
+
+	private:
+
+		enum class datagram : uint8_t {
+			// [protocol ids (8 octets)][id packet]
+			connect_request = 1,
+			// [protocol ids (8 octets)][id packet]
+			connect_accept,
+			connect_refuse,
+			// [seq (4 octets)][frame octets]
+			reliable,
+			// [command][payload]
+			unreliable,
+			// [next expected seq (4 octets)]
+			ack,
+			close
+		};
+
+		// outgoing connection, waiting for an answer.
+		struct connection final {
+			connection(boost::asio::io_service& io_service, const boost::asio::ip::address& address_, unsigned short port_,
+			           std::function<void(detail::optional<peer>&&)>&& handler_)
+					: address(address_)
+					, port(port_)
+					, handler(std::move(handler_))
+					, retry(io_service)
+					, deadline()
+			{}
+
+			const boost::asio::ip::address address;
+			const unsigned short port;
+			std::function<void(detail::optional<peer>&&)> handler;
+			boost::asio::steady_timer retry;
+			std::chrono::steady_clock::time_point deadline;
+		};
+
+		static constexpr std::chrono::milliseconds connection_retry_interval{250};
+		static constexpr std::chrono::milliseconds min_rto{20};
+		static constexpr std::chrono::milliseconds max_rto{3000};
+
+		void port(unsigned short port) final;
+
+		void owner(basic_peer_manager<io_manager>* owner) final;
+
+		static boost::asio::ip::udp::socket make_socket(boost::asio::io_service& io_service, unsigned short port);
+
+		boost::asio::ip::udp::endpoint make_endpoint(const boost::asio::ip::address& address, unsigned short port) const;
+
+		void make_id_packet();
+
+		std::vector<uint8_t> handshake_datagram(datagram type) const;
+
+		void receive();
+
+		void process_datagram(const boost::system::error_code& ec, std::size_t length);
+
+		void process_connection_request(std::size_t length);
+
+		void process_connection_answer(std::size_t length);
+
+		// reads the id packet following the protocol ids, returns false if the handshake is malformed.
+		bool read_handshake(std::size_t length, boost::uuids::uuid& uuid, unsigned short& remote_port);
+
+		void process_reliable(peer& p, std::size_t length);
+
+		void process_ack(peer& p, std::size_t length);
+
+		void process_stream(peer& p);
+
+		void send_frame(const data_type& io_data, commands command, const std::vector<uint8_t>& payload, delivery d) const;
+
+		void send_reliable(const data_type& io_data, commands command, const std::vector<uint8_t>& payload) const;
+
+		void transmit(const data_type& io_data) const;
+
+		void send_datagram(io_manager_data& io_data, const uint8_t* data, std::size_t size) const;
+
+		void send_control(io_manager_data& io_data, datagram type) const;
+
+		void update_rto(io_manager_data& io_data, std::chrono::steady_clock::duration sample) const;
+
+		// sends the lost datagrams again, and shrinks the congestion window.
+		void retransmit(const data_type& io_data, bool timeout) const;
+
+		void arm_timer(const data_type& io_data, std::chrono::steady_clock::time_point deadline) const;
+
+		void peer_timer(const data_type& io_data, const boost::system::error_code& ec) const;
+
+		void retry_connection(const boost::asio::ip::udp::endpoint& endpoint, const boost::system::error_code& ec);
+
+		void connection_done(const boost::asio::ip::udp::endpoint& endpoint, detail::optional<peer>&& result);
+
+		// forgets about the peer, and tells the peer_manager it disconnected.
+		void lose_peer(peer& p) const;
+
+		basic_peer_manager<io_manager>* m_owner;
+		mutable boost::asio::io_service m_io_service;
+		mutable boost::asio::ip::udp::socket m_socket;
+
+		std::string m_id_packet;
+
+		std::array<uint8_t, std::numeric_limits<uint16_t>::max()> m_receive_buffer;
+		boost::asio::ip::udp::endpoint m_sender;
+
+		// connected peers, by endpoint.
+		mutable std::map<boost::asio::ip::udp::endpoint, peer> m_peers;
+		std::map<boost::asio::ip::udp::endpoint, std::unique_ptr<connection>> m_connections;
+
+		std::atomic<delivery> m_user_data_delivery;
+		std::chrono::milliseconds m_handshake_timeout;
+		// frames announced as bigger than this are refused
+		std::size_t m_max_frame_size;
+		mutable io_statistics m_statistics;
+
+		friend class detail::peer_manager_attorney<io_manager>;
+	};
+}} // namespace breep::udp
+
+#include "breep/network/udp/impl/basic_io_manager.tcc"
+
+#endif //BREEP_NETWORK_UDP_BASIC_IO_MANAGER_HPP
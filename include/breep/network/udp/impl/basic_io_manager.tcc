@@ -0,0 +1,832 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "breep/network/udp/basic_io_manager.hpp" // allows my IDE to work
+
+#include <vector>
+#include <limits>
+#include <array>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <iterator>
+#include <boost/asio.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include "breep/network/detail/utils.hpp"
+#include "breep/network/basic_peer_manager.hpp"
+#include "breep/network/basic_peer.hpp"
+#include "breep/util/exceptions.hpp"
+
+
+/**
+ * @file basic_io_manager.tcc
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+
+template <unsigned int T, unsigned long U, unsigned long V>
+breep::udp::basic_io_manager<T,U,V>::basic_io_manager(unsigned short port)
+		: m_owner(nullptr)
+		, m_io_service{}
+		, m_socket(make_socket(m_io_service, port))
+		, m_id_packet()
+		, m_receive_buffer{}
+		, m_sender()
+		, m_peers()
+		, m_connections()
+		, m_user_data_delivery(delivery::reliable_ordered)
+		, m_handshake_timeout(5000)
+		, m_max_frame_size(detail::default_max_frame_size)
+		, m_statistics()
+{
+	static_assert(U < V, "Keep-alives must be sent more often than the timeout.");
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+breep::udp::basic_io_manager<T,U,V>::basic_io_manager(io_manager&& other) noexcept
+		: m_owner(other.m_owner)
+		, m_io_service()
+		, m_socket(m_io_service)
+		, m_id_packet(std::move(other.m_id_packet))
+		, m_receive_buffer{}
+		, m_sender()
+		, m_peers()
+		, m_connections()
+		, m_user_data_delivery(other.m_user_data_delivery.load())
+		, m_handshake_timeout(other.m_handshake_timeout)
+		, m_max_frame_size(other.m_max_frame_size)
+		, m_statistics()
+{
+	// the socket belongs to the other io_service: a new one is bound to the same port.
+	unsigned short port = other.m_socket.local_endpoint().port();
+	other.m_socket.close();
+	other.m_io_service.stop();
+	m_socket = make_socket(m_io_service, port);
+	if (m_owner != nullptr) {
+		receive();
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+breep::udp::basic_io_manager<T,U,V>::~basic_io_manager() {
+	boost::system::error_code ec;
+	m_socket.close(ec);
+	m_io_service.stop();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+template <typename Container>
+inline void breep::udp::basic_io_manager<T,U,V>::send(commands command, const Container& container, const peer& peer, send_priority priority) const {
+	send(command, container.cbegin(), container.size(), peer, priority);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+template <typename InputIterator, typename size_type>
+inline void breep::udp::basic_io_manager<T,U,V>::send(commands command, InputIterator begin, size_type size, const peer& peer, send_priority priority) const {
+	std::vector<uint8_t> payload;
+	payload.reserve(static_cast<std::size_t>(size));
+	std::copy_n(begin, size, std::back_inserter(payload));
+	send(command, std::move(payload), peer, priority);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::send(commands command, std::vector<uint8_t>&& data, const peer& peer, send_priority /*priority*/) const {
+	if (!peer.io_data || peer.io_data->disconnected) {
+		return;
+	}
+
+	delivery d = delivery::reliable_ordered;
+	if (command == commands::send_to || command == commands::send_to_all) {
+		const delivery* scoped = delivery_scope::current();
+		d = scoped != nullptr ? *scoped : m_user_data_delivery.load();
+	}
+
+	data_type io_data = peer.io_data;
+	m_io_service.post([this, io_data, command, d, payload = std::move(data)]() {
+		if (!io_data->disconnected) {
+			send_frame(io_data, command, payload, d);
+		}
+	});
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+auto breep::udp::basic_io_manager<T,U,V>::connect(const boost::asio::ip::address& address, unsigned short port) -> detail::optional<peer> {
+	// The network is not running yet: the connection is driven from the calling thread.
+	detail::optional<peer> result;
+	bool done = false;
+
+	m_io_service.reset();
+	async_connect(address, port, [&result, &done](detail::optional<peer>&& p) {
+		if (p) {
+			result.emplace(std::move(*p));
+		}
+		done = true;
+	});
+	while (!done && m_io_service.run_one()) {}
+	return result;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::async_connect(const boost::asio::ip::address& address, unsigned short port,
+                                                         std::function<void(detail::optional<peer>&&)> handler) {
+	boost::asio::ip::udp::endpoint endpoint = make_endpoint(address, port);
+	if (m_connections.count(endpoint)) {
+		breep::logger<io_manager>.debug("Already connecting to [" + address.to_string() + "]:" + std::to_string(port));
+		handler({});
+		return;
+	}
+
+	auto co = std::make_unique<connection>(m_io_service, address, port, std::move(handler));
+	co->deadline = std::chrono::steady_clock::now() + m_handshake_timeout;
+	m_connections.emplace(endpoint, std::move(co));
+	retry_connection(endpoint, {});
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_connected_peer(peer& peer) {
+	data_type io_data = peer.io_data;
+	m_peers.erase(io_data->endpoint);
+	m_peers.emplace(io_data->endpoint, peer);
+
+	if (io_data->waiting_acceptance_answer) {
+		io_data->waiting_acceptance_answer = false;
+		std::vector<uint8_t> answer = handshake_datagram(datagram::connect_accept);
+		send_datagram(*io_data, answer.data(), answer.size());
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	io_data->last_receive = now;
+	arm_timer(io_data, now + std::chrono::milliseconds(U));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_connection_denial(peer& peer) {
+	io_manager_data& io_data = *peer.io_data;
+	if (io_data.waiting_acceptance_answer) {
+		io_data.waiting_acceptance_answer = false;
+		send_control(io_data, datagram::connect_refuse);
+		return;
+	}
+
+	// We connected to it, but do not want it: unless the endpoint is the one of this very peer, that connected to us in the meantime.
+	auto it = m_peers.find(io_data.endpoint);
+	if (it == m_peers.end() || it->second.id() != peer.id()) {
+		send_control(io_data, datagram::close);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+inline void breep::udp::basic_io_manager<T,U,V>::disconnect() {
+	m_io_service.stop();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::disconnect(peer& peer) {
+	if (!peer.io_data || peer.io_data->disconnected.exchange(true)) {
+		return;
+	}
+	data_type io_data = peer.io_data;
+	m_io_service.post([this, io_data]() {
+		send_control(*io_data, datagram::close);
+		boost::system::error_code ec;
+		io_data->timer.cancel(ec);
+		auto it = m_peers.find(io_data->endpoint);
+		if (it != m_peers.end() && it->second.io_data == io_data) {
+			m_peers.erase(it);
+		}
+	});
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::run() {
+	m_io_service.reset();
+	breep::logger<io_manager>.info("The network is now online.");
+
+	m_io_service.run();
+
+	// The peers are then disconnected by the peer_manager, whose closing datagrams are not sent anymore.
+	boost::system::error_code ec;
+	for (auto& pair : m_peers) {
+		send_control(*pair.second.io_data, datagram::close);
+		pair.second.io_data->timer.cancel(ec);
+	}
+	m_peers.clear();
+	for (auto& pair : m_connections) {
+		pair.second->retry.cancel(ec);
+	}
+	m_connections.clear();
+
+	breep::logger<io_manager>.info("The network is now offline.");
+}
+
+/* PRIVATE */
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::port(unsigned short port) {
+	make_id_packet();
+
+	boost::system::error_code ec;
+	m_socket.close(ec);
+	m_socket = make_socket(m_io_service, port);
+	receive();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::owner(basic_peer_manager<io_manager>* owner) {
+	if (m_owner == nullptr) {
+		m_owner = owner;
+		make_id_packet();
+		receive();
+	} else {
+		throw invalid_state("Tried to set an already set owner. This object shouldn't be shared.");
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+boost::asio::ip::udp::socket breep::udp::basic_io_manager<T,U,V>::make_socket(boost::asio::io_service& io_service, unsigned short port) {
+	boost::asio::ip::udp::socket socket(io_service);
+	boost::asio::ip::udp protocol = boost::asio::ip::udp::v6();
+	boost::system::error_code ec;
+	socket.open(protocol, ec);
+	if (!ec) {
+		socket.set_option(boost::asio::ip::v6_only(false), ec);
+	}
+	if (ec) {
+		// no dual stack socket: IPv4 only.
+		breep::logger<io_manager>.debug("Could not open a dual stack socket (" + ec.message() + ")");
+		socket.close(ec);
+		protocol = boost::asio::ip::udp::v4();
+		socket.open(protocol);
+	}
+	socket.bind(boost::asio::ip::udp::endpoint(protocol, port));
+	socket.non_blocking(true);
+	return socket;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+boost::asio::ip::udp::endpoint breep::udp::basic_io_manager<T,U,V>::make_endpoint(const boost::asio::ip::address& address, unsigned short port) const {
+	boost::system::error_code ec;
+	bool v6_socket = m_socket.local_endpoint(ec).address().is_v6();
+	if (v6_socket && address.is_v4()) {
+		return {boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped, address.to_v4()), port};
+	}
+	if (!v6_socket && address.is_v6() && address.to_v6().is_v4_mapped()) {
+		return {boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, address.to_v6()), port};
+	}
+	return {address, port};
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::make_id_packet() {
+	m_id_packet.clear();
+	m_id_packet.resize(3, 0);
+	detail::make_little_endian(detail::unowning_linear_container(m_owner->self().id().data), m_id_packet);
+
+	m_id_packet[0] = static_cast<uint8_t>(m_id_packet.size() - 1);
+	m_id_packet[1] = static_cast<uint8_t>(m_owner->port() >> 8) & std::numeric_limits<uint8_t>::max();
+	m_id_packet[2] = static_cast<uint8_t>(m_owner->port() & std::numeric_limits<uint8_t>::max());
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+std::vector<uint8_t> breep::udp::basic_io_manager<T,U,V>::handshake_datagram(datagram type) const {
+	std::vector<uint8_t> data;
+	data.reserve(1 + 2 * sizeof(uint32_t) + m_id_packet.size());
+	data.push_back(static_cast<uint8_t>(type));
+	detail::insert_uint32(data, IO_PROTOCOL_ID_1);
+	detail::insert_uint32(data, IO_PROTOCOL_ID_2);
+	data.insert(data.end(), m_id_packet.cbegin(), m_id_packet.cend());
+	return data;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+inline void breep::udp::basic_io_manager<T,U,V>::receive() {
+	m_socket.async_receive_from(boost::asio::buffer(m_receive_buffer), m_sender,
+	                            [this](const boost::system::error_code& ec, std::size_t length) {
+		process_datagram(ec, length);
+	});
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_datagram(const boost::system::error_code& ec, std::size_t length) {
+	if (ec == boost::asio::error::operation_aborted) {
+		// socket closed
+		return;
+	}
+	if (ec) {
+		breep::logger<io_manager>.debug("Failed to receive a datagram (" + ec.message() + ")");
+		receive();
+		return;
+	}
+	if (length == 0) {
+		receive();
+		return;
+	}
+	++m_statistics.datagrams_received;
+
+	const datagram type = static_cast<datagram>(m_receive_buffer[0]);
+	if (type == datagram::connect_request) {
+		process_connection_request(length);
+		receive();
+		return;
+	}
+	if (type == datagram::connect_accept || type == datagram::connect_refuse) {
+		process_connection_answer(length);
+		receive();
+		return;
+	}
+
+	auto it = m_peers.find(m_sender);
+	if (it == m_peers.end() || it->second.io_data->disconnected) {
+		breep::logger<io_manager>.trace("Ignoring a datagram from an unknown peer.");
+		receive();
+		return;
+	}
+	peer& p = it->second;
+	p.io_data->last_receive = std::chrono::steady_clock::now();
+
+	switch (type) {
+		case datagram::reliable:
+			process_reliable(p, length);
+			break;
+		case datagram::unreliable:
+			if (length >= 2) {
+				detail::peer_manager_attorney<io_manager>::data_received(*m_owner, p, static_cast<commands>(m_receive_buffer[1]),
+				                                                         detail::unowning_linear_container(m_receive_buffer.data() + 2, length - 2));
+			}
+			break;
+		case datagram::ack:
+			process_ack(p, length);
+			break;
+		case datagram::close:
+			breep::logger<io_manager>.debug("Peer " + p.id_as_string() + " closed the connection.");
+			lose_peer(p);
+			break;
+		default:
+			breep::logger<io_manager>.warning("Received an unknown datagram type from " + p.id_as_string() + ".");
+			break;
+	}
+	receive();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+bool breep::udp::basic_io_manager<T,U,V>::read_handshake(std::size_t length, boost::uuids::uuid& uuid, unsigned short& remote_port) {
+	constexpr std::size_t id_offset = 1 + 2 * sizeof(uint32_t);
+	if (length < id_offset + 4) {
+		return false;
+	}
+
+	if (detail::read_uint32(m_receive_buffer, 1) != IO_PROTOCOL_ID_1 || detail::read_uint32(m_receive_buffer, 1 + sizeof(uint32_t)) != IO_PROTOCOL_ID_2) {
+		breep::logger<io_manager>.warning("Received a connection from an incompatible peer (" + m_sender.address().to_string() + ").");
+		breep::logger<io_manager>.warning("Our protocol ID: " + std::to_string(IO_PROTOCOL_ID_1) + " " +
+		                                  std::to_string(IO_PROTOCOL_ID_2) + ". Their protocol ID: "
+		                                  + std::to_string(detail::read_uint32(m_receive_buffer, 1)) + " "
+		                                  + std::to_string(detail::read_uint32(m_receive_buffer, 1 + sizeof(uint32_t))) + ".");
+		return false;
+	}
+
+	const uint8_t* id_packet = m_receive_buffer.data() + id_offset;
+	if (id_packet[0] < 3 || static_cast<std::size_t>(id_packet[0]) + 1 != length - id_offset) {
+		return false;
+	}
+	remote_port = static_cast<unsigned short>(id_packet[1] << 8 | id_packet[2]);
+
+	std::string input;
+	detail::unmake_little_endian(detail::unowning_linear_container(id_packet + 3, id_packet[0] - 2u), input);
+	if (input.size() != uuid.size()) {
+		return false;
+	}
+	std::copy(input.data(), input.data() + input.size(), uuid.data);
+	return true;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_connection_request(std::size_t length) {
+	boost::uuids::uuid uuid;
+	unsigned short remote_port;
+	if (!read_handshake(length, uuid, remote_port)) {
+		std::array<uint8_t, 1> refuse{{static_cast<uint8_t>(datagram::connect_refuse)}};
+		boost::system::error_code ec;
+		m_socket.send_to(boost::asio::buffer(refuse), m_sender, 0, ec);
+		return;
+	}
+
+	auto it = m_peers.find(m_sender);
+	if (it != m_peers.end()) {
+		if (it->second.id() == uuid) {
+			// our answer was lost.
+			std::vector<uint8_t> answer = handshake_datagram(datagram::connect_accept);
+			send_datagram(*it->second.io_data, answer.data(), answer.size());
+			return;
+		}
+		// the peer was restarted on the same endpoint.
+		lose_peer(it->second);
+	}
+
+	breep::logger<io_manager>.trace("Connection request from " + m_sender.address().to_string());
+	detail::peer_manager_attorney<io_manager>::peer_connected(*m_owner, peer(
+			uuid,
+			m_sender.address(),
+			remote_port,
+			std::make_shared<io_manager_data>(m_sender, m_io_service, true)
+	));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_connection_answer(std::size_t length) {
+	auto it = m_connections.find(m_sender);
+	if (it == m_connections.end()) {
+		// answer to a request that was already answered.
+		return;
+	}
+
+	if (static_cast<datagram>(m_receive_buffer[0]) == datagram::connect_refuse) {
+		breep::logger<io_manager>.info("Connection refused ([" + it->second->address.to_string() + "]:" + std::to_string(it->second->port) + ")");
+		connection_done(m_sender, {});
+		return;
+	}
+
+	boost::uuids::uuid uuid;
+	unsigned short remote_port;
+	if (!read_handshake(length, uuid, remote_port)) {
+		connection_done(m_sender, {});
+		return;
+	}
+
+	connection_done(m_sender, peer(
+			uuid,
+			it->second->address,
+			remote_port,
+			std::make_shared<io_manager_data>(m_sender, m_io_service)
+	));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::retry_connection(const boost::asio::ip::udp::endpoint& endpoint, const boost::system::error_code& ec) {
+	if (ec == boost::asio::error::operation_aborted) {
+		return;
+	}
+	auto it = m_connections.find(endpoint);
+	if (it == m_connections.end()) {
+		return;
+	}
+
+	connection& co = *it->second;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now >= co.deadline) {
+		breep::logger<io_manager>.warning("Connection to [" + co.address.to_string() + "]:" + std::to_string(co.port) + " timed out.");
+		connection_done(endpoint, {});
+		return;
+	}
+
+	std::vector<uint8_t> request = handshake_datagram(datagram::connect_request);
+	boost::system::error_code send_ec;
+	m_socket.send_to(boost::asio::buffer(request), endpoint, 0, send_ec);
+	if (send_ec) {
+		breep::logger<io_manager>.debug("Failed to send a connection request (" + send_ec.message() + ")");
+	} else {
+		++m_statistics.datagrams_sent;
+	}
+
+	co.retry.expires_at(std::min(now + connection_retry_interval, co.deadline));
+	co.retry.async_wait([this, endpoint](const boost::system::error_code& error) {
+		retry_connection(endpoint, error);
+	});
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::connection_done(const boost::asio::ip::udp::endpoint& endpoint, detail::optional<peer>&& result) {
+	auto it = m_connections.find(endpoint);
+	std::unique_ptr<connection> co = std::move(it->second);
+	m_connections.erase(it);
+
+	boost::system::error_code ec;
+	co->retry.cancel(ec);
+	co->handler(std::move(result));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_reliable(peer& p, std::size_t length) {
+	if (length < segment_header_size) {
+		return;
+	}
+	io_manager_data& io_data = *p.io_data;
+	const uint32_t seq = detail::read_uint32(m_receive_buffer, 1);
+	const uint8_t* data = m_receive_buffer.data() + segment_header_size;
+	const std::size_t size = length - segment_header_size;
+
+	const int32_t distance = static_cast<int32_t>(seq - io_data.expected_seq);
+	bool progressed = false;
+	if (distance == 0) {
+		io_data.stream.insert(io_data.stream.end(), data, data + size);
+		++io_data.expected_seq;
+		for (auto it = io_data.out_of_order.find(io_data.expected_seq) ; it != io_data.out_of_order.end() ; it = io_data.out_of_order.find(io_data.expected_seq)) {
+			io_data.stream.insert(io_data.stream.end(), it->second.cbegin(), it->second.cend());
+			io_data.out_of_order.erase(it);
+			++io_data.expected_seq;
+		}
+		progressed = true;
+	} else if (distance > 0 && static_cast<std::size_t>(distance) < window_size) {
+		io_data.out_of_order.emplace(seq, std::vector<uint8_t>(data, data + size));
+	}
+
+	// Acknowledging everything received in order so far, duplicates included (our previous ack may have been lost).
+	std::array<uint8_t, 1 + sizeof(uint32_t)> ack;
+	ack[0] = static_cast<uint8_t>(datagram::ack);
+	ack[1] = static_cast<uint8_t>(io_data.expected_seq >> 24);
+	ack[2] = static_cast<uint8_t>(io_data.expected_seq >> 16);
+	ack[3] = static_cast<uint8_t>(io_data.expected_seq >> 8);
+	ack[4] = static_cast<uint8_t>(io_data.expected_seq);
+	send_datagram(io_data, ack.data(), ack.size());
+
+	if (progressed) {
+		process_stream(p);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_stream(peer& p) {
+	// p may be erased by the handlers: the state is kept alive, and p is not used once the peer is disconnected.
+	data_type io_data = p.io_data;
+	std::vector<uint8_t>& stream = io_data->stream;
+
+	std::size_t position = 0;
+	while (stream.size() - position >= 2) {
+		uint64_t size;
+		std::size_t varint_size = detail::read_varint(stream.data() + position + 1, stream.size() - position - 1, size);
+		if (varint_size > detail::max_varint_size) {
+			breep::logger<io_manager>.warning("Received a malformed frame from " + p.id_as_string() + ".");
+			send_control(*io_data, datagram::close);
+			lose_peer(p);
+			return;
+		}
+		if (varint_size == 0) {
+			break;
+		}
+		if (size > m_max_frame_size) {
+			breep::logger<io_manager>.warning("Received a frame of " + std::to_string(size) + " octets from " + p.id_as_string()
+			                                  + " (maximum: " + std::to_string(m_max_frame_size) + "). Disconnecting.");
+			send_control(*io_data, datagram::close);
+			lose_peer(p);
+			return;
+		}
+		if (stream.size() - position - 1 - varint_size < size) {
+			break;
+		}
+
+		const commands command = static_cast<commands>(stream[position]);
+		const uint8_t* frame = stream.data() + position + 1 + varint_size;
+		position += 1 + varint_size + static_cast<std::size_t>(size);
+
+		detail::peer_manager_attorney<io_manager>::data_received(*m_owner, p, command,
+		                                                         detail::unowning_linear_container(frame, static_cast<std::size_t>(size)));
+		if (io_data->disconnected) {
+			return;
+		}
+	}
+	stream.erase(stream.begin(), stream.begin() + position);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::process_ack(peer& p, std::size_t length) {
+	if (length != 1 + sizeof(uint32_t)) {
+		return;
+	}
+	const data_type& io_data = p.io_data;
+	const uint32_t next = detail::read_uint32(m_receive_buffer, 1);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	std::size_t acknowledged = 0;
+	while (io_data->transmitted > 0 && static_cast<int32_t>(io_data->unacked.front().seq - next) < 0) {
+		const segment& s = io_data->unacked.front();
+		// Karn's rule: retransmitted segments do not give an RTT sample.
+		if (s.transmissions == 1) {
+			update_rto(*io_data, now - s.sent_at);
+		}
+		io_data->unacked.pop_front();
+		--io_data->transmitted;
+		++acknowledged;
+	}
+
+	if (acknowledged > 0) {
+		io_data->duplicate_acks = 0;
+		// the window only grows again once the losses are recovered from.
+		if (!io_data->recovering || static_cast<int32_t>(next - io_data->recover) >= 0) {
+			io_data->recovering = false;
+			// slow start, then one more datagram per window acknowledged.
+			if (io_data->cwnd < io_data->ssthresh) {
+				io_data->cwnd += acknowledged;
+			} else if ((io_data->cwnd_credit += acknowledged) >= io_data->cwnd) {
+				io_data->cwnd_credit = 0;
+				++io_data->cwnd;
+			}
+			io_data->cwnd = std::min(io_data->cwnd, window_size);
+		}
+		transmit(io_data);
+	} else if (next == io_data->last_ack && io_data->transmitted > 0 && ++io_data->duplicate_acks == 3) {
+		// fast retransmit: the datagrams following the first unacknowledged one are arriving.
+		retransmit(io_data, false);
+	}
+	io_data->last_ack = next;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::update_rto(io_manager_data& io_data, std::chrono::steady_clock::duration sample) const {
+	// RFC 6298
+	if (!io_data.has_rtt) {
+		io_data.srtt = sample;
+		io_data.rttvar = sample / 2;
+		io_data.has_rtt = true;
+	} else {
+		std::chrono::steady_clock::duration delta = io_data.srtt > sample ? io_data.srtt - sample : sample - io_data.srtt;
+		io_data.rttvar = (3 * io_data.rttvar + delta) / 4;
+		io_data.srtt = (7 * io_data.srtt + sample) / 8;
+	}
+	io_data.rto = std::min<std::chrono::steady_clock::duration>(
+			std::max<std::chrono::steady_clock::duration>(io_data.srtt + 4 * io_data.rttvar, min_rto), max_rto);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::retransmit(const data_type& io_data, bool timeout) const {
+	if (!io_data->recovering || timeout) {
+		io_data->ssthresh = std::max<std::size_t>(io_data->transmitted / 2, 2);
+		io_data->cwnd = timeout ? 2 : io_data->ssthresh;
+		io_data->cwnd_credit = 0;
+		io_data->recovering = true;
+		io_data->recover = io_data->next_seq;
+	}
+
+	if (timeout) {
+		// Whatever is in flight is considered lost, and sent again as the window opens.
+		io_data->rto = std::min<std::chrono::steady_clock::duration>(2 * io_data->rto, max_rto);
+		io_data->transmitted = 0;
+		transmit(io_data);
+	} else {
+		segment& s = io_data->unacked.front();
+		send_datagram(*io_data, s.datagram.data(), s.datagram.size());
+		s.sent_at = std::chrono::steady_clock::now();
+		++s.transmissions;
+		++m_statistics.retransmissions;
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::send_frame(const data_type& io_data, commands command, const std::vector<uint8_t>& payload, delivery d) const {
+	if (d == delivery::unreliable_unordered) {
+		if (2 + payload.size() <= T) {
+			std::vector<uint8_t> data;
+			data.reserve(2 + payload.size());
+			data.push_back(static_cast<uint8_t>(datagram::unreliable));
+			data.push_back(static_cast<uint8_t>(command));
+			data.insert(data.end(), payload.cbegin(), payload.cend());
+			send_datagram(*io_data, data.data(), data.size());
+			++m_statistics.unreliable_frames_sent;
+			return;
+		}
+		++m_statistics.unreliable_frames_too_big;
+	}
+	send_reliable(io_data, command, payload);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::send_reliable(const data_type& io_data, commands command, const std::vector<uint8_t>& payload) const {
+	// [command][payload size (varint)][payload], cut in datagrams.
+	std::array<uint8_t, 1 + detail::max_varint_size> header;
+	header[0] = static_cast<uint8_t>(command);
+	const std::size_t header_size = 1 + detail::write_varint(header.data() + 1, payload.size());
+	const std::size_t total = header_size + payload.size();
+	constexpr std::size_t max_chunk = T - segment_header_size;
+
+	std::size_t offset = 0;
+	while (offset < total) {
+		const std::size_t chunk = std::min(max_chunk, total - offset);
+		segment s{io_data->next_seq++, {}, {}, 0};
+		s.datagram.reserve(segment_header_size + chunk);
+		s.datagram.push_back(static_cast<uint8_t>(datagram::reliable));
+		detail::insert_uint32(s.datagram, s.seq);
+
+		const std::size_t end = offset + chunk;
+		if (offset < header_size) {
+			s.datagram.insert(s.datagram.end(), header.cbegin() + offset, header.cbegin() + std::min(end, header_size));
+		}
+		if (end > header_size) {
+			const std::size_t from = std::max(offset, header_size) - header_size;
+			s.datagram.insert(s.datagram.end(), payload.cbegin() + from, payload.cbegin() + (end - header_size));
+		}
+		offset = end;
+		io_data->unacked.push_back(std::move(s));
+	}
+	transmit(io_data);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::transmit(const data_type& io_data) const {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	while (io_data->transmitted < io_data->unacked.size() && io_data->transmitted < io_data->cwnd) {
+		segment& s = io_data->unacked[io_data->transmitted++];
+		send_datagram(*io_data, s.datagram.data(), s.datagram.size());
+		s.sent_at = now;
+		if (s.transmissions++ > 0) {
+			++m_statistics.retransmissions;
+		}
+	}
+	if (io_data->transmitted > 0) {
+		arm_timer(io_data, io_data->unacked.front().sent_at + io_data->rto);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::send_datagram(io_manager_data& io_data, const uint8_t* data, std::size_t size) const {
+	boost::system::error_code ec;
+	m_socket.send_to(boost::asio::buffer(data, size), io_data.endpoint, 0, ec);
+	if (ec) {
+		// lost, as it could have been on the way.
+		breep::logger<io_manager>.debug("Failed to send a datagram (" + ec.message() + ")");
+		return;
+	}
+	++m_statistics.datagrams_sent;
+	io_data.last_send = std::chrono::steady_clock::now();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+inline void breep::udp::basic_io_manager<T,U,V>::send_control(io_manager_data& io_data, datagram type) const {
+	const uint8_t data = static_cast<uint8_t>(type);
+	send_datagram(io_data, &data, 1);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::arm_timer(const data_type& io_data, std::chrono::steady_clock::time_point deadline) const {
+	if (io_data->timer_armed && io_data->timer_deadline <= deadline) {
+		return;
+	}
+	io_data->timer_armed = true;
+	io_data->timer_deadline = deadline;
+	io_data->timer.expires_at(deadline);
+	io_data->timer.async_wait([this, io_data](const boost::system::error_code& ec) {
+		peer_timer(io_data, ec);
+	});
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::peer_timer(const data_type& io_data, const boost::system::error_code& ec) const {
+	if (ec == boost::asio::error::operation_aborted || io_data->disconnected) {
+		return;
+	}
+	io_data->timer_armed = false;
+
+	auto it = m_peers.find(io_data->endpoint);
+	if (it == m_peers.end() || it->second.io_data != io_data) {
+		return;
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - io_data->last_receive >= std::chrono::milliseconds(V)) {
+		breep::logger<io_manager>.info("Timeout of peer " + it->second.id_as_string() + ".");
+		send_control(*io_data, datagram::close);
+		lose_peer(it->second);
+		return;
+	}
+
+	if (io_data->transmitted > 0) {
+		if (now >= io_data->unacked.front().sent_at + io_data->rto) {
+			retransmit(io_data, true);
+		}
+	}
+
+	if (now - io_data->last_send >= std::chrono::milliseconds(U)) {
+		std::array<uint8_t, 2> keep_alive{{static_cast<uint8_t>(datagram::unreliable), static_cast<uint8_t>(commands::keep_alive)}};
+		send_datagram(*io_data, keep_alive.data(), keep_alive.size());
+		++m_statistics.keep_alives_sent;
+	}
+
+	std::chrono::steady_clock::time_point deadline = std::min(io_data->last_receive + std::chrono::milliseconds(V),
+	                                                          io_data->last_send + std::chrono::milliseconds(U));
+	if (io_data->transmitted > 0) {
+		deadline = std::min(deadline, io_data->unacked.front().sent_at + io_data->rto);
+	}
+	arm_timer(io_data, deadline);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::udp::basic_io_manager<T,U,V>::lose_peer(peer& p) const {
+	data_type io_data = p.io_data;
+	if (io_data->disconnected.exchange(true)) {
+		return;
+	}
+	boost::system::error_code ec;
+	io_data->timer.cancel(ec);
+
+	peer lost(p);
+	m_peers.erase(io_data->endpoint);
+	detail::peer_manager_attorney<io_manager>::peer_disconnected(*m_owner, lost);
+}
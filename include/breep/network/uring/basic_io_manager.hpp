@@ -0,0 +1,536 @@
+#ifndef BREEP_NETWORK_URING_BASIC_IO_MANAGER_HPP
+#define BREEP_NETWORK_URING_BASIC_IO_MANAGER_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file uring/basic_io_manager.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <array>
+#include <string>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "breep/network/io_manager_base.hpp"
+#include "breep/network/typedefs.hpp"
+#include "breep/util/exceptions.hpp"
+#include "breep/network/detail/commands.hpp"
+#include "breep/network/detail/buffer_pool.hpp"
+#include "breep/network/detail/mpsc_queue.hpp"
+#include "breep/network/detail/compression.hpp"
+#include "breep/network/tcp/basic_io_manager.hpp"
+#include "breep/network/uring/ring.hpp"
+
+
+namespace breep {
+	template <typename T>
+	class basic_peer_manager;
+
+	namespace detail {
+		template <typename T>
+		class peer_manager_attorney;
+	}
+}
+
+namespace breep { namespace uring {
+
+	/**
+	 * State of a peer, as kept by the io_manager.
+	 * Apart from the fd (guarded by fd_mutex) and disconnected, it is only accessed from the network thread.
+	 */
+	struct io_manager_data final {
+
+		explicit io_manager_data(int fd_, bool waiting_acceptance_ans = false)
+				: fd(fd_)
+				, waiting_acceptance_answer(waiting_acceptance_ans)
+		{}
+
+		io_manager_data(const io_manager_data&) = delete;
+		io_manager_data& operator=(const io_manager_data&) = delete;
+
+		~io_manager_data() {
+			if (fd >= 0) {
+				::close(fd);
+			}
+		}
+
+		/**
+		 * @brief Shuts the socket down: the pending receive then reports the disconnection. May be called from any thread.
+		 */
+		void shutdown() {
+			std::lock_guard<std::mutex> lock(fd_mutex);
+			if (fd >= 0) {
+				::shutdown(fd, SHUT_RDWR);
+			}
+		}
+
+		std::mutex fd_mutex{};
+		int fd;
+		// true for peers that connected to us, until the connection is accepted or refused.
+		bool waiting_acceptance_answer;
+		std::atomic<bool> disconnected{false};
+
+		// key of the peer in the io_manager, set once it is connected.
+		uint64_t id{0};
+
+		// beginning of the frame being received.
+		std::vector<uint8_t> stream{};
+		bool receiving{false};
+		// a malformed frame was received: the rest is ignored.
+		bool broken{false};
+		// the receive ended, and the disconnection was reported.
+		bool closed{false};
+
+		bool waiting() const {
+			return std::any_of(lanes.cbegin(), lanes.cend(), [](const std::deque<tcp::output_frame>& lane) { return !lane.empty(); });
+		}
+
+		// frames taken from the lanes to be sent. The first in_flight of them are being sent, minus the first sent_offset octets.
+		std::deque<tcp::output_frame> queue{};
+		// frames waiting to be sent, by send_priority
+		std::array<std::deque<tcp::output_frame>, send_priority_count> lanes{};
+		std::size_t in_flight{0};
+		std::size_t sent_offset{0};
+		bool sending{false};
+		// a send is to be issued on the next turn of the event loop.
+		bool dirty{false};
+		std::vector<iovec> iovecs{};
+		msghdr message{};
+
+		std::chrono::steady_clock::time_point last_receive{};
+		std::chrono::steady_clock::time_point last_send{};
+
+		// codec agreed on during the handshake, nullptr if the frames exchanged with the peer are not compressed.
+		std::shared_ptr<const codec> link_codec{};
+		// payload of the last compressed frame received, once decompressed.
+		std::vector<uint8_t> decompressed{};
+		detail::compression_counters compression{};
+	};
+
+	/**
+	 * Counters updated by the io_manager. They may be read from any thread.
+	 */
+	struct io_statistics final {
+		// number of io_uring_enter system calls
+		std::atomic<uint64_t> enters{0};
+		// number of operations submitted
+		std::atomic<uint64_t> submissions{0};
+		// highest number of operations submitted by a single io_uring_enter
+		std::atomic<uint64_t> max_submissions_per_enter{0};
+		// number of (gathered) sends issued
+		std::atomic<uint64_t> sends{0};
+		// number of frames sent
+		std::atomic<uint64_t> frames_written{0};
+		// number of octets sent (headers included)
+		std::atomic<uint64_t> octets_written{0};
+		// number of receive completions
+		std::atomic<uint64_t> receives{0};
+		// number of keep_alive frames sent
+		std::atomic<uint64_t> keep_alives_sent{0};
+	};
+
+	/**
+	 * @brief io_uring network_manager implementation (Linux 6.0 or later)
+	 * @details Speaks the same protocol as tcp::basic_io_manager, so that both may be part of the same network.
+	 *          A single network thread owns an io_uring instance: connections are accepted with a multishot accept,
+	 *          and each peer has a multishot receive picking its buffers from a ring of buffers registered to the
+	 *          kernel. Data sent from any thread is queued to the network thread through a lock-free queue; the
+	 *          frames queued for a peer are then sent with a single gathered send. On each loop, every send and
+	 *          receive prepared for all the peers is submitted, and completions are waited for, with a single
+	 *          io_uring_enter.
+	 *
+	 * @tparam BUFFER_LENGTH          Length of each receive buffer.
+	 * @tparam keep_alive_send_millis Time interval indicating the sending of keep_alive packets frequency (in milliseconds).
+	 * @tparam timeout_millis         Time interval after which a peer should be considered dead if no packets have been received from him (in milliseconds).
+	 *
+	 * @since 1.1.0
+	 */
+	template <unsigned int BUFFER_LENGTH, unsigned long keep_alive_send_millis, unsigned long timeout_millis>
+	class basic_io_manager final: public io_manager_base<basic_io_manager<BUFFER_LENGTH,keep_alive_send_millis,timeout_millis>> {
+	public:
+
+		// Same protocol as tcp::basic_io_manager.
+		static constexpr uint32_t IO_PROTOCOL_ID_1 =  755960664; // UPDATE THIS TOGETHER WITH THE HASHING FUNCTION +1 [util/type_traits.hpp]
+		static constexpr uint32_t IO_PROTOCOL_ID_2 = 1683390702;
+
+		// size of the submission queue.
+		static constexpr unsigned int ring_entries = 1024;
+		// number of receive buffers, shared by every peer.
+		static constexpr unsigned int receive_buffers = 256;
+		// maximum number of frames handed to a single send.
+		static constexpr std::size_t max_send_frames = 512;
+		// octets taken from the send_priority lanes for a single send, unless a single frame is bigger:
+		// higher lanes wait for the send in progress.
+		static constexpr std::size_t max_send_size = 256 * 1024;
+
+		static_assert(BUFFER_LENGTH >= 64, "BUFFER_LENGTH is too small.");
+
+		using io_manager = basic_io_manager<BUFFER_LENGTH, keep_alive_send_millis, timeout_millis>;
+		using peer = basic_peer<io_manager>;
+		using data_type = std::shared_ptr<io_manager_data>;
+
+		/**
+		 * @throws unsupported_system if io_uring or its provided buffer rings are not available.
+		 */
+		explicit basic_io_manager(unsigned short port);
+
+		basic_io_manager(io_manager&& other) noexcept;
+
+		~basic_io_manager() final;
+
+		basic_io_manager(const io_manager&) = delete;
+		io_manager& operator=(const io_manager&) = delete;
+
+		template <typename Container>
+		void send(commands command, const Container& data, const peer& target, send_priority priority = send_priority::normal) const;
+
+		template <typename InputIterator, typename size_type>
+		void send(commands command, InputIterator it, size_type size, const peer& target, send_priority priority = send_priority::normal) const;
+
+		/**
+		 * @brief Sends data to a peer, taking ownership of it (avoids copying the payload).
+		 */
+		void send(commands command, std::vector<uint8_t>&& data, const peer& target, send_priority priority = send_priority::normal) const;
+
+		/**
+		 * @brief Sends data shared with other peers: the queued frame points at it instead of copying it.
+		 */
+		void send_shared(commands command, std::shared_ptr<const std::vector<uint8_t>> data, const peer& target,
+		                 send_priority priority = send_priority::normal) const {
+			m_compression.compress_shared(target.io_data->link_codec.get(), command, data, target.io_data->compression, m_buffer_pool);
+			queue_frame(tcp::output_frame(command, std::move(data)), target, priority);
+		}
+
+		/**
+		 * @brief Releases the compressed form of the last shared payload (see send_shared()): like the payload,
+		 *        it goes back to the pool from whichever thread drops its last reference.
+		 */
+		void end_shared() const {
+			m_compression.end_shared();
+		}
+
+		detail::optional<peer> connect(const boost::asio::ip::address& address, unsigned short port) final;
+
+		/**
+		 * @brief Connects to a peer without blocking the network.
+		 * @details The connection and its handshake are bounded by handshake_timeout().
+		 */
+		void async_connect(const boost::asio::ip::address& address, unsigned short port,
+		                   std::function<void(detail::optional<peer>&&)> handler) final;
+
+		void process_connected_peer(peer& connected) final;
+
+		void process_connection_denial(peer& peer) final;
+
+		void disconnect() final;
+
+		void disconnect(peer& peer) final;
+
+		void run() final;
+
+		void set_log_level(log_level ll) const final {
+			breep::logger<io_manager>.level(ll);
+		}
+
+		/**
+		 * @brief Gives an empty buffer from the pool of recycled buffers.
+		 */
+		std::vector<uint8_t> acquire_buffer(std::size_t size) const {
+			return m_buffer_pool.acquire(size);
+		}
+
+		/**
+		 * @brief Gives a buffer back to the pool.
+		 */
+		void release_buffer(std::vector<uint8_t>&& buffer) const {
+			m_buffer_pool.release(std::move(buffer));
+		}
+
+		/**
+		 * @brief Turns a buffer into a payload for send_shared(), that goes back to the pool once every frame
+		 *        pointing at it was written.
+		 */
+		std::shared_ptr<const std::vector<uint8_t>> share_buffer(std::vector<uint8_t>&& buffer) const {
+			return m_buffer_pool.share(std::move(buffer));
+		}
+
+		/**
+		 * @brief Sets the time a connection is given to complete its handshake.
+		 */
+		void handshake_timeout(std::chrono::milliseconds timeout) {
+			m_handshake_timeout = timeout;
+		}
+
+		std::chrono::milliseconds handshake_timeout() const {
+			return m_handshake_timeout;
+		}
+
+		const io_statistics& statistics() const {
+			return m_statistics;
+		}
+
+		/**
+		 * @brief Compresses the payload of the frames of at least \em threshold octets with \em c
+		 *        (see tcp::basic_io_manager::compression).
+		 * @note Should be set before the network is started.
+		 */
+		void compression(std::shared_ptr<const codec> c, std::size_t threshold = 512) {
+			m_compression.configure(std::move(c), threshold);
+			if (m_owner != nullptr) {
+				make_id_packet();
+			}
+		}
+
+		const std::shared_ptr<const codec>& compression() const {
+			return m_compression.codec();
+		}
+
+		/**
+		 * @return counters about the compression of the frames exchanged with \em p. May be called from any thread.
+		 */
+		breep::compression_statistics compression_statistics(const peer& p) const {
+			return p.io_data ? p.io_data->compression.snapshot() : breep::compression_statistics();
+		}
+
+		/**
+		 * @brief Sets the maximum size of the frames a peer may send (64 MiB by default). Peers announcing a bigger
+		 *        frame are disconnected before anything is allocated for it.
+		 * @note Should be set before the network is started.
+		 *
+		 * @since 1.1.0
+		 */
+		void max_frame_size(std::size_t octets) {
+			m_max_frame_size = octets;
+		}
+
+		/**
+		 * @since 1.1.0
+		 */
+		std::size_t max_frame_size() const {
+			return m_max_frame_size;
+		}
+
+	private:
+
+		// what a completion is about, stored in the upper octet of its user_data.
+		enum class operation : uint8_t {
+			wake = 1,
+			tick,
+			accept,
+			handshake,
+			receive,
+			send,
+			cancel
+		};
+
+		// work handed to the network thread.
+		struct request final {
+			enum class kind : uint8_t {
+				frame,
+				task
+			};
+
+			kind type{kind::frame};
+			data_type target{};
+			tcp::output_frame frame{commands::null_command, std::vector<uint8_t>()};
+			std::size_t lane{0};
+			std::function<void()> task{};
+		};
+
+		// connection being established, in either direction.
+		struct handshake final {
+			enum class step : uint8_t {
+				// outgoing
+				connect,
+				send_protocol_id,
+				read_protocol_id,
+				send_id,
+				read_id_size,
+				read_id,
+				read_answer,
+				// incoming
+				read_remote_protocol_id,
+				send_local_protocol_id,
+				read_remote_id_size,
+				read_remote_id,
+				send_local_id,
+
+				completed
+			};
+
+			handshake(int fd_, step first, const std::string& id_packet_)
+					: fd(fd_)
+					, current(first)
+					, id_packet(id_packet_)
+			{}
+
+			int fd;
+			step current;
+			// octets of the current step already sent or received.
+			std::size_t done{0};
+			std::array<uint8_t, 128> buffer{};
+			uint8_t answer{0};
+			const std::string id_packet;
+			boost::asio::ip::tcp::endpoint endpoint{};
+			// set for outgoing connections.
+			std::function<void(detail::optional<peer>&&)> handler{};
+			std::chrono::steady_clock::time_point deadline{};
+			bool expired{false};
+		};
+
+		static constexpr uint16_t buffer_group = 0;
+		static constexpr long tick_millis = 100;
+		// maximum number of requests handled in a row, before the pending completions get a turn.
+		static constexpr unsigned int max_requests = 4096;
+
+		static uint64_t user_data(operation op, uint64_t id) {
+			return static_cast<uint64_t>(op) << 56 | id;
+		}
+
+		void port(unsigned short port) final;
+
+		void owner(basic_peer_manager<io_manager>* owner) final;
+
+		// creates the ring and the acceptor.
+		void open(unsigned short port);
+
+		void make_id_packet();
+
+		bool in_network_thread() const;
+
+		// queues the frame in the lane of \em priority for user data, and in the control lane otherwise.
+		void queue_frame(tcp::output_frame&& frame, const peer& target, send_priority priority) const;
+
+		void queue_frame_now(const data_type& target, tcp::output_frame&& frame, std::size_t lane) const;
+
+		// runs the task from the network thread.
+		void post(std::function<void()>&& task) const;
+
+		void wake() const;
+
+		// one turn of the event loop.
+		void loop_once();
+
+		// returns true if requests are left.
+		bool process_requests();
+
+		void process_completion(const io_uring_cqe& cqe);
+
+		void arm_wake();
+
+		void arm_tick();
+
+		void arm_accept();
+
+		void arm_receive(io_manager_data& io_data);
+
+		void cancel(uint64_t target);
+
+		void tick();
+
+		void accepted(int fd);
+
+		void start_connection(const boost::asio::ip::address& address, unsigned short port,
+		                      std::function<void(detail::optional<peer>&&)>&& handler);
+
+		void handshake_io(uint64_t id, handshake& hs);
+
+		void handshake_completed(uint64_t id, int result);
+
+		// returns false if the handshake failed.
+		bool handshake_next_step(handshake& hs);
+
+		void handshake_done(uint64_t id);
+
+		void handshake_failed(uint64_t id);
+
+		void issue_send(io_manager_data& io_data);
+
+		void send_completed(uint64_t id, int result);
+
+		void receive_completed(uint64_t id, const io_uring_cqe& cqe);
+
+		void process_received(peer& sender, const uint8_t* data, std::size_t size);
+
+		// breaks the link with \em sender if it announced a frame bigger than m_max_frame_size.
+		bool refuse_frame(peer& sender, uint64_t payload_size);
+
+		// hands a received frame to the owner, decompressing it first if needed. Breaks the link if it is malformed.
+		void dispatch(peer& sender, commands command, const detail::unowning_linear_container& frame);
+
+		// the peer's receive ended: reports the disconnection, and forgets about the peer once nothing is pending.
+		void lose_peer(peer& p);
+
+		void recycle(tcp::output_frame& frame) const;
+
+		// recycles the frames that will not be sent to the peer.
+		void drop_frames(io_manager_data& io_data) const;
+
+		// cancels every pending operation and waits for them, without reporting anything.
+		void quiesce();
+
+		basic_peer_manager<io_manager>* m_owner;
+		boost::asio::io_service m_io_service;
+		std::unique_ptr<ring> m_ring;
+		boost::asio::ip::tcp::acceptor m_acceptor;
+		uint64_t m_acceptor_generation;
+		bool m_accept_armed;
+		int m_wake_fd;
+		uint64_t m_wake_value;
+		__kernel_timespec m_tick;
+
+		std::array<uint8_t, 8> m_protocol_id;
+		std::string m_id_packet;
+
+		// pending operations, multishot ones included.
+		std::size_t m_in_flight;
+		uint64_t m_next_id;
+		// connected peers, by io_manager_data::id.
+		std::unordered_map<uint64_t, peer> m_peers;
+		std::unordered_map<uint64_t, std::unique_ptr<handshake>> m_handshakes;
+		mutable std::vector<data_type> m_dirty;
+
+		mutable detail::mpsc_queue<request> m_requests;
+		mutable std::atomic<bool> m_wake_pending;
+		std::atomic<bool> m_stopped;
+		std::atomic<std::thread::id> m_network_thread;
+
+		std::chrono::milliseconds m_handshake_timeout;
+		mutable detail::buffer_pool m_buffer_pool;
+		mutable io_statistics m_statistics;
+		detail::frame_compressor m_compression;
+		// frames announced as bigger than this are refused
+		std::size_t m_max_frame_size;
+
+		friend class detail::peer_manager_attorney<io_manager>;
+	};
+}} // namespace breep::uring
+
+#include "breep/network/uring/impl/basic_io_manager.tcc"
+
+#endif //BREEP_NETWORK_URING_BASIC_IO_MANAGER_HPP
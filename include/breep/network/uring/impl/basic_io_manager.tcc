@@ -0,0 +1,1178 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#include "breep/network/uring/basic_io_manager.hpp" // allows my IDE to work
+
+#include <vector>
+#include <deque>
+#include <limits>
+#include <array>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+
+#include "breep/network/detail/utils.hpp"
+#include "breep/network/basic_peer_manager.hpp"
+#include "breep/network/basic_peer.hpp"
+#include "breep/util/exceptions.hpp"
+
+
+/**
+ * @file basic_io_manager.tcc
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+
+template <unsigned int T, unsigned long U, unsigned long V>
+breep::uring::basic_io_manager<T,U,V>::basic_io_manager(unsigned short port)
+		: m_owner(nullptr)
+		, m_io_service{}
+		, m_ring()
+		, m_acceptor(m_io_service)
+		, m_acceptor_generation(0)
+		, m_accept_armed(false)
+		, m_wake_fd(-1)
+		, m_wake_value(0)
+		, m_tick{0, tick_millis * 1000000}
+		, m_protocol_id{}
+		, m_id_packet()
+		, m_in_flight(0)
+		, m_next_id(1)
+		, m_peers()
+		, m_handshakes()
+		, m_dirty()
+		, m_requests()
+		, m_wake_pending(false)
+		, m_stopped(false)
+		, m_network_thread()
+		, m_handshake_timeout(5000)
+		, m_buffer_pool()
+		, m_statistics()
+		, m_compression()
+		, m_max_frame_size(detail::default_max_frame_size)
+{
+	std::vector<uint8_t> protocol_id;
+	detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_1);
+	detail::insert_uint32(protocol_id, IO_PROTOCOL_ID_2);
+	std::copy(protocol_id.cbegin(), protocol_id.cend(), m_protocol_id.begin());
+
+	open(port);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+breep::uring::basic_io_manager<T,U,V>::basic_io_manager(io_manager&& other) noexcept
+		: m_owner(other.m_owner)
+		, m_io_service{}
+		, m_ring()
+		, m_acceptor(m_io_service)
+		, m_acceptor_generation(other.m_acceptor_generation + 1)
+		, m_accept_armed(false)
+		, m_wake_fd(other.m_wake_fd)
+		, m_wake_value(0)
+		, m_tick(other.m_tick)
+		, m_protocol_id(other.m_protocol_id)
+		, m_id_packet(std::move(other.m_id_packet))
+		, m_in_flight(0)
+		, m_next_id(other.m_next_id)
+		, m_peers()
+		, m_handshakes()
+		, m_dirty()
+		, m_requests()
+		, m_wake_pending(false)
+		, m_stopped(false)
+		, m_network_thread()
+		, m_handshake_timeout(other.m_handshake_timeout)
+		, m_buffer_pool()
+		, m_statistics()
+		, m_compression(std::move(other.m_compression))
+		, m_max_frame_size(other.m_max_frame_size)
+{
+	// The pending operations point at the other object: they are cancelled before taking the ring over.
+	other.quiesce();
+	m_ring = std::move(other.m_ring);
+	other.m_wake_fd = -1;
+	auto protocol = other.m_acceptor.local_endpoint().protocol();
+	m_acceptor.assign(protocol, other.m_acceptor.release());
+
+	if (m_owner != nullptr) {
+		arm_wake();
+		arm_tick();
+		arm_accept();
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+breep::uring::basic_io_manager<T,U,V>::~basic_io_manager() {
+	if (!m_ring) {
+		// moved from.
+		return;
+	}
+	quiesce();
+	m_peers.clear();
+	m_ring.reset();
+	tcp::ip_transport::close(m_acceptor);
+	::close(m_wake_fd);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+template <typename Container>
+inline void breep::uring::basic_io_manager<T,U,V>::send(commands command, const Container& data, const peer& target, send_priority priority) const {
+	send(command, data.cbegin(), data.size(), target, priority);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+template <typename InputIterator, typename size_type>
+inline void breep::uring::basic_io_manager<T,U,V>::send(commands command, InputIterator it, size_type size, const peer& target, send_priority priority) const {
+	std::vector<uint8_t> payload = m_buffer_pool.acquire(static_cast<std::size_t>(size));
+	std::copy_n(it, size, std::back_inserter(payload));
+	send(command, std::move(payload), target, priority);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+inline void breep::uring::basic_io_manager<T,U,V>::send(commands command, std::vector<uint8_t>&& data, const peer& target, send_priority priority) const {
+	m_compression.compress(target.io_data->link_codec.get(), command, data, target.io_data->compression, m_buffer_pool);
+	queue_frame(tcp::output_frame(command, std::move(data)), target, priority);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+auto breep::uring::basic_io_manager<T,U,V>::connect(const boost::asio::ip::address& address, unsigned short port) -> detail::optional<peer> {
+	// The network is not running yet: the connection is driven from the calling thread.
+	detail::optional<peer> result;
+	bool done = false;
+
+	m_network_thread = std::this_thread::get_id();
+	start_connection(address, port, [&result, &done](detail::optional<peer>&& p) {
+		if (p) {
+			result.emplace(std::move(*p));
+		}
+		done = true;
+	});
+	while (!done) {
+		loop_once();
+	}
+	m_network_thread = std::thread::id();
+	return result;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::async_connect(const boost::asio::ip::address& address, unsigned short port,
+                                                          std::function<void(detail::optional<peer>&&)> handler) {
+	if (!in_network_thread()) {
+		post([this, address, port, handler]() mutable {
+			start_connection(address, port, std::move(handler));
+		});
+		return;
+	}
+	start_connection(address, port, std::move(handler));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::process_connected_peer(peer& connected) {
+	if (!connected.io_data) {
+		return;
+	}
+	io_manager_data& io_data = *connected.io_data;
+	if (io_data.waiting_acceptance_answer) {
+		io_data.waiting_acceptance_answer = false;
+		uint8_t command = static_cast<uint8_t>(commands::connection_accepted);
+		::send(io_data.fd, &command, sizeof(command), MSG_NOSIGNAL);
+	}
+
+	io_data.id = m_next_id++;
+	io_data.last_receive = io_data.last_send = std::chrono::steady_clock::now();
+	m_peers.emplace(io_data.id, connected);
+	arm_receive(io_data);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::process_connection_denial(peer& peer) {
+	if (peer.io_data && peer.io_data->waiting_acceptance_answer) {
+		peer.io_data->waiting_acceptance_answer = false;
+		uint8_t command = static_cast<uint8_t>(commands::connection_refused);
+		::send(peer.io_data->fd, &command, sizeof(command), MSG_NOSIGNAL);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::disconnect() {
+	m_stopped = true;
+	wake();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::disconnect(peer& p) {
+	if (!p.io_data) {
+		return;
+	}
+	p.io_data->disconnected = true;
+	// the network thread forgets about the peer once its receive ended.
+	p.io_data->shutdown();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::run() {
+	m_stopped = false;
+	m_network_thread = std::this_thread::get_id();
+	breep::logger<io_manager>.info("The network is now online.");
+
+	while (!m_stopped) {
+		loop_once();
+	}
+
+	// The peers are then disconnected by the peer_manager: their completions are reaped by the next run, or when destroyed.
+	m_network_thread = std::thread::id();
+	breep::logger<io_manager>.info("The network is now offline.");
+}
+
+/* PRIVATE */
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::port(unsigned short port) {
+	make_id_packet();
+
+	// The pending accept holds a reference to the listening socket: it has to end before listening to the new port.
+	cancel(user_data(operation::accept, m_acceptor_generation));
+	while (m_accept_armed) {
+		m_ring->submit(1);
+		m_ring->for_each_cqe([this](const io_uring_cqe& cqe) {
+			process_completion(cqe);
+		});
+	}
+	tcp::ip_transport::close(m_acceptor);
+	m_acceptor = tcp::ip_transport::make_acceptor(m_io_service, port, false);
+	++m_acceptor_generation;
+	arm_accept();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::owner(basic_peer_manager<io_manager>* owner) {
+	if (m_owner == nullptr) {
+		m_owner = owner;
+
+		make_id_packet();
+
+		arm_wake();
+		arm_tick();
+		arm_accept();
+	} else {
+		throw invalid_state("Tried to set an already set owner. This object shouldn't be shared.");
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::open(unsigned short port) {
+	m_ring = std::make_unique<ring>(ring_entries);
+	m_ring->register_buffers(buffer_group, receive_buffers, T);
+
+	m_wake_fd = ::eventfd(0, EFD_CLOEXEC);
+	if (m_wake_fd < 0) {
+		throw unsupported_system("Could not create an eventfd (" + std::string(std::strerror(errno)) + ").");
+	}
+
+	m_acceptor = tcp::ip_transport::make_acceptor(m_io_service, port, false);
+	if (!tcp::ip_transport::dual_stack(m_acceptor)) {
+		breep::logger<io_manager>.warning("IP dual stack is unsupported on your system: only listening to ipv6.");
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::make_id_packet() {
+	m_id_packet.clear();
+	m_id_packet.resize(3, 0);
+	detail::make_little_endian(detail::unowning_linear_container(m_owner->self().id().data), m_id_packet);
+	m_id_packet.push_back(static_cast<char>(m_compression.codec_id()));
+
+	m_id_packet[0] = static_cast<uint8_t>(m_id_packet.size() - 1);
+	m_id_packet[1] = static_cast<uint8_t>(m_owner->port() >> 8) & std::numeric_limits<uint8_t>::max();
+	m_id_packet[2] = static_cast<uint8_t>(m_owner->port() & std::numeric_limits<uint8_t>::max());
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+inline bool breep::uring::basic_io_manager<T,U,V>::in_network_thread() const {
+	std::thread::id id = m_network_thread.load();
+	return id == std::thread::id() || id == std::this_thread::get_id();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::queue_frame(tcp::output_frame&& frame, const peer& target, send_priority priority) const {
+	if (!target.io_data || target.io_data->disconnected) {
+		recycle(frame);
+		return;
+	}
+
+	const commands command = frame.original_command();
+	const bool user_data = command == commands::send_to || command == commands::send_to_all || command == commands::stream_chunk;
+	const auto lane = static_cast<std::size_t>(user_data ? priority : send_priority::control);
+
+	if (m_network_thread.load() == std::this_thread::get_id()) {
+		queue_frame_now(target.io_data, std::move(frame), lane);
+		return;
+	}
+
+	request r;
+	r.type = request::kind::frame;
+	r.target = target.io_data;
+	r.frame = std::move(frame);
+	r.lane = lane;
+	m_requests.push(std::move(r));
+	wake();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::queue_frame_now(const data_type& target, tcp::output_frame&& frame, std::size_t lane) const {
+	if (target->disconnected) {
+		recycle(frame);
+		return;
+	}
+	target->lanes[lane].push_back(std::move(frame));
+	if (!target->dirty && !target->sending) {
+		target->dirty = true;
+		m_dirty.push_back(target);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::post(std::function<void()>&& task) const {
+	request r;
+	r.type = request::kind::task;
+	r.task = std::move(task);
+	m_requests.push(std::move(r));
+	wake();
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+inline void breep::uring::basic_io_manager<T,U,V>::wake() const {
+	// Only the first request since the last wake up writes to the eventfd.
+	if (!m_wake_pending.exchange(true)) {
+		uint64_t one = 1;
+		if (::write(m_wake_fd, &one, sizeof(one)) < 0) {
+			breep::logger<io_manager>.warning("Failed to wake the network thread up.");
+		}
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::loop_once() {
+	const bool more_requests = process_requests();
+
+	// Every peer with frames to send gets a single gathered send.
+	std::vector<data_type> dirty;
+	dirty.swap(m_dirty);
+	for (const data_type& io_data : dirty) {
+		io_data->dirty = false;
+		issue_send(*io_data);
+	}
+
+	// Submitting, and waiting for completions, with a single system call.
+	const uint64_t enters = m_ring->enters();
+	const unsigned int submitted = m_ring->submit(more_requests ? 0 : 1);
+	m_statistics.enters.fetch_add(m_ring->enters() - enters, std::memory_order_relaxed);
+	m_statistics.submissions.fetch_add(submitted, std::memory_order_relaxed);
+	if (submitted > m_statistics.max_submissions_per_enter.load(std::memory_order_relaxed)) {
+		m_statistics.max_submissions_per_enter.store(submitted, std::memory_order_relaxed);
+	}
+
+	m_ring->for_each_cqe([this](const io_uring_cqe& cqe) {
+		process_completion(cqe);
+	});
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+bool breep::uring::basic_io_manager<T,U,V>::process_requests() {
+	request r;
+	for (unsigned int i{0} ; i < max_requests ; ++i) {
+		if (!m_requests.pop(r)) {
+			return false;
+		}
+		if (r.type == request::kind::frame) {
+			queue_frame_now(r.target, std::move(r.frame), r.lane);
+			r.target.reset();
+		} else {
+			std::function<void()> task = std::move(r.task);
+			r.task = nullptr;
+			task();
+		}
+	}
+	return true;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::process_completion(const io_uring_cqe& cqe) {
+	if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+		--m_in_flight;
+	}
+
+	const uint64_t id = cqe.user_data & ((uint64_t(1) << 56) - 1);
+	switch (static_cast<operation>(cqe.user_data >> 56)) {
+		case operation::wake:
+			m_wake_pending = false;
+			arm_wake();
+			break;
+
+		case operation::tick:
+			tick();
+			arm_tick();
+			break;
+
+		case operation::accept:
+			if (cqe.res >= 0) {
+				accepted(cqe.res);
+			} else if (cqe.res != -ECANCELED && id == m_acceptor_generation) {
+				breep::logger<io_manager>.warning("Failed to accept a connection (" + std::string(std::strerror(-cqe.res)) + ").");
+			}
+			if ((cqe.flags & IORING_CQE_F_MORE) == 0 && id == m_acceptor_generation) {
+				// accepting again right away, unless it failed: the tick then tries again.
+				m_accept_armed = false;
+				if (cqe.res >= 0) {
+					arm_accept();
+				}
+			}
+			break;
+
+		case operation::handshake:
+			handshake_completed(id, cqe.res);
+			break;
+
+		case operation::receive:
+			receive_completed(id, cqe);
+			break;
+
+		case operation::send:
+			send_completed(id, cqe.res);
+			break;
+
+		case operation::cancel:
+			break;
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::arm_wake() {
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = m_wake_fd;
+	sqe->addr = reinterpret_cast<uint64_t>(&m_wake_value);
+	sqe->len = sizeof(m_wake_value);
+	sqe->user_data = user_data(operation::wake, 0);
+	++m_in_flight;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::arm_tick() {
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = reinterpret_cast<uint64_t>(&m_tick);
+	sqe->len = 1;
+	sqe->user_data = user_data(operation::tick, 0);
+	++m_in_flight;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::arm_accept() {
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = m_acceptor.native_handle();
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = user_data(operation::accept, m_acceptor_generation);
+	++m_in_flight;
+	m_accept_armed = true;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::arm_receive(io_manager_data& io_data) {
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = io_data.fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = buffer_group;
+	sqe->user_data = user_data(operation::receive, io_data.id);
+	++m_in_flight;
+	io_data.receiving = true;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::cancel(uint64_t target) {
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = target;
+	sqe->user_data = user_data(operation::cancel, 0);
+	++m_in_flight;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::tick() {
+	const auto now = std::chrono::steady_clock::now();
+
+	for (auto& pair : m_peers) {
+		peer& p = pair.second;
+		io_manager_data& io_data = *p.io_data;
+		if (io_data.closed || io_data.disconnected) {
+			continue;
+		}
+
+		if (now - io_data.last_receive >= std::chrono::milliseconds(V)) {
+			// shutting the socket down (rather than closing it) lets the receive report the disconnection.
+			breep::logger<io_manager>.trace(p.id_as_string() + " timed out");
+			io_data.shutdown();
+			continue;
+		}
+
+		// Any frame sent to the peer does the job of a keep_alive.
+		if (now - io_data.last_send >= std::chrono::milliseconds(U) && io_data.queue.empty() && !io_data.waiting()) {
+			m_statistics.keep_alives_sent.fetch_add(1, std::memory_order_relaxed);
+			send(commands::keep_alive, constant::unused_param, p);
+		}
+	}
+
+	for (auto& pair : m_handshakes) {
+		handshake& hs = *pair.second;
+		if (!hs.expired && now >= hs.deadline) {
+			hs.expired = true;
+			cancel(user_data(operation::handshake, pair.first));
+		}
+	}
+
+	if (!m_accept_armed) {
+		arm_accept();
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::accepted(int fd) {
+	boost::asio::ip::tcp::endpoint endpoint;
+	socklen_t length = static_cast<socklen_t>(endpoint.capacity());
+	if (::getpeername(fd, endpoint.data(), &length) < 0) {
+		::close(fd);
+		return;
+	}
+	endpoint.resize(length);
+
+	int one = 1;
+	::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	auto hs = std::make_unique<handshake>(fd, handshake::step::read_remote_protocol_id, m_id_packet);
+	hs->endpoint = endpoint;
+	hs->deadline = std::chrono::steady_clock::now() + m_handshake_timeout;
+
+	const uint64_t id = m_next_id++;
+	handshake_io(id, *hs);
+	m_handshakes.emplace(id, std::move(hs));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::start_connection(const boost::asio::ip::address& address, unsigned short port,
+                                                             std::function<void(detail::optional<peer>&&)>&& handler) {
+	boost::asio::ip::tcp::endpoint endpoint(address, port);
+	int fd = ::socket(endpoint.data()->sa_family, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (fd < 0) {
+		breep::logger<io_manager>.warning("Failed to open a socket (" + std::string(std::strerror(errno)) + ").");
+		handler({});
+		return;
+	}
+	int one = 1;
+	::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	auto hs = std::make_unique<handshake>(fd, handshake::step::connect, m_id_packet);
+	hs->endpoint = endpoint;
+	hs->handler = std::move(handler);
+	hs->deadline = std::chrono::steady_clock::now() + m_handshake_timeout;
+
+	const uint64_t id = m_next_id++;
+	handshake_io(id, *hs);
+	m_handshakes.emplace(id, std::move(hs));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::handshake_io(uint64_t id, handshake& hs) {
+	using step = typename handshake::step;
+
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->fd = hs.fd;
+	sqe->user_data = user_data(operation::handshake, id);
+	++m_in_flight;
+
+	if (hs.current == step::connect) {
+		sqe->opcode = IORING_OP_CONNECT;
+		sqe->addr = reinterpret_cast<uint64_t>(hs.endpoint.data());
+		sqe->off = hs.endpoint.size();
+		return;
+	}
+
+	// Each step sends or receives an exact number of octets.
+	const uint8_t* data;
+	std::size_t size;
+	bool sending = false;
+	switch (hs.current) {
+		case step::send_protocol_id:
+		case step::send_local_protocol_id:
+			data = m_protocol_id.data();
+			size = m_protocol_id.size();
+			sending = true;
+			break;
+		case step::send_id:
+		case step::send_local_id:
+			data = reinterpret_cast<const uint8_t*>(hs.id_packet.data());
+			size = hs.id_packet.size();
+			sending = true;
+			break;
+		case step::read_protocol_id:
+		case step::read_remote_protocol_id:
+			data = hs.buffer.data();
+			size = m_protocol_id.size();
+			break;
+		case step::read_id_size:
+		case step::read_remote_id_size:
+			data = hs.buffer.data();
+			size = 1;
+			break;
+		case step::read_id:
+		case step::read_remote_id:
+			data = hs.buffer.data() + 1;
+			size = hs.buffer[0];
+			break;
+		default:
+			data = &hs.answer;
+			size = sizeof(hs.answer);
+			break;
+	}
+
+	sqe->opcode = sending ? IORING_OP_SEND : IORING_OP_RECV;
+	sqe->addr = reinterpret_cast<uint64_t>(data + hs.done);
+	sqe->len = static_cast<uint32_t>(size - hs.done);
+	sqe->msg_flags = sending ? MSG_NOSIGNAL : 0;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::handshake_completed(uint64_t id, int result) {
+	using step = typename handshake::step;
+
+	auto it = m_handshakes.find(id);
+	if (it == m_handshakes.end()) {
+		return;
+	}
+	handshake& hs = *it->second;
+
+	if (hs.expired || result < 0 || (result == 0 && hs.current != step::connect)) {
+		handshake_failed(id);
+		return;
+	}
+
+	if (hs.current != step::connect) {
+		hs.done += static_cast<std::size_t>(result);
+		std::size_t expected;
+		switch (hs.current) {
+			case step::send_protocol_id:
+			case step::send_local_protocol_id:
+			case step::read_protocol_id:
+			case step::read_remote_protocol_id:
+				expected = m_protocol_id.size();
+				break;
+			case step::send_id:
+			case step::send_local_id:
+				expected = hs.id_packet.size();
+				break;
+			case step::read_id:
+			case step::read_remote_id:
+				expected = hs.buffer[0];
+				break;
+			default:
+				expected = 1;
+				break;
+		}
+		if (hs.done < expected) {
+			handshake_io(id, hs);
+			return;
+		}
+	}
+
+	hs.done = 0;
+	if (!handshake_next_step(hs)) {
+		handshake_failed(id);
+	} else if (hs.current == step::completed) {
+		handshake_done(id);
+	} else {
+		handshake_io(id, hs);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+bool breep::uring::basic_io_manager<T,U,V>::handshake_next_step(handshake& hs) {
+	using step = typename handshake::step;
+
+	const bool outgoing = static_cast<bool>(hs.handler);
+	const std::string remote = "[" + hs.endpoint.address().to_string() + "]" + (outgoing ? ":" + std::to_string(hs.endpoint.port()) : "");
+	auto check_protocol_id = [this, &hs, &remote, outgoing]() {
+		if (std::equal(m_protocol_id.cbegin(), m_protocol_id.cend(), hs.buffer.cbegin())) {
+			return true;
+		}
+		breep::logger<io_manager>.warning(std::string(outgoing ? "Target" : "Incomming") + " peer has not the same io_manager protocol ID than us ("
+		                                  + remote + ").");
+		breep::logger<io_manager>.warning("Our protocol ID: " + std::to_string(IO_PROTOCOL_ID_1) + " " +
+		                                  std::to_string(IO_PROTOCOL_ID_2) + ". Their protocol ID: "
+		                                  + std::to_string(detail::read_uint32(hs.buffer)) + " "
+		                                  + std::to_string(detail::read_uint32(hs.buffer, sizeof(uint32_t))) + ".");
+		return false;
+	};
+
+	switch (hs.current) {
+		case step::connect:
+			hs.current = step::send_protocol_id;
+			return true;
+
+		case step::send_protocol_id:
+			hs.current = step::read_protocol_id;
+			return true;
+
+		case step::read_protocol_id:
+			hs.current = step::send_id;
+			return check_protocol_id();
+
+		case step::send_id:
+			hs.current = step::read_id_size;
+			return true;
+
+		case step::read_id_size:
+		case step::read_remote_id_size:
+			if (hs.buffer[0] < 4 || hs.buffer[0] >= hs.buffer.size()) {
+				return false;
+			}
+			hs.current = hs.current == step::read_id_size ? step::read_id : step::read_remote_id;
+			return true;
+
+		case step::read_id:
+			hs.current = step::read_answer;
+			return true;
+
+		case step::read_answer:
+			if (static_cast<commands>(hs.answer) == commands::connection_refused) {
+				breep::logger<io_manager>.info("Connection refused (" + remote + ")");
+				return false;
+			}
+			if (static_cast<commands>(hs.answer) != commands::connection_accepted) {
+				breep::logger<io_manager>.warning("Incompatible protocol, but protocol id match."
+				                                  "(when connecting to " + remote + ")");
+				return false;
+			}
+			hs.current = step::completed;
+			return true;
+
+		case step::read_remote_protocol_id:
+			// Our protocol ID is sent in any case, for the remote peer to know why it is rejected.
+			hs.current = step::send_local_protocol_id;
+			return true;
+
+		case step::send_local_protocol_id:
+			hs.current = step::read_remote_id_size;
+			return check_protocol_id();
+
+		case step::read_remote_id:
+			hs.current = step::send_local_id;
+			return true;
+
+		case step::send_local_id:
+			hs.current = step::completed;
+			return true;
+
+		case step::completed:
+			break;
+	}
+	return false;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::handshake_done(uint64_t id) {
+	auto it = m_handshakes.find(id);
+	std::unique_ptr<handshake> hs = std::move(it->second);
+	m_handshakes.erase(it);
+
+	// [size][port][id][codec]
+	std::string input;
+	detail::unmake_little_endian(detail::unowning_linear_container(hs->buffer.data() + 3, hs->buffer[0] - 3u), input);
+
+	boost::uuids::uuid uuid;
+	std::copy(input.data(), input.data() + input.size(), uuid.data);
+
+	const auto port = static_cast<unsigned short>(hs->buffer[1] << 8 | hs->buffer[2]);
+	const bool outgoing = static_cast<bool>(hs->handler);
+	auto io_data = std::make_shared<io_manager_data>(hs->fd, !outgoing);
+	io_data->link_codec = m_compression.negotiate(hs->buffer[hs->buffer[0]]);
+	hs->fd = -1;
+
+	if (outgoing) {
+		hs->handler(detail::optional<peer>(peer(std::move(uuid), hs->endpoint.address(), port, std::move(io_data))));
+	} else {
+		detail::peer_manager_attorney<io_manager>::peer_connected(
+				*m_owner,
+				peer(std::move(uuid), hs->endpoint.address(), port, std::move(io_data))
+		);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::handshake_failed(uint64_t id) {
+	auto it = m_handshakes.find(id);
+	std::unique_ptr<handshake> hs = std::move(it->second);
+	m_handshakes.erase(it);
+	::close(hs->fd);
+
+	if (hs->handler) {
+		if (hs->expired) {
+			breep::logger<io_manager>.warning("Connection to [" + hs->endpoint.address().to_string() + "]:"
+			                                  + std::to_string(hs->endpoint.port()) + " timed out.");
+		}
+		hs->handler({});
+	} else if (hs->expired) {
+		breep::logger<io_manager>.warning("Incomming connection did not complete its handshake in time.");
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::issue_send(io_manager_data& io_data) {
+	if (io_data.sending || (io_data.queue.empty() && !io_data.waiting())) {
+		return;
+	}
+
+	// Taking the frames waiting in the lanes, from the highest one
+	std::size_t queued = 0;
+	for (const tcp::output_frame& frame : io_data.queue) {
+		queued += frame.size();
+	}
+	for (std::deque<tcp::output_frame>& lane : io_data.lanes) {
+		while (!lane.empty() && io_data.queue.size() < max_send_frames
+		       && (io_data.queue.empty() || queued + lane.front().size() <= max_send_size)) {
+			queued += lane.front().size();
+			io_data.queue.push_back(std::move(lane.front()));
+			lane.pop_front();
+		}
+	}
+
+	io_data.in_flight = std::min(io_data.queue.size(), max_send_frames);
+	io_data.iovecs.clear();
+	std::size_t skip = io_data.sent_offset;
+	std::size_t octets = 0;
+	auto gather = [&io_data, &skip, &octets](const uint8_t* data, std::size_t size) {
+		if (skip >= size) {
+			skip -= size;
+			return;
+		}
+		io_data.iovecs.push_back(iovec{const_cast<uint8_t*>(data) + skip, size - skip});
+		octets += size - skip;
+		skip = 0;
+	};
+	for (std::size_t i{0} ; i < io_data.in_flight ; ++i) {
+		const tcp::output_frame& frame = io_data.queue[i];
+		gather(frame.header.data(), frame.header_size);
+		gather(frame.payload_data().data(), frame.payload_data().size());
+	}
+
+	std::memset(&io_data.message, 0, sizeof(io_data.message));
+	io_data.message.msg_iov = io_data.iovecs.data();
+	io_data.message.msg_iovlen = io_data.iovecs.size();
+
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = io_data.fd;
+	sqe->addr = reinterpret_cast<uint64_t>(&io_data.message);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+	sqe->user_data = user_data(operation::send, io_data.id);
+	++m_in_flight;
+
+	io_data.sending = true;
+	io_data.last_send = std::chrono::steady_clock::now();
+	m_statistics.sends.fetch_add(1, std::memory_order_relaxed);
+	m_statistics.octets_written.fetch_add(octets, std::memory_order_relaxed);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::send_completed(uint64_t id, int result) {
+	auto it = m_peers.find(id);
+	if (it == m_peers.end()) {
+		return;
+	}
+	io_manager_data& io_data = *it->second.io_data;
+	io_data.sending = false;
+
+	if (result < 0 || io_data.disconnected) {
+		// The receive reports the disconnection: the frames left will not be sent.
+		drop_frames(io_data);
+		if (result < 0) {
+			io_data.shutdown();
+		}
+		if (io_data.closed) {
+			m_peers.erase(it);
+		}
+		return;
+	}
+
+	// Popping the frames that were fully sent (the send may be short).
+	std::size_t sent = static_cast<std::size_t>(result);
+	std::size_t frames = 0;
+	while (sent != 0 && !io_data.queue.empty()) {
+		tcp::output_frame& frame = io_data.queue.front();
+		const std::size_t remaining = frame.size() - io_data.sent_offset;
+		if (sent < remaining) {
+			io_data.sent_offset += sent;
+			break;
+		}
+		sent -= remaining;
+		io_data.sent_offset = 0;
+		recycle(frame);
+		io_data.queue.pop_front();
+		++frames;
+	}
+	io_data.in_flight = 0;
+	m_statistics.frames_written.fetch_add(frames, std::memory_order_relaxed);
+
+	// Frames queued meanwhile are sent right away.
+	issue_send(io_data);
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::receive_completed(uint64_t id, const io_uring_cqe& cqe) {
+	const bool has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+	const auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+	auto it = m_peers.find(id);
+	if (it == m_peers.end()) {
+		if (has_buffer) {
+			m_ring->recycle_buffer(bid);
+		}
+		return;
+	}
+	peer& sender = it->second;
+	io_manager_data& io_data = *sender.io_data;
+
+	if (cqe.res > 0) {
+		m_statistics.receives.fetch_add(1, std::memory_order_relaxed);
+		io_data.last_receive = std::chrono::steady_clock::now();
+		process_received(sender, m_ring->buffer(bid), static_cast<std::size_t>(cqe.res));
+	}
+	if (has_buffer) {
+		m_ring->recycle_buffer(bid);
+	}
+
+	if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+		io_data.receiving = false;
+		// The multishot receive also stops when it runs out of buffers: they were just given back.
+		if (cqe.res > 0 || cqe.res == -ENOBUFS) {
+			arm_receive(io_data);
+		} else {
+			lose_peer(sender);
+		}
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::process_received(peer& sender, const uint8_t* data, std::size_t size) {
+	io_manager_data& io_data = *sender.io_data;
+	std::vector<uint8_t>& stream = io_data.stream;
+
+	std::size_t index{0};
+	while (index < size && !io_data.broken) {
+		uint64_t payload_size;
+		std::size_t varint_size;
+
+		if (stream.empty()) {
+			// Reading the frame header from the buffer
+			varint_size = detail::read_varint(data + index + 1, size - index - 1, payload_size);
+			if (varint_size > detail::max_varint_size) {
+				break;
+			}
+			if (varint_size != 0 && refuse_frame(sender, payload_size)) {
+				return;
+			}
+			if (varint_size != 0 && payload_size <= size - index - 1 - varint_size) {
+				// The whole frame is in the buffer: dispatching it from there.
+				commands command = static_cast<commands>(data[index]);
+				index += 1 + varint_size;
+				detail::unowning_linear_container frame(data + index, static_cast<std::size_t>(payload_size));
+				index += frame.size();
+				dispatch(sender, command, frame);
+				continue;
+			}
+			if (varint_size != 0) {
+				stream.reserve(1 + varint_size + static_cast<std::size_t>(payload_size));
+			}
+			stream.insert(stream.end(), data + index, data + size);
+			return;
+		}
+
+		// The beginning of the frame was received earlier.
+		varint_size = stream.size() > 1 ? detail::read_varint(stream.data() + 1, stream.size() - 1, payload_size) : 0;
+		if (varint_size > detail::max_varint_size) {
+			break;
+		}
+		if (varint_size != 0 && refuse_frame(sender, payload_size)) {
+			return;
+		}
+		if (varint_size == 0) {
+			// Incomplete header: completing it, and reading it again.
+			std::size_t count = std::min(size - index, tcp::output_frame::max_header_size);
+			stream.insert(stream.end(), data + index, data + index + count);
+			index += count;
+			continue;
+		}
+
+		const std::size_t frame_size = 1 + varint_size + static_cast<std::size_t>(payload_size);
+		if (stream.size() > frame_size) {
+			// The header was completed with octets of the next frame.
+			index -= stream.size() - frame_size;
+			stream.resize(frame_size);
+		} else {
+			stream.reserve(frame_size);
+			std::size_t count = std::min(size - index, frame_size - stream.size());
+			stream.insert(stream.end(), data + index, data + index + count);
+			index += count;
+		}
+
+		if (stream.size() == frame_size) {
+			commands command = static_cast<commands>(stream[0]);
+			dispatch(sender, command, detail::unowning_linear_container(stream.data() + 1 + varint_size, static_cast<std::size_t>(payload_size)));
+			stream.clear();
+		}
+	}
+
+	if (index < size && !io_data.broken) {
+		breep::logger<io_manager>.warning("Received a malformed frame from " + sender.id_as_string() + ". Disconnecting.");
+		io_data.broken = true;
+		stream.clear();
+		io_data.shutdown();
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+bool breep::uring::basic_io_manager<T,U,V>::refuse_frame(peer& sender, uint64_t payload_size) {
+	if (payload_size <= m_max_frame_size) {
+		return false;
+	}
+	breep::logger<io_manager>.warning("Received a frame of " + std::to_string(payload_size) + " octets from " + sender.id_as_string()
+	                                  + " (maximum: " + std::to_string(m_max_frame_size) + "). Disconnecting.");
+	io_manager_data& io_data = *sender.io_data;
+	io_data.broken = true;
+	io_data.stream.clear();
+	io_data.shutdown();
+	return true;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::dispatch(peer& sender, commands command, const detail::unowning_linear_container& frame) {
+	if (command != commands::compressed) {
+		detail::peer_manager_attorney<io_manager>::data_received(*m_owner, sender, command, frame);
+		return;
+	}
+
+	io_manager_data& io_data = *sender.io_data;
+	if (!io_data.link_codec || !detail::frame_compressor::decompress(*io_data.link_codec, frame, command, io_data.decompressed, io_data.compression)) {
+		breep::logger<io_manager>.warning("Received a malformed compressed frame from " + sender.id_as_string() + ". Disconnecting.");
+		io_data.broken = true;
+		io_data.stream.clear();
+		io_data.shutdown();
+		return;
+	}
+	detail::peer_manager_attorney<io_manager>::data_received(*m_owner, sender, command,
+	                                                         detail::unowning_linear_container(io_data.decompressed.data(), io_data.decompressed.size()));
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::lose_peer(peer& p) {
+	data_type io_data = p.io_data;
+	io_data->closed = true;
+	io_data->stream.clear();
+	io_data->stream.shrink_to_fit();
+
+	if (!io_data->disconnected.exchange(true)) {
+		detail::peer_manager_attorney<io_manager>::peer_disconnected(*m_owner, p);
+	}
+
+	// The frames left will not be sent. The send in flight, if any, erases the peer when it completes.
+	if (!io_data->sending) {
+		drop_frames(*io_data);
+		m_peers.erase(io_data->id);
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::drop_frames(io_manager_data& io_data) const {
+	for (tcp::output_frame& frame : io_data.queue) {
+		recycle(frame);
+	}
+	io_data.queue.clear();
+	for (std::deque<tcp::output_frame>& lane : io_data.lanes) {
+		for (tcp::output_frame& frame : lane) {
+			recycle(frame);
+		}
+		lane.clear();
+	}
+	io_data.in_flight = 0;
+	io_data.sent_offset = 0;
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::recycle(tcp::output_frame& frame) const {
+	if (frame.shared_payload) {
+		// shared payloads give themselves back once their last frame drops them (see share_buffer())
+		frame.shared_payload.reset();
+	} else {
+		m_buffer_pool.release(std::move(frame.payload));
+	}
+}
+
+template <unsigned int T, unsigned long U, unsigned long V>
+void breep::uring::basic_io_manager<T,U,V>::quiesce() {
+	if (!m_ring) {
+		return;
+	}
+
+	for (auto& pair : m_peers) {
+		pair.second.io_data->shutdown();
+	}
+
+	io_uring_sqe* sqe = m_ring->get_sqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+	sqe->user_data = user_data(operation::cancel, 0);
+	++m_in_flight;
+
+	// Nothing is reported: completions only give their buffers back.
+	while (m_in_flight != 0) {
+		m_ring->submit(1);
+		m_ring->for_each_cqe([this](const io_uring_cqe& cqe) {
+			if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+				--m_in_flight;
+			}
+			if ((cqe.flags & IORING_CQE_F_BUFFER) != 0) {
+				m_ring->recycle_buffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+			}
+		});
+	}
+
+	for (auto& pair : m_handshakes) {
+		::close(pair.second->fd);
+	}
+	m_handshakes.clear();
+	m_accept_armed = false;
+}
@@ -0,0 +1,261 @@
+#ifndef BREEP_NETWORK_URING_RING_HPP
+#define BREEP_NETWORK_URING_RING_HPP
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file ring.hpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ */
+
+#ifndef __linux__
+#error "breep::uring requires Linux."
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <new>
+#include <memory>
+#include <string>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "breep/util/exceptions.hpp"
+
+namespace breep { namespace uring {
+
+	/**
+	 * @brief io_uring instance: a submission queue, a completion queue, and a ring of provided receive buffers.
+	 * @details Talks to the kernel through the raw system calls (liburing is not required).
+	 *          Must only be used from one thread at a time.
+	 *
+	 * @since 1.1.0
+	 */
+	class ring final {
+	public:
+
+		/**
+		 * @param entries size of the submission queue.
+		 * @throws unsupported_system if io_uring is not available.
+		 */
+		explicit ring(unsigned int entries) {
+			io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+			params.flags = IORING_SETUP_CLAMP;
+			m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+			if (m_fd < 0) {
+				throw unsupported_system("io_uring is not available on your system (" + std::string(std::strerror(errno)) + ").");
+			}
+
+			m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+			m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single_mmap) {
+				m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+			}
+
+			m_sq_ring = map(m_sq_ring_size, IORING_OFF_SQ_RING);
+			m_cq_ring = single_mmap ? m_sq_ring : map(m_cq_ring_size, IORING_OFF_CQ_RING);
+			m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+			m_sqes = static_cast<io_uring_sqe*>(map(m_sqes_size, IORING_OFF_SQES));
+
+			uint8_t* sq = static_cast<uint8_t*>(m_sq_ring);
+			m_sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+			m_sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+			m_sq_mask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+			m_sq_entries = params.sq_entries;
+			unsigned int* array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+			for (unsigned int i{0} ; i < m_sq_entries ; ++i) {
+				array[i] = i;
+			}
+			m_sqe_tail = *m_sq_tail;
+
+			uint8_t* cq = static_cast<uint8_t*>(m_cq_ring);
+			m_cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+			m_cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+			m_cq_mask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+			m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		}
+
+		ring(const ring&) = delete;
+		ring& operator=(const ring&) = delete;
+
+		~ring() {
+			// closing the ring cancels the pending operations.
+			::close(m_fd);
+			if (m_buffer_ring != nullptr) {
+				::munmap(m_buffer_ring, m_buffer_ring_size);
+			}
+			::munmap(m_sqes, m_sqes_size);
+			if (m_cq_ring != m_sq_ring) {
+				::munmap(m_cq_ring, m_cq_ring_size);
+			}
+			::munmap(m_sq_ring, m_sq_ring_size);
+		}
+
+		/**
+		 * @return a zeroed submission queue entry, to be submitted by the next call to submit().
+		 */
+		io_uring_sqe* get_sqe() {
+			while (m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries) {
+				// full: handing what is queued to the kernel.
+				submit(0);
+			}
+			io_uring_sqe* sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+			std::memset(sqe, 0, sizeof(*sqe));
+			++m_sqe_tail;
+			return sqe;
+		}
+
+		/**
+		 * @brief Submits the queued entries and waits for \em wait_nr completions, with a single system call.
+		 * @return the number of entries submitted.
+		 */
+		unsigned int submit(unsigned int wait_nr) {
+			__atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+			unsigned int to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+			if (to_submit == 0 && wait_nr == 0) {
+				return 0;
+			}
+
+			unsigned int flags = wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0;
+			long ret = ::syscall(__NR_io_uring_enter, m_fd, to_submit, wait_nr, flags, nullptr, 0);
+			++m_enters;
+			// on EINTR, or EBUSY while the completion queue is full, the entries are submitted by the next call.
+			return ret < 0 ? 0 : static_cast<unsigned int>(ret);
+		}
+
+		/**
+		 * @brief Calls \em f with each available completion, and frees them.
+		 * @return the number of completions processed.
+		 */
+		template <typename F>
+		unsigned int for_each_cqe(F&& f) {
+			unsigned int head = *m_cq_head;
+			unsigned int tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			unsigned int count{0};
+			while (head != tail) {
+				// copied: the slot may be reused as soon as the head moves.
+				io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+				++head;
+				++count;
+				__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+				f(cqe);
+				tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			}
+			return count;
+		}
+
+		/**
+		 * @brief Registers \em count buffers of \em size octets, that the kernel picks from when receiving
+		 *        with IOSQE_BUFFER_SELECT and \em group.
+		 * @param count power of two.
+		 * @throws unsupported_system if provided buffer rings are not available (Linux < 5.19).
+		 */
+		void register_buffers(uint16_t group, unsigned int count, unsigned int size) {
+			m_buffer_ring_size = count * sizeof(io_uring_buf);
+			void* mem = ::mmap(nullptr, m_buffer_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+			if (mem == MAP_FAILED) {
+				throw std::bad_alloc();
+			}
+			m_buffer_ring = static_cast<io_uring_buf_ring*>(mem);
+			m_buffers.reset(new uint8_t[static_cast<std::size_t>(count) * size]);
+			m_buffer_count = count;
+			m_buffer_size = size;
+
+			io_uring_buf_reg reg;
+			std::memset(&reg, 0, sizeof(reg));
+			reg.ring_addr = reinterpret_cast<uint64_t>(m_buffer_ring);
+			reg.ring_entries = count;
+			reg.bgid = group;
+			if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+				throw unsupported_system("io_uring provided buffer rings are not available on your system ("
+				                         + std::string(std::strerror(errno)) + ").");
+			}
+
+			for (uint16_t bid{0} ; bid < count ; ++bid) {
+				recycle_buffer(bid);
+			}
+		}
+
+		uint8_t* buffer(uint16_t bid) const {
+			return m_buffers.get() + static_cast<std::size_t>(bid) * m_buffer_size;
+		}
+
+		/**
+		 * @brief Gives a buffer picked by the kernel back to it.
+		 */
+		void recycle_buffer(uint16_t bid) {
+			// not m_buffer_ring->bufs: compiled as C++, the header's flexible array does not start at offset 0.
+			io_uring_buf& buf = reinterpret_cast<io_uring_buf*>(m_buffer_ring)[m_buffer_tail & (m_buffer_count - 1)];
+			buf.addr = reinterpret_cast<uint64_t>(buffer(bid));
+			buf.len = m_buffer_size;
+			buf.bid = bid;
+			++m_buffer_tail;
+			__atomic_store_n(&m_buffer_ring->tail, m_buffer_tail, __ATOMIC_RELEASE);
+		}
+
+		/**
+		 * @return the number of io_uring_enter system calls made.
+		 */
+		uint64_t enters() const {
+			return m_enters;
+		}
+
+	private:
+		void* map(std::size_t size, uint64_t offset) {
+			void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, static_cast<off_t>(offset));
+			if (ptr == MAP_FAILED) {
+				int error = errno;
+				::close(m_fd);
+				throw unsupported_system("Could not map the io_uring queues (" + std::string(std::strerror(error)) + ").");
+			}
+			return ptr;
+		}
+
+		int m_fd{-1};
+
+		void* m_sq_ring{nullptr};
+		std::size_t m_sq_ring_size{0};
+		unsigned int* m_sq_head{nullptr};
+		unsigned int* m_sq_tail{nullptr};
+		unsigned int m_sq_mask{0};
+		unsigned int m_sq_entries{0};
+		io_uring_sqe* m_sqes{nullptr};
+		std::size_t m_sqes_size{0};
+		// entries handed out by get_sqe().
+		unsigned int m_sqe_tail{0};
+
+		void* m_cq_ring{nullptr};
+		std::size_t m_cq_ring_size{0};
+		unsigned int* m_cq_head{nullptr};
+		unsigned int* m_cq_tail{nullptr};
+		unsigned int m_cq_mask{0};
+		io_uring_cqe* m_cqes{nullptr};
+
+		io_uring_buf_ring* m_buffer_ring{nullptr};
+		std::size_t m_buffer_ring_size{0};
+		std::unique_ptr<uint8_t[]> m_buffers{};
+		unsigned int m_buffer_count{0};
+		unsigned int m_buffer_size{0};
+		uint16_t m_buffer_tail{0};
+
+		uint64_t m_enters{0};
+	};
+}}
+
+#endif //BREEP_NETWORK_URING_RING_HPP
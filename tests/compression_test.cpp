@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file compression_test.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Compresses a frame with detail::frame_compressor and lz_codec, and checks that decompress() gives it back,
+ * and that it refuses malformed compressed frames: nested compression, a declared size too big for the
+ * compressed payload, and truncated or over-long size varints.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <breep/network/lz_codec.hpp>
+#include <breep/network/detail/compression.hpp>
+
+namespace {
+
+	using breep::commands;
+
+	const breep::lz_codec codec;
+
+	bool round_trip() {
+		breep::detail::frame_compressor compressor;
+		compressor.configure(std::make_shared<breep::lz_codec>(), 0);
+		breep::detail::buffer_pool pool;
+		breep::detail::compression_counters counters;
+
+		std::vector<uint8_t> original;
+		for (std::size_t i = 0 ; i < 64 * 1024 ; ++i) {
+			original.push_back(static_cast<uint8_t>("breep, breep, breep!"[i % 20]));
+		}
+		std::vector<uint8_t> payload = original;
+		commands command = commands::send_to_all;
+		compressor.compress(&codec, command, payload, counters, pool);
+		if (command != commands::compressed || payload.size() >= original.size()) {
+			std::cerr << "Compressible payload was not compressed.\n";
+			return false;
+		}
+
+		std::vector<uint8_t> output;
+		command = commands::null_command;
+		if (!breep::detail::frame_compressor::decompress(codec, breep::detail::unowning_linear_container(payload.data(), payload.size()),
+		                                                 command, output, counters)) {
+			std::cerr << "Compressed frame was refused.\n";
+			return false;
+		}
+		if (command != commands::send_to_all || output != original || counters.frames_decompressed != 1) {
+			std::cerr << "Compressed frame did not decompress to the original one.\n";
+			return false;
+		}
+		return true;
+	}
+
+	// [command][declared size (varint)][body]
+	std::vector<uint8_t> frame(commands command, uint64_t declared_size, std::size_t body_size) {
+		std::vector<uint8_t> f(1 + breep::detail::max_varint_size);
+		f[0] = static_cast<uint8_t>(command);
+		f.resize(1 + breep::detail::write_varint(f.data() + 1, declared_size));
+		f.resize(f.size() + body_size, 0);
+		return f;
+	}
+
+	bool refused(const std::string& what, const std::vector<uint8_t>& f) {
+		breep::detail::compression_counters counters;
+		commands command = commands::null_command;
+		std::vector<uint8_t> output;
+		if (breep::detail::frame_compressor::decompress(codec, breep::detail::unowning_linear_container(f.data(), f.size()),
+		                                                command, output, counters)) {
+			std::cerr << what << " was not refused.\n";
+			return false;
+		}
+		if (output.capacity() != 0) {
+			std::cerr << what << " made decompress() allocate " << output.capacity() << " octets.\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool malformed_frames() {
+		// a compressed frame holding another one
+		bool ok = refused("Nested compressed frame", frame(commands::compressed, 16, 16));
+
+		// declared sizes more than 256 times the compressed body
+		ok = refused("Declared size above the maximum expansion", frame(commands::send_to_all, 64 * 256 + 256, 64)) && ok;
+		ok = refused("Declared size of 2^64 - 1", frame(commands::send_to_all, ~uint64_t{0}, 64)) && ok;
+
+		// size varints cut by the end of the frame
+		ok = refused("Truncated size", {static_cast<uint8_t>(commands::send_to_all), 0x80}) && ok;
+		ok = refused("Truncated size", {static_cast<uint8_t>(commands::send_to_all), 0xFF, 0xFF, 0xFF}) && ok;
+		ok = refused("Empty size", {static_cast<uint8_t>(commands::send_to_all)}) && ok;
+
+		// more continuation octets than a uint64_t may take
+		std::vector<uint8_t> over_long(1 + breep::detail::max_varint_size + 1, 0x80);
+		over_long[0] = static_cast<uint8_t>(commands::send_to_all);
+		over_long.push_back(0x01);
+		ok = refused("Over-long size", over_long) && ok;
+		return ok;
+	}
+}
+
+int main() {
+	const bool ok = round_trip();
+	return malformed_frames() && ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file framing_test.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Checks the varint encoding of the frame sizes (round trips at every length, truncated and over-long
+ * varints), and that a peer sending a frame bigger than the receiver's max_frame_size() is disconnected
+ * without the frame being delivered.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <breep/network/tcp.hpp>
+#include <breep/network/detail/utils.hpp>
+
+namespace {
+
+	bool round_trip(uint64_t value, std::size_t expected_size) {
+		std::array<uint8_t, breep::detail::max_varint_size> buffer{};
+		const std::size_t written = breep::detail::write_varint(buffer.data(), value);
+		uint64_t read_value;
+		const std::size_t read = breep::detail::read_varint(buffer.data(), written, read_value);
+		if (written != expected_size || read != written || read_value != value) {
+			std::cerr << "Varint round trip of " << value << " failed (" << written << " octets written, "
+			          << read << " read, " << expected_size << " expected).\n";
+			return false;
+		}
+
+		// every strict prefix is an incomplete header
+		for (std::size_t size = 0 ; size < written ; ++size) {
+			if (breep::detail::read_varint(buffer.data(), size, read_value) != 0) {
+				std::cerr << "Truncated varint of " << value << " (" << size << " octets out of "
+				          << written << ") was not reported as incomplete.\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool varints() {
+		bool ok = round_trip(0, 1);
+		for (std::size_t size = 1 ; size < breep::detail::max_varint_size ; ++size) {
+			// smallest and biggest values taking size octets
+			ok = round_trip(size == 1 ? 1 : uint64_t{1} << (7 * (size - 1)), size) && ok;
+			ok = round_trip((uint64_t{1} << (7 * size)) - 1, size) && ok;
+		}
+		ok = round_trip(uint64_t{1} << 63, breep::detail::max_varint_size) && ok;
+		ok = round_trip(std::numeric_limits<uint64_t>::max(), breep::detail::max_varint_size) && ok;
+
+		// more continuation octets than a uint64_t may take
+		std::array<uint8_t, breep::detail::max_varint_size + 1> over_long{};
+		over_long.fill(0x80);
+		over_long.back() = 0x01;
+		uint64_t value;
+		for (std::size_t size : {breep::detail::max_varint_size, breep::detail::max_varint_size + 1}) {
+			if (breep::detail::read_varint(over_long.data(), size, value) <= breep::detail::max_varint_size) {
+				std::cerr << "Over-long varint (" << size << " octets available) was not reported as malformed.\n";
+				ok = false;
+			}
+		}
+		return ok;
+	}
+
+	bool max_frame_size() {
+		const unsigned short port = 3583;
+		const std::size_t max_size = 4096;
+
+		breep::tcp::peer_manager sender(port);
+		breep::tcp::peer_manager receiver(port + 1);
+		receiver.io().max_frame_size(max_size);
+
+		std::atomic<std::size_t> small_frames{0}, big_frames{0}, disconnections{0};
+		receiver.add_data_listener([&](breep::tcp::peer_manager&, const breep::tcp::peer&, breep::cuint8_random_iterator,
+		                               std::size_t size, bool) {
+			++(size > max_size ? big_frames : small_frames);
+		});
+		receiver.add_disconnection_listener([&](breep::tcp::peer_manager&, const breep::tcp::peer&) {
+			++disconnections;
+		});
+
+		sender.run();
+		if (!receiver.connect(boost::asio::ip::address_v4::loopback(), port)) {
+			std::cerr << "Failed to connect.\n";
+			return false;
+		}
+		for (int i = 0 ; i < 100 && sender.peers().empty() ; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+
+		sender.send_to_all(std::vector<uint8_t>(max_size / 2, 1));
+		for (int i = 0 ; i < 100 && small_frames == 0 ; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		sender.send_to_all(std::vector<uint8_t>(max_size * 4, 2));
+		for (int i = 0 ; i < 300 && disconnections == 0 ; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		receiver.disconnect();
+		sender.disconnect();
+		receiver.join();
+		sender.join();
+
+		if (small_frames != 1 || big_frames != 0 || disconnections != 1) {
+			std::cerr << "Frame over max_frame_size was not refused (" << small_frames << " small frames, " << big_frames
+			          << " big frames and " << disconnections << " disconnections).\n";
+			return false;
+		}
+		return true;
+	}
+}
+
+int main() {
+	const bool ok = varints();
+	return max_frame_size() && ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file stream_test.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Sends a stream to a peer, and checks that sending another stream with the same id to the same peer
+ * throws breep::invalid_state without disturbing the first one.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <breep/network/tcp.hpp>
+
+int main() {
+	const unsigned short port = 3579;
+	const std::size_t size = 8 * 1024 * 1024;
+
+	breep::tcp::network sender(port);
+	breep::tcp::network receiver(port + 1);
+
+	std::atomic<std::size_t> received{0};
+	std::atomic<bool> complete{false};
+	receiver.add_stream_listener([&](breep::tcp::network&, const breep::tcp::peer&, breep::stream_id id, uint64_t offset,
+	                                 breep::cuint8_random_iterator, std::size_t chunk_size, bool last) {
+		if (id == 1 && offset == received) {
+			received += chunk_size;
+			complete = last;
+		}
+		// keeping the stream in flight for a while
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	});
+
+	sender.awake();
+	if (!receiver.connect(boost::asio::ip::address_v4::loopback(), port)) {
+		std::cerr << "Failed to connect.\n";
+		return 1;
+	}
+	for (int i = 0 ; i < 100 && (sender.peers().empty() || receiver.peers().empty()) ; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	if (sender.peers().empty()) {
+		std::cerr << "Peers did not connect.\n";
+		return 1;
+	}
+	const breep::tcp::peer& target = sender.peers().begin()->second;
+
+	std::vector<uint8_t> data(size, 42);
+	bool first_sent{false};
+	std::thread first([&] {
+		first_sent = sender.send_stream(target, 1, data.cbegin(), data.cend());
+	});
+
+	while (received == 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	bool thrown{false};
+	try {
+		sender.send_stream(target, 1, data.cbegin(), data.cend());
+	} catch (const breep::invalid_state&) {
+		thrown = true;
+	}
+
+	first.join();
+
+	receiver.disconnect();
+	sender.disconnect();
+	receiver.join();
+	sender.join();
+
+	if (!thrown) {
+		std::cerr << "Sending a stream id already in use did not throw.\n";
+		return 1;
+	}
+	if (!first_sent || !complete || received != size) {
+		std::cerr << "The first stream did not complete (" << received << " octets received).\n";
+		return 1;
+	}
+	return 0;
+}
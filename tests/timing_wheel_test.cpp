@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file timing_wheel_test.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Checks that detail::timing_wheel expires values at their exact tick, whichever of its levels they were
+ * scheduled in, that deadlines beyond its span are clamped to it, and that values cancelled the way its users
+ * cancel them (scheduling weak pointers, and ignoring the expired ones) are still handed back and forgotten.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <breep/network/detail/timing_wheel.hpp>
+
+namespace {
+
+	template <typename T>
+	using wheel = breep::detail::timing_wheel<T>;
+	using clock = std::chrono::steady_clock;
+
+	const clock::duration resolution = std::chrono::milliseconds(1);
+	const clock::time_point start = clock::now();
+
+	clock::time_point at(uint64_t tick) {
+		return start + resolution * tick;
+	}
+
+	// advances the wheel up to \em tick, and returns the values that expired.
+	std::vector<uint64_t> advance(wheel<uint64_t>& w, uint64_t tick) {
+		std::vector<uint64_t> expired;
+		w.advance(at(tick), [&expired](uint64_t value) {
+			expired.push_back(value);
+		});
+		return expired;
+	}
+
+	// every value is the tick it is scheduled for: checks that it expires at this exact tick.
+	bool expires_at_deadline(wheel<uint64_t>& w, const std::vector<uint64_t>& deadlines) {
+		for (uint64_t deadline : deadlines) {
+			std::vector<uint64_t> expired = advance(w, deadline - 1);
+			if (!expired.empty()) {
+				std::cerr << expired.size() << " value(s) expired early (first one due at tick " << expired.front()
+				          << ", expired by tick " << deadline - 1 << ").\n";
+				return false;
+			}
+			expired = advance(w, deadline);
+			if (expired.size() != 1 || expired.front() != deadline) {
+				std::cerr << "Value due at tick " << deadline << " did not expire on time.\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool schedule_and_cascade() {
+		constexpr uint64_t slots = wheel<uint64_t>::slots_per_level;
+		// values of each of the 4 levels: the last ones are only reached by cascading down every level
+		const std::vector<uint64_t> deadlines {
+				1, 5, slots - 1,
+				slots, slots * 7 + 3, slots * slots - 1,
+				slots * slots, slots * slots * 9 + slots * 5 + 1, slots * slots * slots - 1,
+				slots * slots * slots, slots * slots * slots * 11 + slots * slots * 7 + slots * 3 + 2, wheel<uint64_t>::span - 1
+		};
+
+		wheel<uint64_t> w(resolution, start);
+		// scheduled in reverse order, the slots being filled in no particular order
+		for (auto it = deadlines.rbegin() ; it != deadlines.rend() ; ++it) {
+			w.schedule(at(*it), *it);
+		}
+		if (w.size() != deadlines.size()) {
+			std::cerr << "Wheel holds " << w.size() << " values, " << deadlines.size() << " expected.\n";
+			return false;
+		}
+		if (!expires_at_deadline(w, deadlines)) {
+			return false;
+		}
+		if (w.size() != 0) {
+			std::cerr << "Wheel still holds " << w.size() << " values once they all expired.\n";
+			return false;
+		}
+
+		// deadlines already passed expire at the next tick
+		const uint64_t now = deadlines.back();
+		w.schedule(start, now + 1);
+		w.schedule(at(now), now + 1);
+		const std::vector<uint64_t> expired = advance(w, now + 1);
+		if (expired.size() != 2) {
+			std::cerr << "Values scheduled in the past did not expire at the next tick.\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool beyond_span() {
+		constexpr uint64_t span = wheel<uint64_t>::span;
+		const uint64_t now = 1000;
+
+		wheel<uint64_t> w(resolution, start);
+		advance(w, now);
+		// clamped to the last tick covered by the wheel
+		w.schedule(at(now + span), now + span - 1);
+		w.schedule(at(now + span * 4), now + span - 1);
+
+		std::vector<uint64_t> expired = advance(w, now + span - 2);
+		if (!expired.empty()) {
+			std::cerr << "Deadline beyond the wheel's span expired before the end of the span.\n";
+			return false;
+		}
+		expired = advance(w, now + span - 1);
+		if (expired.size() != 2) {
+			std::cerr << "Deadlines beyond the wheel's span were not clamped to it (" << expired.size() << " expired).\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool cancel() {
+		wheel<std::weak_ptr<int>> w(resolution, start);
+		auto kept = std::make_shared<int>(1);
+		auto cancelled = std::make_shared<int>(2);
+		w.schedule(at(10), kept);
+		w.schedule(at(10), cancelled);
+		w.schedule(at(2000), cancelled);
+		cancelled.reset();
+
+		std::size_t live{0}, dropped{0};
+		w.advance(at(5000), [&](std::weak_ptr<int>&& value) {
+			++(value.lock() ? live : dropped);
+		});
+		if (live != 1 || dropped != 2 || w.size() != 0) {
+			std::cerr << "Cancelled values were not handed back (" << live << " live, " << dropped << " cancelled, "
+			          << w.size() << " left).\n";
+			return false;
+		}
+		return true;
+	}
+}
+
+int main() {
+	bool ok = schedule_and_cascade();
+	ok = beyond_span() && ok;
+	ok = cancel() && ok;
+	return ok ? 0 : 1;
+}
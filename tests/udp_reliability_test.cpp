@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                               //
+// Copyright 2017-2018 Lucas Lazare.                                                             //
+// This file is part of Breep project which is released under the                                //
+// European Union Public License v1.1. If a copy of the EUPL was                                 //
+// not distributed with this software, you can obtain one at :                                   //
+// https://joinup.ec.europa.eu/community/eupl/og_page/european-union-public-licence-eupl-v11     //
+//                                                                                               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * @file udp_reliability_test.cpp
+ * @author Lucas Lazare
+ * @since 1.1.0
+ *
+ * Connects two udp peers through a relay that drops and reorders datagrams in both directions, and checks that
+ * the frames sent reliably are all delivered, intact and in order (exercising the reordering of the received
+ * segments, the acknowledgements and the retransmissions of the udp io_manager).
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <breep/network/udp.hpp>
+
+namespace {
+
+	/**
+	 * Forwards the datagrams of a client to a target, and back, dropping and reordering some of them.
+	 * Runs its own thread.
+	 */
+	class lossy_relay {
+	public:
+		lossy_relay(unsigned short port, unsigned short target_port)
+				: m_io_service()
+				, m_front(m_io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), port))
+				, m_back(m_io_service, boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+				, m_target(boost::asio::ip::address_v4::loopback(), target_port)
+		{}
+
+		void start() {
+			receive(m_to_target);
+			receive(m_to_client);
+			m_thread = std::thread([this] { m_io_service.run(); });
+		}
+
+		void stop() {
+			m_io_service.stop();
+			m_thread.join();
+		}
+
+		std::size_t dropped() const {
+			return m_to_target.dropped + m_to_client.dropped;
+		}
+
+		std::size_t reordered() const {
+			return m_to_target.reordered + m_to_client.reordered;
+		}
+
+	private:
+		// the first datagrams of each direction go through untouched, for the handshake to complete quickly.
+		static constexpr std::size_t untouched_datagrams = 4;
+
+		struct direction {
+			explicit direction(bool to_target_) : to_target(to_target_) {}
+
+			const bool to_target;
+			std::array<uint8_t, 2048> buffer{};
+			boost::asio::ip::udp::endpoint sender{};
+			std::size_t count{0};
+			// datagram held back, to be sent after the next one
+			std::vector<uint8_t> held{};
+			std::atomic<std::size_t> dropped{0};
+			std::atomic<std::size_t> reordered{0};
+		};
+
+		void receive(direction& d) {
+			boost::asio::ip::udp::socket& socket = d.to_target ? m_front : m_back;
+			socket.async_receive_from(boost::asio::buffer(d.buffer), d.sender, [this, &d](const boost::system::error_code& ec, std::size_t length) {
+				if (ec == boost::asio::error::operation_aborted) {
+					return;
+				}
+				if (!ec) {
+					if (d.to_target) {
+						m_client = d.sender;
+					}
+					forward(d, length);
+				}
+				receive(d);
+			});
+		}
+
+		void forward(direction& d, std::size_t length) {
+			const std::size_t n = d.count++;
+			if (n >= untouched_datagrams && n % 7 == 0) {
+				++d.dropped;
+				return;
+			}
+			if (n >= untouched_datagrams && n % 5 == 0 && d.held.empty()) {
+				d.held.assign(d.buffer.data(), d.buffer.data() + length);
+				++d.reordered;
+				return;
+			}
+			send(d, d.buffer.data(), length);
+			if (!d.held.empty()) {
+				send(d, d.held.data(), d.held.size());
+				d.held.clear();
+			}
+		}
+
+		void send(const direction& d, const uint8_t* data, std::size_t length) {
+			boost::system::error_code ec;
+			if (d.to_target) {
+				m_back.send_to(boost::asio::buffer(data, length), m_target, 0, ec);
+			} else {
+				m_front.send_to(boost::asio::buffer(data, length), m_client, 0, ec);
+			}
+		}
+
+		boost::asio::io_service m_io_service;
+		// faces the client
+		boost::asio::ip::udp::socket m_front;
+		// faces the target
+		boost::asio::ip::udp::socket m_back;
+		const boost::asio::ip::udp::endpoint m_target;
+		boost::asio::ip::udp::endpoint m_client{};
+		direction m_to_target{true};
+		direction m_to_client{false};
+		std::thread m_thread{};
+	};
+
+	// frames of various sizes, some of them spanning several datagrams.
+	std::vector<uint8_t> message(uint32_t index) {
+		std::vector<uint8_t> data(4 + (index % 10 == 0 ? 4000 : index % 50));
+		for (std::size_t i = 0 ; i < 4 ; ++i) {
+			data[i] = static_cast<uint8_t>(index >> (8 * i));
+		}
+		for (std::size_t i = 4 ; i < data.size() ; ++i) {
+			data[i] = static_cast<uint8_t>(index + i);
+		}
+		return data;
+	}
+}
+
+int main() {
+	const unsigned short port = 3586;
+	const uint32_t messages = 500;
+
+	breep::udp::peer_manager receiver(port);
+	breep::udp::peer_manager sender(port + 1);
+	lossy_relay relay(port + 2, port);
+
+	std::atomic<uint32_t> received{0};
+	std::atomic<bool> corrupted{false};
+	receiver.add_data_listener([&](breep::udp::peer_manager&, const breep::udp::peer&, breep::cuint8_random_iterator data,
+	                               std::size_t size, bool) {
+		const std::vector<uint8_t> expected = message(received);
+		if (size != expected.size() || !std::equal(expected.cbegin(), expected.cend(), data)) {
+			corrupted = true;
+		}
+		++received;
+	});
+
+	receiver.run();
+	relay.start();
+	if (!sender.connect(boost::asio::ip::address_v4::loopback(), port + 2)) {
+		std::cerr << "Failed to connect through the relay.\n";
+		relay.stop();
+		return 1;
+	}
+	for (int i = 0 ; i < 100 && receiver.peers().empty() ; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+
+	for (uint32_t i = 0 ; i < messages ; ++i) {
+		sender.send_to_all(message(i));
+	}
+	for (int i = 0 ; i < 1500 && received < messages && !corrupted ; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	const uint64_t retransmissions = sender.io().statistics().retransmissions;
+
+	sender.disconnect();
+	receiver.disconnect();
+	sender.join();
+	receiver.join();
+	relay.stop();
+
+	if (relay.dropped() == 0 || relay.reordered() == 0) {
+		std::cerr << "The relay did not disturb the datagrams (" << relay.dropped() << " dropped, "
+		          << relay.reordered() << " reordered).\n";
+		return 1;
+	}
+	if (corrupted || received != messages) {
+		std::cerr << "Frames were not delivered in order (" << received << " out of " << messages << " received"
+		          << (corrupted ? ", some out of order or corrupted" : "") << ").\n";
+		return 1;
+	}
+	if (retransmissions == 0) {
+		std::cerr << "Dropped datagrams were delivered without being retransmitted.\n";
+		return 1;
+	}
+	return 0;
+}